@@ -0,0 +1,193 @@
+/*
+ * Created 190619 lynnl
+ *
+ * Workload runner shared by the in-process benches
+ *
+ * Each thread runs `ops' timed calls of a workload's op()
+ *  per call latency is kept so percentiles are exact
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define NSEC_PER_SEC    1000000000ULL
+
+struct bench_workload {
+    const char *name;
+    /* Untimed  per thread  *priv handed to op() and teardown() */
+    int (*setup)(unsigned tid, void **priv);
+    /* Timed  i counts from 0 per thread  returns 0 or -errno */
+    int (*op)(void *priv, uint64_t i);
+    void (*teardown)(void *priv);
+};
+
+struct bench_thread {
+    pthread_t thread;
+    unsigned tid;
+    const struct bench_workload *w;
+    uint64_t ops;
+    uint64_t *lat;      /* ns per op */
+    uint64_t errors;
+    int err;            /* Last op error  positive errno */
+    int e;              /* setup() result */
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned ready;
+    int go;
+} bench_start = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0};
+
+static inline uint64_t bench_now(void)
+{
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+/* xorshift64*  per thread state  never seed with 0 */
+static inline uint64_t bench_rand(uint64_t *s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 2685821657736338717ULL;
+}
+
+static void *bench_thread(void *arg)
+{
+    struct bench_thread *t = (struct bench_thread *) arg;
+    void *priv = NULL;
+    uint64_t i, t0, t1;
+    int e;
+
+    t->e = t->w->setup != NULL ? t->w->setup(t->tid, &priv) : 0;
+
+    (void) pthread_mutex_lock(&bench_start.lock);
+    bench_start.ready++;
+    (void) pthread_cond_broadcast(&bench_start.cond);
+    while (!bench_start.go) (void) pthread_cond_wait(&bench_start.cond, &bench_start.lock);
+    (void) pthread_mutex_unlock(&bench_start.lock);
+
+    if (t->e != 0) return NULL;
+
+    t0 = bench_now();
+    for (i = 0; i < t->ops; i++) {
+        e = t->w->op(priv, i);
+        t1 = bench_now();
+        t->lat[i] = t1 - t0;
+        t0 = t1;
+        if (e < 0) {
+            t->errors++;
+            t->err = -e;
+        }
+    }
+
+    if (t->w->teardown != NULL) t->w->teardown(priv);
+    return NULL;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* `lat' sorted ascending  nearest-rank */
+static inline double bench_pct(const uint64_t *lat, uint64_t n, double q)
+{
+    uint64_t k = (uint64_t) (q * n);
+    if (k >= n) k = n - 1;
+    return lat[k] / 1e3;
+}
+
+static void bench_header(void)
+{
+    printf("%-12s %4s %10s %12s %9s %9s %9s %9s %9s %8s\n",
+            "workload", "thr", "ops", "ops/s",
+            "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)", "errors");
+}
+
+/**
+ * Run `w' on `threads' threads  `ops' calls each  and print a result line
+ * @return      0 if success  -1 if any op failed or setup/resource failure
+ */
+static int bench_run(const struct bench_workload *w, unsigned threads, uint64_t ops)
+{
+    struct bench_thread *t;
+    uint64_t *lat = NULL, n = 0, errors = 0, t0, t1;
+    unsigned i, nt = 0;
+    int e = -1, err = 0;
+
+    t = (struct bench_thread *) calloc(threads, sizeof(*t));
+    if (t == NULL) goto out;
+    lat = (uint64_t *) malloc(threads * ops * sizeof(*lat));
+    if (lat == NULL) goto out;
+
+    bench_start.ready = 0;
+    bench_start.go = 0;
+
+    for (nt = 0; nt < threads; nt++) {
+        t[nt].tid = nt;
+        t[nt].w = w;
+        t[nt].ops = ops;
+        t[nt].lat = lat + nt * ops;
+        if (pthread_create(&t[nt].thread, NULL, bench_thread, &t[nt]) != 0) {
+            fprintf(stderr, "pthread_create(3) fail  errno: %d\n", errno);
+            break;
+        }
+    }
+
+    (void) pthread_mutex_lock(&bench_start.lock);
+    while (bench_start.ready < nt) (void) pthread_cond_wait(&bench_start.cond, &bench_start.lock);
+    bench_start.go = 1;
+    t0 = bench_now();
+    (void) pthread_cond_broadcast(&bench_start.cond);
+    (void) pthread_mutex_unlock(&bench_start.lock);
+
+    for (i = 0; i < nt; i++) (void) pthread_join(t[i].thread, NULL);
+    t1 = bench_now();
+
+    if (nt != threads) goto out;
+
+    for (i = 0; i < nt; i++) {
+        if (t[i].e != 0) {
+            fprintf(stderr, "%s: setup fail on thread %u  errno: %d\n", w->name, i, -t[i].e);
+            goto out;
+        }
+        errors += t[i].errors;
+        if (t[i].err != 0) err = t[i].err;
+    }
+
+    n = (uint64_t) nt * ops;
+    qsort(lat, n, sizeof(*lat), bench_cmp);
+
+    printf("%-12s %4u %10llu %12.0f %9.2f %9.2f %9.2f %9.2f %9.2f %8llu\n",
+            w->name, nt, (unsigned long long) n,
+            n * (double) NSEC_PER_SEC / (t1 - t0),
+            bench_pct(lat, n, 0.50), bench_pct(lat, n, 0.90),
+            bench_pct(lat, n, 0.99), bench_pct(lat, n, 0.999),
+            lat[n - 1] / 1e3, (unsigned long long) errors);
+    if (errors != 0) {
+        fprintf(stderr, "%s: last errno: %d (%s)\n", w->name, err, strerror(err));
+        goto out;
+    }
+
+    e = 0;
+out:
+    free(lat);
+    free(t);
+    return e;
+}
+
+#endif
@@ -0,0 +1,422 @@
+/*
+ * Created 190619 lynnl
+ *
+ * In-process clockfs benchmark  calls clockfs_ops directly
+ *  or clock_ll_ops if built with -DBENCH_LL  see: bench/Makefile
+ *
+ * Same option handling as the fs main()  e.g. -o lazy  -o log=ring
+ * Records of the log workload reach syslog(3) under -o log-level=debug
+ * clock_update() runs alongside unless lazy  just as when mounted
+ *
+ * -i then holds the clock file open without reading  as an idle `tail -f'
+ *  and reports CPU the process burns meanwhile(getrusage(2))
+ *  the updater's ticks under the ticker  nothing if lazy
+ */
+
+#ifdef BENCH_LL
+#define main clockfs_ll_main
+#include "../clockfs/clockfs_ll.c"
+#undef main
+#define cb_cfg      clockfs_ll_cfg
+#define cb_opts     clockfs_ll_opts
+#else
+#define main clockfs_main
+#include "../clockfs/clockfs.c"
+#undef main
+#define cb_cfg      clockfs_cfg
+#define cb_opts     clockfs_opts
+#endif
+
+#include <getopt.h>
+#include <sys/resource.h>
+
+#ifdef BENCH_LL
+#include "fuse_shim.h"
+#endif
+#include "bench.h"
+
+#define READ_SIZE       4096
+
+struct cb_thread {
+    struct fuse_file_info fi;
+#ifdef BENCH_LL
+    struct fuse_req req;
+#endif
+    char buf[READ_SIZE];
+};
+
+static int cb_thread_setup(unsigned tid, void **priv)
+{
+    struct cb_thread *t;
+
+    UNUSED(tid);
+
+    t = (struct cb_thread *) calloc(1, sizeof(*t));
+    if (t == NULL) return -ENOMEM;
+#ifdef BENCH_LL
+    t->req.sink = t->buf;
+    t->req.sinksz = sizeof(t->buf);
+#endif
+
+    *priv = t;
+    return 0;
+}
+
+#ifdef BENCH_LL
+/* Low-level ops reply rather than return */
+static inline int cb_result(struct cb_thread *t)
+{
+    assert(t->req.replied == 1);
+    return t->req.err != 0 ? -t->req.err : (int) t->req.size;
+}
+#endif
+
+static int cb_open(struct cb_thread *t)
+{
+    t->fi.flags = O_RDONLY;
+    t->fi.fh = 0;
+#ifdef BENCH_LL
+    fuse_req_reset(&t->req);
+    clock_ll_ops.open(&t->req, 2, &t->fi);
+    return cb_result(t);
+#else
+    return clockfs_ops.open(file_path, &t->fi);
+#endif
+}
+
+static int cb_read(struct cb_thread *t)
+{
+#ifdef BENCH_LL
+    fuse_req_reset(&t->req);
+    clock_ll_ops.read(&t->req, 2, sizeof(t->buf), 0, &t->fi);
+    return cb_result(t);
+#else
+    return clockfs_ops.read(file_path, t->buf, sizeof(t->buf), 0, &t->fi);
+#endif
+}
+
+static int cb_release(struct cb_thread *t)
+{
+#ifdef BENCH_LL
+    fuse_req_reset(&t->req);
+    clock_ll_ops.release(&t->req, 2, &t->fi);
+    return cb_result(t);
+#else
+    return clockfs_ops.release(file_path, &t->fi);
+#endif
+}
+
+static int getattr_op(void *priv, uint64_t i)
+{
+    struct cb_thread *t = (struct cb_thread *) priv;
+
+    UNUSED(i);
+#ifdef BENCH_LL
+    fuse_req_reset(&t->req);
+    clock_ll_ops.getattr(&t->req, 2, NULL);
+    return cb_result(t);
+#else
+    {
+        struct stat st;
+        UNUSED(t);
+        return clockfs_ops.getattr(file_path, &st);
+    }
+#endif
+}
+
+#ifdef BENCH_LL
+static int lookup_op(void *priv, uint64_t i)
+{
+    struct cb_thread *t = (struct cb_thread *) priv;
+
+    UNUSED(i);
+    fuse_req_reset(&t->req);
+    clock_ll_ops.lookup(&t->req, 1, file_name);
+    return cb_result(t);
+}
+#endif
+
+static int read_setup(unsigned tid, void **priv)
+{
+    int e = cb_thread_setup(tid, priv);
+    if (e == 0) {
+        e = cb_open((struct cb_thread *) *priv);
+        if (e < 0) free(*priv);
+    }
+    return e < 0 ? e : 0;
+}
+
+static void read_teardown(void *priv)
+{
+    (void) cb_release((struct cb_thread *) priv);
+    free(priv);
+}
+
+/*
+ * Layout of fmt_datetime()  '0' stands for a digit  '+' for either sign
+ * A torn snapshot or a half-updated cache shows up as a misplaced
+ *  separator  a non-digit or an out of range field
+ */
+static const char dt_layout[] = "00/00/00 00:00:00.000+0000\n";
+
+static inline int dt_field(const char *p)
+{
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+static int dt_valid(const char *s, int n)
+{
+    int k;
+
+    if (n != DT_LEN) return 0;
+
+    for (k = 0; k < DT_LEN; k++) {
+        if (dt_layout[k] == '0') {
+            if (s[k] < '0' || s[k] > '9') return 0;
+        } else if (dt_layout[k] == '+') {
+            if (s[k] != '+' && s[k] != '-') return 0;
+        } else if (s[k] != dt_layout[k]) {
+            return 0;
+        }
+    }
+
+    return dt_field(s + 3) >= 1 && dt_field(s + 3) <= 12 &&
+            dt_field(s + 6) >= 1 && dt_field(s + 6) <= 31 &&
+            dt_field(s + 9) < 24 && dt_field(s + 12) < 60 &&
+            dt_field(s + 15) < 60 && dt_field(s + 24) < 60;
+}
+
+/*
+ * Read of an already open handle  the steady state of `tail -f'-like readers
+ * Every read is checked against the layout  run with several threads
+ *  and a short resolution so readers race the updater
+ */
+static int read_op(void *priv, uint64_t i)
+{
+    struct cb_thread *t = (struct cb_thread *) priv;
+    int n;
+
+    UNUSED(i);
+    n = cb_read(t);
+    if (n < 0) return n;
+    return dt_valid(t->buf, n) ? 0 : -EIO;
+}
+
+/*
+ * A full `cat clock.txt'  open  read  release
+ * Unless lazy  an open with no other handle waits a tick(see: ticker_open())
+ *  which the idle updater runs at once  so expect a wakeup and an update per op
+ *  on a single thread  not a resolution
+ */
+static int openread_op(void *priv, uint64_t i)
+{
+    struct cb_thread *t = (struct cb_thread *) priv;
+    int e;
+
+    UNUSED(i);
+    e = cb_open(t);
+    if (e < 0) return e;
+    e = read_op(t, 0);
+    (void) cb_release(t);
+    return e;
+}
+
+#ifndef BENCH_LL
+static int readdir_filler(void *buf, const char *name, const struct stat *st, off_t off)
+{
+    UNUSED(name);
+    UNUSED(st);
+    UNUSED(off);
+    (*(unsigned *) buf)++;
+    return 0;
+}
+#endif
+
+static int readdir_op(void *priv, uint64_t i)
+{
+    struct cb_thread *t = (struct cb_thread *) priv;
+
+    UNUSED(i);
+#ifdef BENCH_LL
+    fuse_req_reset(&t->req);
+    clock_ll_ops.readdir(&t->req, 1, sizeof(t->buf), 0, &t->fi);
+    return cb_result(t);
+#else
+    {
+        unsigned n = 0;
+        int e = clockfs_ops.readdir("/", &n, readdir_filler, 0, &t->fi);
+        return e != 0 ? e : (n == 3 ? 0 : -EIO);
+    }
+#endif
+}
+
+/*
+ * One debug record per op through the runtime backend  as SYSLOG_DBG() of
+ *  a DEBUG build would emit  filtered unless -o log-level=debug
+ * Compare the sync backend with -o log=ring
+ */
+static int log_op(void *priv, uint64_t i)
+{
+    UNUSED(priv);
+    LOG_EMIT(LOG_DEBUG, "[DBG] clockbench  op: %llu", (unsigned long long) i);
+    return 0;
+}
+
+static const struct bench_workload workloads[] = {
+    {"getattr", cb_thread_setup, getattr_op, free},
+#ifdef BENCH_LL
+    {"lookup", cb_thread_setup, lookup_op, free},
+#endif
+    {"read", read_setup, read_op, read_teardown},
+    {"openread", cb_thread_setup, openread_op, free},
+    {"readdir", cb_thread_setup, readdir_op, free},
+    {"log", cb_thread_setup, log_op, free},
+};
+
+#define NWORKLOADS  (sizeof(workloads) / sizeof(*workloads))
+
+static inline uint64_t cpu_usec(void)
+{
+    struct rusage ru;
+
+    (void) getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+            (uint64_t) (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+/**
+ * Hold a handle open for `secs' seconds  see: -i
+ * @return      0 if success  -errno otherwise
+ */
+static int idle_run(unsigned secs)
+{
+    struct cb_thread t;
+    uint64_t cpu, ticks;
+    int e;
+
+    (void) memset(&t, 0, sizeof(t));
+#ifdef BENCH_LL
+    t.req.sink = t.buf;
+    t.req.sinksz = sizeof(t.buf);
+#endif
+
+    e = cb_open(&t);
+    if (e < 0) return e;
+
+    ticks = ticker.ticks;
+    cpu = cpu_usec();
+    (void) sleep(secs);
+    cpu = cpu_usec() - cpu;
+    ticks = ticker.ticks - ticks;
+
+    (void) cb_release(&t);
+
+    printf("idle %us  cpu: %.3fms (%.3f%%)  ticks: %llu\n",
+            secs, cpu / 1e3, cpu / (secs * 1e4), (unsigned long long) ticks);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    unsigned i;
+
+    fprintf(stderr,
+        "usage: %s [-w workload[,...]] [-t threads] [-n ops] [-i secs] [-o fsopt[,...]]\n"
+        "  -i   hold the clock file open idle for secs  report CPU used\n"
+        "workloads:", prog);
+    for (i = 0; i < NWORKLOADS; i++) fprintf(stderr, " %s", workloads[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char *fsargv[3] = {argv[0], "-o", NULL};
+    struct fuse_args args = FUSE_ARGS_INIT(1, fsargv);
+    char *wl = NULL;
+    unsigned threads = 1;
+    uint64_t ops = 1000000;
+    unsigned idle = 0;
+    pthread_t clock_thread;
+    char buf[DATA_BUFSZ];
+    size_t len;
+    char *w, *save;
+    unsigned i;
+    int c, e = 1;
+
+    while ((c = getopt(argc, argv, "w:t:n:i:o:h")) != -1) {
+        switch (c) {
+        case 'w': wl = optarg; break;
+        case 't': threads = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'n': ops = strtoull(optarg, NULL, 0); break;
+        case 'i': idle = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'o': fsargv[2] = optarg; args.argc = 3; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (threads == 0 || ops == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (fuse_opt_parse(&args, &cb_cfg, cb_opts, NULL) == -1) return 1;
+
+    if (cb_cfg.resolution == 0) {
+        fprintf(stderr, "resolution must be positive\n");
+        return 1;
+    }
+    ticker.resolution = cb_cfg.resolution;
+
+    e = log_parse_level(cb_cfg.log_level);
+    if (e < 0) {
+        fprintf(stderr, "bad log-level: %s\n", cb_cfg.log_level);
+        return 1;
+    }
+    if (log_init(e, cb_cfg.log_ring) != 0) {
+        fprintf(stderr, "log_init() fail  errno: %d\n", errno);
+        return 1;
+    }
+
+    if (cb_cfg.lazy) {
+        len = fmt_datetime(buf, sizeof(buf));
+        (void) snapshot_publish(&file_data, buf, len);
+    } else if (pthread_create(&clock_thread, NULL, &clock_update, &args) != 0) {
+        /* clock_update() only passes its argument to the shim */
+        fprintf(stderr, "pthread_create(3) fail  errno: %d\n", errno);
+        e = 1;
+        goto out_log;
+    }
+
+    printf("mode: %s  resolution: %ums\n", cb_cfg.lazy ? "lazy" : "ticker", ticker.resolution);
+    bench_header();
+
+    e = 0;
+    if (wl == NULL) {
+        for (i = 0; i < NWORKLOADS && e == 0; i++) e = bench_run(&workloads[i], threads, ops);
+    } else {
+        for (w = strtok_r(wl, ",", &save); w != NULL && e == 0; w = strtok_r(NULL, ",", &save)) {
+            for (i = 0; i < NWORKLOADS; i++) {
+                if (!strcmp(w, workloads[i].name)) break;
+            }
+            if (i == NWORKLOADS) {
+                fprintf(stderr, "unknown workload: %s\n", w);
+                e = -1;
+            } else {
+                e = bench_run(&workloads[i], threads, ops);
+            }
+        }
+    }
+    if (e == 0 && idle != 0) e = idle_run(idle);
+    e = e != 0;
+
+    if (!cb_cfg.lazy) {
+        ticker_stop(&ticker);
+        (void) pthread_join(clock_thread, NULL);
+    }
+
+out_log:
+    log_fini();
+    return e;
+}
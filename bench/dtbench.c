@@ -0,0 +1,265 @@
+/*
+ * Created 190619 lynnl
+ *
+ * fmt_datetime() correctness check and micro-benchmark
+ *  see: clockfs/datetime.h  bench/Makefile
+ *
+ * -c sweeps second by second across DST and year boundaries
+ *  comparing the cached formatter with localtime_r(3) + strftime(3)
+ *  forward  backward  and alternating between both sides of the boundary
+ *  as racing callers or a clock stepped back would
+ *  then probes random times  back and forth  so the cache keeps refilling
+ * Otherwise times fmt_datetime() against the same reference
+ *  under the zone in TZ
+ */
+
+#include "../clockfs/datetime.h"
+
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "bench.h"
+
+#define SWEEP_SECS      (2 * 60 * 60)   /* Either side of a boundary */
+#define PROBES          200000
+#define DT_BUFSZ        64      /* Room for a longer reference */
+
+struct dt_window {
+    const char *tz;
+    const char *what;
+    time_t at;          /* First second after the boundary */
+    long gmtoff;        /* At `at'  proves the zone really loaded */
+};
+
+static const struct dt_window windows[] = {
+    {"America/New_York", "dst start", 1552201200, -4 * 3600},
+    {"America/New_York", "dst end", 1572760800, -5 * 3600},
+    {"America/New_York", "new year", 1577854800, -5 * 3600},
+    {"America/New_York", "leap day", 1583038800, -5 * 3600},
+    /* Half-hour DST shift */
+    {"Australia/Lord_Howe", "dst start", 1570289400, 11 * 3600},
+    {"Australia/Lord_Howe", "dst end", 1586012400, 10 * 3600 + 1800},
+    /* Quarter-hour offset */
+    {"Asia/Kathmandu", "new year", 1577816100, 5 * 3600 + 45 * 60},
+    {"UTC", "new year", 1577836800, 0},
+};
+
+#define NWINDOWS    (sizeof(windows) / sizeof(*windows))
+
+/**
+ * What fmt_datetime() replaced  the reference of every check
+ * @return      length of formatted string  0 if localtime_r(3) failed
+ */
+static size_t ref_datetime(char *str, size_t n, const struct timeval *tv)
+{
+    char date[32];
+    char zone[8];
+    struct tm tm;
+    time_t sec = tv->tv_sec;
+    int len;
+
+    if (localtime_r(&sec, &tm) == NULL) return 0;
+    (void) strftime(date, sizeof(date), "%y/%m/%d %H:%M:%S", &tm);
+    (void) strftime(zone, sizeof(zone), "%z", &tm);
+
+    len = snprintf(str, n, "%s.%03ld%s\n", date, (long) tv->tv_usec / 1000, zone);
+    return len < 0 ? 0 : ((size_t) len < n ? (size_t) len : n - 1);
+}
+
+static void set_tz(const char *tz)
+{
+    (void) setenv("TZ", tz, 1);
+    tzset();
+    /* Cache is per process  not per zone */
+    dt_cache.until = 0;
+}
+
+/**
+ * @return      0 if both formatters agree  -1 otherwise
+ */
+static int check_one(time_t sec, long usec)
+{
+    char got[DT_BUFSZ];
+    char want[DT_BUFSZ];
+    struct timeval tv;
+    size_t n, m;
+
+    tv.tv_sec = sec;
+    tv.tv_usec = (suseconds_t) usec;
+    n = fmt_datetime_at(got, sizeof(got), &tv);
+    m = ref_datetime(want, sizeof(want), &tv);
+    if (n == m && n == DT_LEN && !memcmp(got, want, n)) return 0;
+
+    fprintf(stderr, "mismatch  sec: %lld usec: %ld\n  got:  %.*s  want: %.*s",
+            (long long) sec, usec, (int) n, got, (int) m, want);
+    return -1;
+}
+
+static int check_window(const struct dt_window *w)
+{
+    struct tm tm;
+    time_t sec;
+
+    set_tz(w->tz);
+    if (localtime_r(&w->at, &tm) == NULL || tm.tm_gmtoff != w->gmtoff) {
+        fprintf(stderr, "%s: no zoneinfo?  gmtoff: %ld want: %ld\n",
+                w->tz, (long) tm.tm_gmtoff, w->gmtoff);
+        return -1;
+    }
+
+    for (sec = w->at - SWEEP_SECS; sec < w->at + SWEEP_SECS; sec++) {
+        if (check_one(sec, (long) (sec * 7919 % 1000000)) != 0) {
+            fprintf(stderr, "%s %s: sweep fail\n", w->tz, w->what);
+            return -1;
+        }
+    }
+
+    for (sec = w->at + SWEEP_SECS - 1; sec >= w->at - SWEEP_SECS; sec--) {
+        if (check_one(sec, (long) (sec * 7919 % 1000000)) != 0) {
+            fprintf(stderr, "%s %s: backward sweep fail\n", w->tz, w->what);
+            return -1;
+        }
+    }
+
+    /* After the boundary  then as far before it */
+    for (sec = 0; sec < SWEEP_SECS; sec++) {
+        if (check_one(w->at + sec, 0) != 0 || check_one(w->at - 1 - sec, 999999) != 0) {
+            fprintf(stderr, "%s %s: interleaved fail\n", w->tz, w->what);
+            return -1;
+        }
+    }
+
+    printf("%-20s %-10s ok\n", w->tz, w->what);
+    return 0;
+}
+
+/* Random times in [2000, 2038)  each jump likely lands outside the cache */
+static int check_probes(const char *tz)
+{
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    uint64_t r;
+    unsigned i;
+
+    set_tz(tz);
+    for (i = 0; i < PROBES; i++) {
+        r = bench_rand(&seed);
+        if (check_one((time_t) (946684800 + r % 1200000000), (long) (r >> 40) % 1000000) != 0) {
+            fprintf(stderr, "%s: probe fail\n", tz);
+            return -1;
+        }
+    }
+
+    printf("%-20s %-10s ok\n", tz, "probes");
+    return 0;
+}
+
+static int run_check(void)
+{
+    unsigned i;
+
+    for (i = 0; i < NWINDOWS; i++) {
+        if (check_window(&windows[i]) != 0) return -1;
+    }
+    for (i = 0; i < NWINDOWS; i++) {
+        if (i != 0 && !strcmp(windows[i].tz, windows[i - 1].tz)) continue;
+        if (check_probes(windows[i].tz) != 0) return -1;
+    }
+    return 0;
+}
+
+static int dt_setup(unsigned tid, void **priv)
+{
+    UNUSED(tid);
+    *priv = NULL;
+    return 0;
+}
+
+static int fmt_op(void *priv, uint64_t i)
+{
+    char buf[DT_BUFSZ];
+
+    UNUSED(priv);
+    UNUSED(i);
+    return fmt_datetime(buf, sizeof(buf)) == DT_LEN ? 0 : -EIO;
+}
+
+static int strftime_op(void *priv, uint64_t i)
+{
+    char buf[DT_BUFSZ];
+    struct timeval tv;
+
+    UNUSED(priv);
+    UNUSED(i);
+    (void) gettimeofday(&tv, NULL);
+    return ref_datetime(buf, sizeof(buf), &tv) == DT_LEN ? 0 : -EIO;
+}
+
+static const struct bench_workload workloads[] = {
+    {"fmt", dt_setup, fmt_op, NULL},
+    {"strftime", dt_setup, strftime_op, NULL},
+};
+
+#define NWORKLOADS  (sizeof(workloads) / sizeof(*workloads))
+
+static void usage(const char *prog)
+{
+    unsigned i;
+
+    fprintf(stderr,
+        "usage: %s [-c] [-w workload[,...]] [-t threads] [-n ops]\n"
+        "  -c   check against localtime_r(3) + strftime(3) and exit\n"
+        "workloads:", prog);
+    for (i = 0; i < NWORKLOADS; i++) fprintf(stderr, " %s", workloads[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char *wl = NULL;
+    unsigned threads = 1;
+    uint64_t ops = 1000000;
+    char *w, *save;
+    unsigned i;
+    int check = 0;
+    int c, e = 0;
+
+    while ((c = getopt(argc, argv, "cw:t:n:h")) != -1) {
+        switch (c) {
+        case 'c': check = 1; break;
+        case 'w': wl = optarg; break;
+        case 't': threads = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'n': ops = strtoull(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (threads == 0 || ops == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (check) return run_check() != 0;
+
+    tzset();
+    bench_header();
+
+    if (wl == NULL) {
+        for (i = 0; i < NWORKLOADS && e == 0; i++) e = bench_run(&workloads[i], threads, ops);
+    } else {
+        for (w = strtok_r(wl, ",", &save); w != NULL && e == 0; w = strtok_r(NULL, ",", &save)) {
+            for (i = 0; i < NWORKLOADS; i++) {
+                if (!strcmp(w, workloads[i].name)) break;
+            }
+            if (i == NWORKLOADS) {
+                fprintf(stderr, "unknown workload: %s\n", w);
+                e = -1;
+            } else {
+                e = bench_run(&workloads[i], threads, ops);
+            }
+        }
+    }
+
+    return e != 0;
+}
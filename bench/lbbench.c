@@ -0,0 +1,790 @@
+/*
+ * Created 190619 lynnl
+ *
+ * In-process loopbackfs benchmark  calls loopback_op directly
+ *  no mount  no /dev/fuse  see: bench/Makefile
+ *
+ * A scratch tree is built under -d(default /tmp) and removed on exit:
+ *  tree/f000000...     -f empty files  stat  readdir and ls workloads
+ *  data/t0...          one -s sized file per thread  read/write workloads
+ *  data/a0...          one file per thread grown by -b sized appends
+ *                       back to empty each -s bytes  append workload
+ *  xattr/t0...         one empty file per thread  xattr workload
+ *                       xattrscan browses tree/ instead
+ *  attr/t0...          one empty file per thread  setattr workload
+ *                       cpp copies it to attr/t0.N  touch uses tree/
+ *
+ * Every fs option(-o) goes through lb_setup() as it would on mount
+ *  e.g. -o attr-cache-ttl=1,op-stats
+ */
+
+#define main loopbackfs_main
+#include "../loopbackfs/loopbackfs/loopbackfs.c"
+#undef main
+
+#include <getopt.h>
+#include <dirent.h>
+#include <fuse_lowlevel.h>   /* fuse_add_direntry() */
+
+#include "fuse_shim.h"
+#include "bench.h"
+
+/* Kernel's readdir buffer  filler() reports full past it */
+#define READDIR_BUFSZ       4096
+#define XATTR_NAMES         8
+
+static struct {
+    /* Half of PATH_MAX  leaves room for scratch tree names under it */
+    char root[PATH_MAX / 2];
+    unsigned threads;
+    uint64_t ops;
+    unsigned files;
+    size_t size;
+    size_t bsize;
+    int zero_copy;      /* Use read_buf()/write_buf() if not io=copy */
+    int keep;           /* Leave the scratch tree */
+    char **tree;        /* Paths of tree/f... */
+} lbb = {
+    .threads = 1,
+    .ops = 100000,
+    .files = 1000,
+    .size = 16 << 20,
+    .bsize = 4096,
+};
+
+/* Per thread state of data and xattr workloads */
+struct lbb_thread {
+    char path[PATH_MAX];
+    struct fuse_file_info fi;
+    uint64_t seed;
+    char *buf;
+    int rand;
+    int write;
+};
+
+static int lbb_thread_new(unsigned tid, const char *sub, void **priv)
+{
+    struct lbb_thread *t;
+
+    t = (struct lbb_thread *) calloc(1, sizeof(*t));
+    if (t == NULL) return -ENOMEM;
+
+    t->buf = (char *) malloc(lbb.bsize);
+    if (t->buf == NULL) {
+        free(t);
+        return -ENOMEM;
+    }
+    (void) memset(t->buf, 'a' + tid % 26, lbb.bsize);
+    t->seed = 0x9e3779b97f4a7c15ULL * (tid + 1);
+    (void) snprintf(t->path, sizeof(t->path), "%s/%s/t%u", lbb.root, sub, tid);
+
+    *priv = t;
+    return 0;
+}
+
+static void lbb_thread_free(void *priv)
+{
+    struct lbb_thread *t = (struct lbb_thread *) priv;
+    free(t->buf);
+    free(t);
+}
+
+static int stat_op(void *priv, uint64_t i)
+{
+    uint64_t *seed = (uint64_t *) priv;
+    struct stat st;
+
+    UNUSED(i);
+    return loopback_op.getattr(lbb.tree[bench_rand(seed) % lbb.files], &st);
+}
+
+static int negstat_op(void *priv, uint64_t i)
+{
+    uint64_t *seed = (uint64_t *) priv;
+    char path[PATH_MAX];
+    struct stat st;
+    int e;
+
+    UNUSED(i);
+    (void) snprintf(path, sizeof(path), "%s/tree/n%06u", lbb.root,
+                    (unsigned) (bench_rand(seed) % lbb.files));
+    e = loopback_op.getattr(path, &st);
+    return e == -ENOENT ? 0 : (e == 0 ? -EEXIST : e);
+}
+
+static int seed_setup(unsigned tid, void **priv)
+{
+    uint64_t *seed = (uint64_t *) malloc(sizeof(*seed));
+    if (seed == NULL) return -ENOMEM;
+    *seed = 0x9e3779b97f4a7c15ULL * (tid + 1);
+    *priv = seed;
+    return 0;
+}
+
+static int io_setup(unsigned tid, void **priv, int rand, int write)
+{
+    struct lbb_thread *t;
+    int e;
+
+    e = lbb_thread_new(tid, "data", priv);
+    if (e != 0) return e;
+
+    t = (struct lbb_thread *) *priv;
+    t->rand = rand;
+    t->write = write;
+    t->fi.flags = O_RDWR;
+    e = loopback_op.open(t->path, &t->fi);
+    if (e != 0) lbb_thread_free(t);
+    return e;
+}
+
+static int seqread_setup(unsigned tid, void **priv) { return io_setup(tid, priv, 0, 0); }
+static int randread_setup(unsigned tid, void **priv) { return io_setup(tid, priv, 1, 0); }
+static int seqwrite_setup(unsigned tid, void **priv) { return io_setup(tid, priv, 0, 1); }
+static int randwrite_setup(unsigned tid, void **priv) { return io_setup(tid, priv, 1, 1); }
+
+/* Log/object file writer  compare -o write-coalesce=N against none */
+static int append_setup(unsigned tid, void **priv)
+{
+    struct lbb_thread *t;
+    int e;
+
+    e = lbb_thread_new(tid, "data", priv);
+    if (e != 0) return e;
+
+    t = (struct lbb_thread *) *priv;
+    (void) snprintf(t->path, sizeof(t->path), "%s/data/a%u", lbb.root, tid);
+    t->write = 1;
+    t->fi.flags = O_WRONLY | O_CREAT | O_TRUNC;
+    e = loopback_op.create(t->path, 0644, &t->fi);
+    if (e != 0) lbb_thread_free(t);
+    return e;
+}
+
+static void io_teardown(void *priv)
+{
+    struct lbb_thread *t = (struct lbb_thread *) priv;
+    (void) loopback_op.release(t->path, &t->fi);
+    lbb_thread_free(t);
+}
+
+/**
+ * Zero-copy read as libfuse would serve it:
+ *  read_buf() then fuse_buf_copy() into the reply buffer
+ */
+static int io_read_buf(struct lbb_thread *t, off_t off)
+{
+    struct fuse_bufvec *src = NULL;
+    struct fuse_bufvec dst = FUSE_BUFVEC_INIT(lbb.bsize);
+    ssize_t n;
+    int e;
+
+    e = loopback_op.read_buf(t->path, &src, lbb.bsize, off, &t->fi);
+    if (e != 0) return e;
+
+    dst.buf[0].mem = t->buf;
+    n = fuse_buf_copy(&dst, src, 0);
+    shim_free_buf(src);
+    return n < 0 ? (int) n : 0;
+}
+
+static int io_write_buf(struct lbb_thread *t, off_t off)
+{
+    struct fuse_bufvec src = FUSE_BUFVEC_INIT(lbb.bsize);
+    int n;
+
+    src.buf[0].mem = t->buf;
+    n = loopback_op.write_buf(t->path, &src, off, &t->fi);
+    return n < 0 ? n : 0;
+}
+
+static int io_op(void *priv, uint64_t i)
+{
+    struct lbb_thread *t = (struct lbb_thread *) priv;
+    uint64_t nblk = lbb.size / lbb.bsize;
+    off_t off;
+    int n;
+
+    off = (off_t) ((t->rand ? bench_rand(&t->seed) : i) % nblk * lbb.bsize);
+
+    if (t->fi.flags & O_CREAT && off == 0 && i != 0) {
+        /* Append file full  start over */
+        n = loopback_op.ftruncate(t->path, 0, &t->fi);
+        if (n != 0) return n;
+    }
+
+    if (t->write) {
+        if (lbb.zero_copy && loopback_op.write_buf != NULL) return io_write_buf(t, off);
+        n = loopback_op.write(t->path, t->buf, lbb.bsize, off, &t->fi);
+    } else {
+        if (lbb.zero_copy && loopback_op.read_buf != NULL) return io_read_buf(t, off);
+        n = loopback_op.read(t->path, t->buf, lbb.bsize, off, &t->fi);
+    }
+
+    return n < 0 ? n : 0;
+}
+
+/* Commit log writer  compare -o fsync-group=N against none at -t > 1 */
+static int fsync_setup(unsigned tid, void **priv) { return io_setup(tid, priv, 0, 1); }
+
+static int fsync_op(void *priv, uint64_t i)
+{
+    struct lbb_thread *t = (struct lbb_thread *) priv;
+    int e;
+
+    e = io_op(priv, i);
+    if (e != 0) return e;
+    return loopback_op.fsync(t->path, 0, &t->fi);
+}
+
+struct readdir_buf {
+    size_t used;
+    unsigned count;
+    off_t next;
+    char *names;        /* NULL or  page's names back to back  see: ls_op() */
+    size_t nameslen;
+};
+
+static int readdir_filler(void *buf, const char *name, const struct stat *st, off_t off)
+{
+    struct readdir_buf *b = (struct readdir_buf *) buf;
+    size_t sz = fuse_add_direntry(NULL, NULL, 0, name, st, off);
+
+    if (b->used + sz > READDIR_BUFSZ) return 1;
+    b->used += sz;
+    b->count++;
+    b->next = off;
+    /* A dirent is longer than its name  page's names always fit */
+    if (b->names != NULL) {
+        (void) memcpy(b->names + b->nameslen, name, strlen(name) + 1);
+        b->nameslen += strlen(name) + 1;
+    }
+    return 0;
+}
+
+/* One op lists the whole tree  page by page as the kernel asks */
+static int readdir_op(void *priv, uint64_t i)
+{
+    struct fuse_file_info fi;
+    struct readdir_buf b;
+    char path[PATH_MAX];
+    unsigned count = 0;
+    int e;
+
+    UNUSED(priv);
+    UNUSED(i);
+
+    (void) snprintf(path, sizeof(path), "%s/tree", lbb.root);
+    (void) memset(&fi, 0, sizeof(fi));
+    e = loopback_op.opendir(path, &fi);
+    if (e != 0) return e;
+
+    b.next = 0;
+    b.names = NULL;
+    do {
+        b.used = 0;
+        b.count = 0;
+        e = loopback_op.readdir(path, &b, readdir_filler, b.next, &fi);
+        count += b.count;
+    } while (e == 0 && b.count != 0);
+
+    (void) loopback_op.releasedir(path, &fi);
+
+    if (e == 0 && count != lbb.files + 2) e = -EIO;
+    return e;
+}
+
+/*
+ * `ls -l' of the tree  each page listed is followed by a getattr per entry
+ *  as the kernel does on behalf of the lister
+ * That getattr is what readdir-plus(with attr-cache-ttl) saves
+ * Starts from a cold attr cache  as an `ls -l' longer than a ttl after the last
+ */
+static int ls_op(void *priv, uint64_t i)
+{
+    struct fuse_file_info fi;
+    struct readdir_buf b;
+    char names[READDIR_BUFSZ];
+    char path[PATH_MAX];
+    char sub[PATH_MAX];
+    struct stat st;
+    unsigned count = 0;
+    size_t k;
+    int e;
+
+    UNUSED(priv);
+    UNUSED(i);
+
+    cache_flush(&attr_cache);
+
+    (void) snprintf(path, sizeof(path), "%s/tree", lbb.root);
+    (void) memset(&fi, 0, sizeof(fi));
+    e = loopback_op.opendir(path, &fi);
+    if (e != 0) return e;
+
+    b.next = 0;
+    b.names = names;
+    do {
+        b.used = 0;
+        b.count = 0;
+        b.nameslen = 0;
+        e = loopback_op.readdir(path, &b, readdir_filler, b.next, &fi);
+        count += b.count;
+
+        for (k = 0; e == 0 && k < b.nameslen; k += strlen(names + k) + 1) {
+            if (!strcmp(names + k, ".") || !strcmp(names + k, "..")) continue;
+            if (snprintf(sub, sizeof(sub), "%s/%s", path, names + k) >= (int) sizeof(sub)) {
+                e = -ENAMETOOLONG;
+            } else {
+                e = loopback_op.getattr(sub, &st);
+            }
+        }
+    } while (e == 0 && b.count != 0);
+
+    (void) loopback_op.releasedir(path, &fi);
+
+    if (e == 0 && count != lbb.files + 2) e = -EIO;
+    return e;
+}
+
+static int xattr_setup(unsigned tid, void **priv)
+{
+    return lbb_thread_new(tid, "xattr", priv);
+}
+
+/* set  get  list(probe and names)  remove on a rotating name */
+static int xattr_op(void *priv, uint64_t i)
+{
+    struct lbb_thread *t = (struct lbb_thread *) priv;
+    char name[32];
+    int e;
+
+    (void) snprintf(name, sizeof(name), "user.lbbench.%u", (unsigned) (i / 4 % XATTR_NAMES));
+
+    switch (i % 4) {
+    case 0:
+        return loopback_op.setxattr(t->path, name, t->buf, 64, 0, 0);
+    case 1:
+        e = loopback_op.getxattr(t->path, name, t->buf, lbb.bsize, 0);
+        break;
+    case 2:
+        /* Size probe then names  as the kernel asks */
+        e = loopback_op.listxattr(t->path, NULL, 0);
+        if (e >= 0) e = loopback_op.listxattr(t->path, t->buf, lbb.bsize);
+        break;
+    default:
+        return loopback_op.removexattr(t->path, name);
+    }
+
+    return e < 0 ? e : 0;
+}
+
+/* Finder-like browse of the tree  lookups of names that mostly aren't there */
+static int xattrscan_op(void *priv, uint64_t i)
+{
+    uint64_t *seed = (uint64_t *) priv;
+    const char *path = lbb.tree[bench_rand(seed) % lbb.files];
+    char buf[256];
+    int e;
+
+    switch (i % 3) {
+    case 0:
+        e = loopback_op.getxattr(path, "user.lbbench.tag", buf, sizeof(buf), 0);
+        break;
+    case 1:
+        e = loopback_op.getxattr(path, "user.lbbench.0", buf, sizeof(buf), 0);
+        break;
+    default:
+        e = loopback_op.listxattr(path, NULL, 0);
+        if (e >= 0) e = loopback_op.listxattr(path, buf, sizeof(buf));
+        break;
+    }
+
+    return e < 0 && e != -ENOATTR ? e : 0;
+}
+
+/* Every valid bit setattr_x() knows  see: shim/darwin_compat.h */
+static const uint32_t sa_bits[] = {
+    1U << 0, 1U << 1, 1U << 2, 1U << 3, 1U << 4, 1U << 5,
+    /* crtime  chgtime  bkuptime  flags  ENOTSUP through the shim */
+    1U << 28, 1U << 29, 1U << 30, 1U << 31,
+};
+
+#define SA_COMBOS       (1U << (sizeof(sa_bits) / sizeof(*sa_bits)))
+#define SA_DARWIN_ONLY  0x3c0U      /* Indices of the last four above */
+
+static int attr_setup(unsigned tid, void **priv)
+{
+    return lbb_thread_new(tid, "attr", priv);
+}
+
+/*
+ * Walks every combination of valid bits in turn and checks the result
+ *  each preceded by the getattr() the kernel would have done
+ * All but every fourth op go through a hard link  both names stay in
+ *  attr cache  so the original name is stale by its turn and its chmod(2)
+ *  must not be taken as redundant
+ */
+static int setattr_op(void *priv, uint64_t i)
+{
+    struct lbb_thread *t = (struct lbb_thread *) priv;
+    unsigned c = (unsigned) (i % SA_COMBOS);
+    char ln[PATH_MAX];
+    struct setattr_x a;
+    struct stat st;
+    unsigned k;
+    int e;
+
+    if (snprintf(ln, sizeof(ln), "%s.ln", t->path) >= (int) sizeof(ln)) return -ENAMETOOLONG;
+    (void) memset(&a, 0, sizeof(a));
+    for (k = 0; k < sizeof(sa_bits) / sizeof(*sa_bits); k++) {
+        if (c & (1U << k)) a.valid |= (int32_t) sa_bits[k];
+    }
+    a.mode = (i >> 1) & 1 ? 0600 : 0644;
+    a.uid = getuid();
+    a.gid = getgid();
+    a.size = (off_t) (i % 8192);
+    a.acctime.tv_sec = 1500000000 + (time_t) i;
+    a.acctime.tv_nsec = (long) (i % 1000) * 1000;
+    a.modtime.tv_sec = 1600000000 + (time_t) i;
+    a.modtime.tv_nsec = (long) (i % 1000) * 1000 + 1;
+    a.crtime = a.chgtime = a.bkuptime = a.modtime;
+
+    (void) loopback_op.getattr(t->path, &st);
+    (void) loopback_op.getattr(ln, &st);
+    e = loopback_op.setattr_x(i % 4 == 1 ? t->path : ln, &a);
+    if (e == -ENOTSUP && (c & SA_DARWIN_ONLY)) return 0;
+    if (e != 0) return e;
+
+    if (lstat(t->path, &st) != 0) return -errno;
+    if ((SETATTR_WANTS_MODE(&a) && (st.st_mode & 07777) != a.mode) ||
+            (SETATTR_WANTS_UID(&a) && st.st_uid != a.uid) ||
+            (SETATTR_WANTS_GID(&a) && st.st_gid != a.gid) ||
+            (SETATTR_WANTS_SIZE(&a) && st.st_size != a.size) ||
+            (SETATTR_WANTS_ACCTIME(&a) && (st.st_atimespec.tv_sec != a.acctime.tv_sec ||
+                st.st_atimespec.tv_nsec != a.acctime.tv_nsec)) ||
+            (SETATTR_WANTS_MODTIME(&a) && (st.st_mtimespec.tv_sec != a.modtime.tv_sec ||
+                st.st_mtimespec.tv_nsec != a.modtime.tv_nsec))) {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/* getattr() then getxtimes() of a tree file  as the kernel asks for a full stat */
+static int xtimes_op(void *priv, uint64_t i)
+{
+    uint64_t *seed = (uint64_t *) priv;
+    const char *path = lbb.tree[bench_rand(seed) % lbb.files];
+    struct timespec bkuptime, crtime;
+    struct stat st;
+    int e;
+
+    UNUSED(i);
+    e = loopback_op.getattr(path, &st);
+    if (e != 0) return e;
+    return loopback_op.getxtimes(path, &bkuptime, &crtime);
+}
+
+#define OPEN_HELD           64      /* Handles each thread keeps open */
+#define OPEN_FILES          16      /* Tree files they spread over */
+
+struct open_state {
+    uint64_t seed;
+    struct fuse_file_info fi[OPEN_HELD];
+    const char *path[OPEN_HELD];
+};
+
+static int open_setup(unsigned tid, void **priv)
+{
+    struct open_state *o = (struct open_state *) calloc(1, sizeof(*o));
+    if (o == NULL) return -ENOMEM;
+    o->seed = 0x9e3779b97f4a7c15ULL * (tid + 1);
+    *priv = o;
+    return 0;
+}
+
+/*
+ * Many processes holding the same few files open
+ *  each op replaces the oldest of a thread's handles by a new open and a read
+ */
+static int open_op(void *priv, uint64_t i)
+{
+    struct open_state *o = (struct open_state *) priv;
+    unsigned k = (unsigned) (i % OPEN_HELD);
+    char c;
+    int e;
+
+    if (o->path[k] != NULL) (void) loopback_op.release(o->path[k], &o->fi[k]);
+
+    o->path[k] = lbb.tree[bench_rand(&o->seed) % MIN(lbb.files, OPEN_FILES)];
+    (void) memset(&o->fi[k], 0, sizeof(o->fi[k]));
+    o->fi[k].flags = O_RDONLY;
+    e = loopback_op.open(o->path[k], &o->fi[k]);
+    if (e != 0) {
+        o->path[k] = NULL;
+        return e;
+    }
+    e = loopback_op.read(o->path[k], &c, 1, 0, &o->fi[k]);
+    return e < 0 ? e : 0;
+}
+
+static void open_teardown(void *priv)
+{
+    struct open_state *o = (struct open_state *) priv;
+    unsigned k;
+
+    for (k = 0; k < OPEN_HELD; k++) {
+        if (o->path[k] != NULL) (void) loopback_op.release(o->path[k], &o->fi[k]);
+    }
+    free(o);
+}
+
+/* touch(1) of a tree file */
+static int touch_op(void *priv, uint64_t i)
+{
+    uint64_t *seed = (uint64_t *) priv;
+    struct setattr_x a;
+
+    UNUSED(i);
+    (void) memset(&a, 0, sizeof(a));
+    a.valid = (int32_t) (sa_bits[4] | sa_bits[5]);
+    (void) clock_gettime(CLOCK_REALTIME, &a.modtime);
+    a.acctime = a.modtime;
+    return loopback_op.setattr_x(lbb.tree[bench_rand(seed) % lbb.files], &a);
+}
+
+/*
+ * cp -p of the thread's attr file to one of a few names
+ *  create  write  release  then owner  mode and times of the source
+ *  by path  as copies without an open handle arrive
+ */
+static int cpp_op(void *priv, uint64_t i)
+{
+    struct lbb_thread *t = (struct lbb_thread *) priv;
+    struct fuse_file_info fi;
+    struct setattr_x a;
+    char dst[PATH_MAX];
+    struct stat st;
+    int e;
+
+    if (lstat(t->path, &st) != 0) return -errno;
+    if (snprintf(dst, sizeof(dst), "%s.%u", t->path, (unsigned) (i % 8)) >= (int) sizeof(dst)) {
+        return -ENAMETOOLONG;
+    }
+
+    (void) memset(&fi, 0, sizeof(fi));
+    fi.flags = O_WRONLY | O_CREAT | O_TRUNC;
+    e = loopback_op.create(dst, st.st_mode & 07777, &fi);
+    if (e != 0) return e;
+    e = loopback_op.write(dst, t->buf, lbb.bsize, 0, &fi);
+    (void) loopback_op.release(dst, &fi);
+    if (e < 0) return e;
+
+    (void) loopback_op.getattr(dst, &st);
+    (void) memset(&a, 0, sizeof(a));
+    a.valid = (int32_t) (sa_bits[0] | sa_bits[1] | sa_bits[2] | sa_bits[4] | sa_bits[5]);
+    a.mode = st.st_mode & 07777;
+    a.uid = st.st_uid;
+    a.gid = st.st_gid;
+    a.acctime.tv_sec = 1500000000;
+    a.modtime.tv_sec = 1600000000;
+    return loopback_op.setattr_x(dst, &a);
+}
+
+static const struct bench_workload workloads[] = {
+    {"stat", seed_setup, stat_op, free},
+    {"negstat", seed_setup, negstat_op, free},
+    {"seqread", seqread_setup, io_op, io_teardown},
+    {"randread", randread_setup, io_op, io_teardown},
+    {"seqwrite", seqwrite_setup, io_op, io_teardown},
+    {"randwrite", randwrite_setup, io_op, io_teardown},
+    {"append", append_setup, io_op, io_teardown},
+    {"fsync", fsync_setup, fsync_op, io_teardown},
+    {"readdir", NULL, readdir_op, NULL},
+    {"ls", NULL, ls_op, NULL},
+    {"xattr", xattr_setup, xattr_op, lbb_thread_free},
+    {"xattrscan", seed_setup, xattrscan_op, free},
+    {"setattr", attr_setup, setattr_op, lbb_thread_free},
+    {"touch", seed_setup, touch_op, free},
+    {"xtimes", seed_setup, xtimes_op, free},
+    {"open", open_setup, open_op, open_teardown},
+    {"cpp", attr_setup, cpp_op, lbb_thread_free},
+};
+
+#define NWORKLOADS  (sizeof(workloads) / sizeof(*workloads))
+
+static int mkfile(const char *path, size_t size)
+{
+    int fd, e = 0;
+
+    fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    if (size != 0 && ftruncate(fd, (off_t) size) != 0) e = -1;
+    /* Real blocks  a sparse file would make reads look free */
+    if (e == 0 && size != 0) {
+        char buf[65536];
+        size_t off;
+        (void) memset(buf, 'x', sizeof(buf));
+        for (off = 0; off < size && e == 0; off += sizeof(buf)) {
+            if (pwrite(fd, buf, MIN(sizeof(buf), size - off), (off_t) off) < 0) e = -1;
+        }
+    }
+    (void) close(fd);
+    return e;
+}
+
+static int tree_build(void)
+{
+    char path[PATH_MAX];
+    char ln[PATH_MAX];
+    const char *sub[] = {"tree", "data", "xattr", "attr"};
+    unsigned i;
+
+    for (i = 0; i < sizeof(sub) / sizeof(*sub); i++) {
+        (void) snprintf(path, sizeof(path), "%s/%s", lbb.root, sub[i]);
+        if (mkdir(path, 0755) != 0) return -1;
+    }
+
+    lbb.tree = (char **) calloc(lbb.files, sizeof(*lbb.tree));
+    if (lbb.tree == NULL) return -1;
+    for (i = 0; i < lbb.files; i++) {
+        (void) snprintf(path, sizeof(path), "%s/tree/f%06u", lbb.root, i);
+        lbb.tree[i] = strdup(path);
+        if (lbb.tree[i] == NULL || mkfile(path, 0) != 0) return -1;
+    }
+
+    for (i = 0; i < lbb.threads; i++) {
+        (void) snprintf(path, sizeof(path), "%s/data/t%u", lbb.root, i);
+        if (mkfile(path, lbb.size) != 0) return -1;
+        (void) snprintf(path, sizeof(path), "%s/xattr/t%u", lbb.root, i);
+        if (mkfile(path, 0) != 0) return -1;
+        (void) snprintf(path, sizeof(path), "%s/attr/t%u", lbb.root, i);
+        if (mkfile(path, 0) != 0) return -1;
+        (void) snprintf(ln, sizeof(ln), "%s/attr/t%u.ln", lbb.root, i);
+        if (link(path, ln) != 0) return -1;
+    }
+
+    return 0;
+}
+
+static void rmtree(const char *path)
+{
+    char sub[PATH_MAX];
+    struct dirent *ent;
+    DIR *dp;
+
+    dp = opendir(path);
+    if (dp != NULL) {
+        while ((ent = readdir(dp)) != NULL) {
+            if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) continue;
+            (void) snprintf(sub, sizeof(sub), "%s/%s", path, ent->d_name);
+            if (ent->d_type == DT_DIR) rmtree(sub);
+            else (void) unlink(sub);
+        }
+        (void) closedir(dp);
+    }
+    (void) rmdir(path);
+}
+
+static void usage(const char *prog)
+{
+    unsigned i;
+
+    fprintf(stderr,
+        "usage: %s [-w workload[,...]] [-t threads] [-n ops] [-d dir]\n"
+        "          [-f files] [-s size] [-b bsize] [-z] [-k] [-o fsopt[,...]]\n"
+        "  -n   ops per thread (%llu)\n"
+        "  -f   files in the stat/readdir tree (%u)\n"
+        "  -s   data file size per thread (%zu)\n"
+        "  -b   read/write block size (%zu)\n"
+        "  -z   zero-copy path  read_buf()/write_buf()\n"
+        "  -k   keep the scratch tree\n"
+        "workloads:",
+        prog, (unsigned long long) lbb.ops, lbb.files, lbb.size, lbb.bsize);
+    for (i = 0; i < NWORKLOADS; i++) fprintf(stderr, " %s", workloads[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char *fsargv[3] = {argv[0], "-o", NULL};
+    struct fuse_args args = FUSE_ARGS_INIT(1, fsargv);
+    const char *dir = "/tmp";
+    /* strtok_r() writes into it */
+    char wl_all[] = "stat,negstat,seqread,randread,seqwrite,randwrite,append,fsync,readdir,ls,xattr,xattrscan,setattr,touch,cpp,xtimes,open";
+    char *wl = wl_all;
+    struct sbuf sb = {NULL, 0, 0, 0};
+    char *w, *save;
+    unsigned i;
+    int c, e = 1;
+
+    while ((c = getopt(argc, argv, "w:t:n:d:f:s:b:zko:h")) != -1) {
+        switch (c) {
+        case 'w': wl = optarg; break;
+        case 't': lbb.threads = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'n': lbb.ops = strtoull(optarg, NULL, 0); break;
+        case 'd': dir = optarg; break;
+        case 'f': lbb.files = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 's': lbb.size = strtoull(optarg, NULL, 0); break;
+        case 'b': lbb.bsize = strtoull(optarg, NULL, 0); break;
+        case 'z': lbb.zero_copy = 1; break;
+        case 'k': lbb.keep = 1; break;
+        case 'o': fsargv[2] = optarg; args.argc = 3; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (lbb.threads == 0 || lbb.ops == 0 || lbb.files == 0 ||
+            lbb.bsize == 0 || lbb.size < lbb.bsize) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (lb_setup(&args) != 0) return 1;
+
+    if (snprintf(lbb.root, sizeof(lbb.root), "%s/lbbench.XXXXXX", dir) >= (int) sizeof(lbb.root)) {
+        fprintf(stderr, "-d too long: %s\n", dir);
+        return 1;
+    }
+    if (mkdtemp(lbb.root) == NULL) {
+        fprintf(stderr, "mkdtemp(3) fail  errno: %d\n", errno);
+        return 1;
+    }
+
+    if (tree_build() != 0) {
+        fprintf(stderr, "scratch tree build fail  errno: %d\n", errno);
+        goto out_tree;
+    }
+
+    printf("root: %s  io: %s\n", lbb.root,
+            lbb.zero_copy && loopback_op.read_buf != NULL ? "zero-copy" : "copy");
+    bench_header();
+
+    for (w = strtok_r(wl, ",", &save); w != NULL; w = strtok_r(NULL, ",", &save)) {
+        for (i = 0; i < NWORKLOADS; i++) {
+            if (!strcmp(w, workloads[i].name)) break;
+        }
+        if (i == NWORKLOADS) {
+            fprintf(stderr, "unknown workload: %s\n", w);
+            goto out_tree;
+        }
+        if (bench_run(&workloads[i], lbb.threads, lbb.ops) != 0) goto out_tree;
+    }
+
+    if (loopbackfs_cfg.op_stats || cache_enabled(&attr_cache) || cache_enabled(&neg_cache) ||
+            loopbackfs_cfg.readahead != 0 || loopbackfs_cfg.write_coalesce != 0 || io_async() ||
+            loopbackfs_cfg.fsync_group != 0 || xattr_cache_enabled() || loopbackfs_cfg.fd_share) {
+        if (lb_stats_render(&sb) == 0) fputs(sb.p, stdout);
+        sbuf_free(&sb);
+    }
+
+    e = 0;
+out_tree:
+    /* Flushed before the tree goes  a replay can rebuild it(see: lbreplay -p) */
+    trace_flush();
+    if (!lbb.keep) rmtree(lbb.root);
+    return e;
+}
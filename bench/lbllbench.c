@@ -0,0 +1,312 @@
+/*
+ * Created 190619 lynnl
+ *
+ * In-process loopbackfs_ll benchmark  calls lb_ll_ops directly
+ *  see: bench/Makefile  lbbench.c
+ *
+ * A scratch tree of -f empty files is built under -d(default /tmp)
+ *  tree/f000000...
+ *
+ * walk keeps every lookup it makes until a pass over the tree ends
+ *  as the kernel holds vnodes of a `find'  and opens each file on the way
+ *  so inode fds must leave room for file handles(see: raise_nofile())
+ */
+
+#define main loopbackfs_ll_main
+#include "../loopbackfs/loopbackfs/loopbackfs_ll.c"
+#undef main
+
+#include <getopt.h>
+
+#include "fuse_shim.h"
+#include "bench.h"
+
+static struct {
+    /* Half of PATH_MAX  leaves room for scratch tree names under it */
+    char root[PATH_MAX / 2];
+    unsigned threads;
+    uint64_t ops;
+    unsigned files;
+    int keep;           /* Leave the scratch tree */
+    fuse_ino_t tree;    /* Inode of tree/  looked up once */
+} llb = {
+    .threads = 1,
+    .ops = 100000,
+    .files = 1000,
+};
+
+struct llb_thread {
+    struct fuse_req req;
+    struct fuse_file_info fi;
+    uint64_t seed;
+    fuse_ino_t *held;   /* walk  lookups not yet forgotten */
+    unsigned nheld;
+};
+
+static int llb_thread_setup(unsigned tid, void **priv)
+{
+    struct llb_thread *t;
+
+    t = (struct llb_thread *) calloc(1, sizeof(*t));
+    if (t == NULL) return -ENOMEM;
+    t->seed = 0x9e3779b97f4a7c15ULL * (tid + 1);
+
+    *priv = t;
+    return 0;
+}
+
+/* Low-level ops reply rather than return */
+static inline int llb_result(struct llb_thread *t)
+{
+    assert(t->req.replied == 1);
+    return -t->req.err;
+}
+
+static int llb_lookup(struct llb_thread *t, unsigned k)
+{
+    char name[16];
+
+    (void) snprintf(name, sizeof(name), "f%06u", k);
+    fuse_req_reset(&t->req);
+    lb_ll_ops.lookup(&t->req, llb.tree, name);
+    return llb_result(t);
+}
+
+static void llb_forget(struct llb_thread *t, fuse_ino_t ino)
+{
+    fuse_req_reset(&t->req);
+    lb_ll_ops.forget(&t->req, ino, 1);
+}
+
+/* lookup  getattr  forget  the inode table churns but never grows */
+static int lookup_op(void *priv, uint64_t i)
+{
+    struct llb_thread *t = (struct llb_thread *) priv;
+    fuse_ino_t ino;
+    int e;
+
+    UNUSED(i);
+    e = llb_lookup(t, (unsigned) (bench_rand(&t->seed) % llb.files));
+    if (e != 0) return e;
+    ino = t->req.ino;
+
+    fuse_req_reset(&t->req);
+    lb_ll_ops.getattr(&t->req, ino, NULL);
+    e = llb_result(t);
+
+    llb_forget(t, ino);
+    return e;
+}
+
+static int walk_setup(unsigned tid, void **priv)
+{
+    struct llb_thread *t;
+    int e;
+
+    e = llb_thread_setup(tid, priv);
+    if (e != 0) return e;
+
+    t = (struct llb_thread *) *priv;
+    t->held = (fuse_ino_t *) calloc(llb.files, sizeof(*t->held));
+    if (t->held == NULL) {
+        free(t);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+static void walk_release(struct llb_thread *t)
+{
+    while (t->nheld != 0) llb_forget(t, t->held[--t->nheld]);
+}
+
+static void walk_teardown(void *priv)
+{
+    struct llb_thread *t = (struct llb_thread *) priv;
+    walk_release(t);
+    free(t->held);
+    free(t);
+}
+
+static int walk_op(void *priv, uint64_t i)
+{
+    struct llb_thread *t = (struct llb_thread *) priv;
+    fuse_ino_t ino;
+    int e;
+
+    if (i % llb.files == 0) walk_release(t);
+
+    e = llb_lookup(t, (unsigned) (i % llb.files));
+    if (e != 0) return e;
+    ino = t->req.ino;
+    t->held[t->nheld++] = ino;
+
+    t->fi.flags = O_RDONLY;
+    fuse_req_reset(&t->req);
+    lb_ll_ops.open(&t->req, ino, &t->fi);
+    e = llb_result(t);
+    if (e != 0) return e;
+
+    fuse_req_reset(&t->req);
+    lb_ll_ops.release(&t->req, ino, &t->fi);
+    return llb_result(t);
+}
+
+static const struct bench_workload workloads[] = {
+    {"lookup", llb_thread_setup, lookup_op, free},
+    {"walk", walk_setup, walk_op, walk_teardown},
+};
+
+#define NWORKLOADS  (sizeof(workloads) / sizeof(*workloads))
+
+/**
+ * Look up each component of `path' from the root  as the kernel would
+ * Lookups along the way are kept  the bench exits right after
+ * @return      0 on success  -errno otherwise
+ */
+static int lookup_path(const char *path, fuse_ino_t *ino)
+{
+    struct fuse_req req;
+    char buf[PATH_MAX];
+    char *c, *save;
+
+    (void) memset(&req, 0, sizeof(req));
+    (void) snprintf(buf, sizeof(buf), "%s", path);
+
+    *ino = FUSE_ROOT_ID;
+    for (c = strtok_r(buf, "/", &save); c != NULL; c = strtok_r(NULL, "/", &save)) {
+        fuse_req_reset(&req);
+        lb_ll_ops.lookup(&req, *ino, c);
+        if (req.err != 0) return -req.err;
+        *ino = req.ino;
+    }
+    return 0;
+}
+
+static int tree_build(void)
+{
+    char path[PATH_MAX];
+    unsigned i;
+    int fd;
+
+    (void) snprintf(path, sizeof(path), "%s/tree", llb.root);
+    if (mkdir(path, 0755) != 0) return -1;
+
+    for (i = 0; i < llb.files; i++) {
+        (void) snprintf(path, sizeof(path), "%s/tree/f%06u", llb.root, i);
+        fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd < 0) return -1;
+        (void) close(fd);
+    }
+
+    return 0;
+}
+
+static void tree_remove(void)
+{
+    char path[PATH_MAX];
+    unsigned i;
+
+    for (i = 0; i < llb.files; i++) {
+        (void) snprintf(path, sizeof(path), "%s/tree/f%06u", llb.root, i);
+        (void) unlink(path);
+    }
+    (void) snprintf(path, sizeof(path), "%s/tree", llb.root);
+    (void) rmdir(path);
+    (void) rmdir(llb.root);
+}
+
+static void usage(const char *prog)
+{
+    unsigned i;
+
+    fprintf(stderr,
+        "usage: %s [-w workload[,...]] [-t threads] [-n ops] [-d dir]\n"
+        "          [-f files] [-k] [-o fsopt[,...]]\n"
+        "  -n   ops per thread (%llu)\n"
+        "  -f   files in the tree (%u)\n"
+        "  -k   keep the scratch tree\n"
+        "workloads:",
+        prog, (unsigned long long) llb.ops, llb.files);
+    for (i = 0; i < NWORKLOADS; i++) fprintf(stderr, " %s", workloads[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char *fsargv[3] = {argv[0], "-o", NULL};
+    struct fuse_args args = FUSE_ARGS_INIT(1, fsargv);
+    const char *dir = "/tmp";
+    /* strtok_r() writes into it */
+    char wl_all[] = "lookup,walk";
+    char *wl = wl_all;
+    char path[PATH_MAX];
+    char *w, *save;
+    unsigned i;
+    int c, e = 1;
+
+    while ((c = getopt(argc, argv, "w:t:n:d:f:ko:h")) != -1) {
+        switch (c) {
+        case 'w': wl = optarg; break;
+        case 't': llb.threads = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'n': llb.ops = strtoull(optarg, NULL, 0); break;
+        case 'd': dir = optarg; break;
+        case 'f': llb.files = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'k': llb.keep = 1; break;
+        case 'o': fsargv[2] = optarg; args.argc = 3; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (llb.threads == 0 || llb.ops == 0 || llb.files == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (fuse_opt_parse(&args, &loopbackfs_ll_cfg, loopback_ll_opts, NULL) == -1) return 1;
+    if (lb_ll_setup() != 0) return 1;
+
+    if (snprintf(llb.root, sizeof(llb.root), "%s/lbllbench.XXXXXX", dir) >= (int) sizeof(llb.root)) {
+        fprintf(stderr, "-d too long: %s\n", dir);
+        return 1;
+    }
+    if (mkdtemp(llb.root) == NULL) {
+        fprintf(stderr, "mkdtemp(3) fail  errno: %d\n", errno);
+        return 1;
+    }
+
+    if (tree_build() != 0) {
+        fprintf(stderr, "scratch tree build fail  errno: %d\n", errno);
+        goto out_tree;
+    }
+
+    (void) snprintf(path, sizeof(path), "%s/tree", llb.root);
+    e = lookup_path(path, &llb.tree);
+    if (e != 0) {
+        fprintf(stderr, "lookup %s fail  errno: %d\n", path, -e);
+        e = 1;
+        goto out_tree;
+    }
+    e = 1;
+
+    printf("root: %s  fd budget: %u\n", llb.root, itab.fd_budget);
+    bench_header();
+
+    for (w = strtok_r(wl, ",", &save); w != NULL; w = strtok_r(NULL, ",", &save)) {
+        for (i = 0; i < NWORKLOADS; i++) {
+            if (!strcmp(w, workloads[i].name)) break;
+        }
+        if (i == NWORKLOADS) {
+            fprintf(stderr, "unknown workload: %s\n", w);
+            goto out_tree;
+        }
+        if (bench_run(&workloads[i], llb.threads, llb.ops) != 0) goto out_tree;
+    }
+
+    e = 0;
+out_tree:
+    if (!llb.keep) tree_remove();
+    return e;
+}
@@ -0,0 +1,630 @@
+/*
+ * Created 190619 lynnl
+ *
+ * Replay a loopbackfs workload trace(see: `trace=' option) against
+ *  loopback_op  in-process  paths rebased under a scratch directory
+ *
+ * Records are issued one at a time in the order they started
+ *  at original pace(-x 1)  N times faster(-x N) or back to back(-x 0)
+ * File handles recorded at open/create/opendir are mapped to the
+ *  replay's own  ops on a handle whose open failed are skipped
+ *
+ * With -p  files and directories the trace expects to exist are created
+ *  first  files sized to cover the furthest successful read
+ *
+ * Results are compared with the recorded ones  op stats are always on
+ *  so per-op latency of the replay is printed at the end
+ */
+
+#define main loopbackfs_main
+#include "../loopbackfs/loopbackfs/loopbackfs.c"
+#undef main
+
+#include <getopt.h>
+#include <fuse_lowlevel.h>   /* fuse_add_direntry() */
+
+#include "fuse_shim.h"
+
+#define READDIR_BUFSZ       4096
+#define FILLER_BYTE         'r'
+
+/* A parsed record  paths point into the mapped trace */
+struct rp_rec {
+    const struct trace_rec *r;
+    const char *path;
+    const char *path2;
+};
+
+/* Recorded fh -> replay handle  open addressing */
+struct rp_fh {
+    uint64_t key;
+    int used;
+    struct fuse_file_info fi;
+};
+
+/* Paths needing to exist before replay  see: -p */
+struct rp_node {
+    char *path;
+    int created;        /* First seen being created  or failing */
+    int dir;
+    uint64_t size;
+};
+
+static struct {
+    const char *root;
+    size_t rootlen;
+    double speed;
+    int prepare;
+    int verbose;
+
+    struct rp_rec *recs;
+    size_t nrecs;
+
+    struct rp_fh *fhs;
+    size_t fh_mask;
+
+    struct rp_node *nodes;
+    size_t node_mask;
+
+    char *buf;
+    size_t bufsz;
+
+    uint64_t replayed;
+    uint64_t skipped;
+    uint64_t mismatched;
+} rp = {
+    .speed = 1.0,
+};
+
+static int rp_rec_cmp(const void *a, const void *b)
+{
+    const struct rp_rec *x = (const struct rp_rec *) a;
+    const struct rp_rec *y = (const struct rp_rec *) b;
+    if (x->r->start != y->r->start) return x->r->start < y->r->start ? -1 : 1;
+    /* Keep completion order of simultaneous starts */
+    return x->r < y->r ? -1 : x->r > y->r;
+}
+
+/**
+ * Split trace into records  sorted by start time
+ * @return      0 if success  -errno otherwise
+ */
+static int rp_parse(const char *p, size_t len)
+{
+    const struct trace_header *h = (const struct trace_header *) p;
+    const struct trace_rec *r;
+    size_t off, cap = 0, max = 0;
+    struct rp_rec *n;
+
+    if (len < sizeof(*h) || h->magic != TRACE_MAGIC) return -EINVAL;
+    if (h->version != TRACE_VERSION) return -EPROTO;
+
+    for (off = sizeof(*h); off + sizeof(*r) <= len; ) {
+        r = (const struct trace_rec *) (p + off);
+        if (off + sizeof(*r) + r->pathlen + r->path2len > len) break;   /* Torn tail */
+        if (r->op >= OP_MAX) return -EPROTO;
+
+        if (rp.nrecs == cap) {
+            cap = cap ? cap * 2 : 4096;
+            n = (struct rp_rec *) realloc(rp.recs, cap * sizeof(*n));
+            if (n == NULL) return -ENOMEM;
+            rp.recs = n;
+        }
+        n = &rp.recs[rp.nrecs++];
+        n->r = r;
+        n->path = (const char *) (r + 1);
+        n->path2 = n->path + r->pathlen;
+
+        if (r->size > max && r->size <= INT_MAX) max = r->size;
+        off += TRACE_RECSZ(*r);
+    }
+
+    qsort(rp.recs, rp.nrecs, sizeof(*rp.recs), rp_rec_cmp);
+
+    rp.bufsz = max > 65536 ? max : 65536;
+    rp.buf = (char *) malloc(rp.bufsz);
+    if (rp.buf == NULL) return -ENOMEM;
+    (void) memset(rp.buf, FILLER_BYTE, rp.bufsz);
+    return 0;
+}
+
+/**
+ * "<root><path>"  `path' not NUL-terminated
+ */
+static int rp_path(char *out, const char *path, size_t len)
+{
+    if (rp.rootlen + len >= PATH_MAX) return -ENAMETOOLONG;
+    (void) memcpy(out, rp.root, rp.rootlen);
+    (void) memcpy(out + rp.rootlen, path, len);
+    out[rp.rootlen + len] = '\0';
+    return 0;
+}
+
+static size_t rp_hash_size(size_t n)
+{
+    size_t sz = 64;
+    while (sz < n * 2) sz <<= 1;
+    return sz;
+}
+
+static struct rp_fh *rp_fh_slot(uint64_t key, int insert)
+{
+    size_t i = (size_t) (key * 0x9e3779b97f4a7c15ULL >> 16) & rp.fh_mask;
+    struct rp_fh *tomb = NULL;
+
+    for (;; i = (i + 1) & rp.fh_mask) {
+        struct rp_fh *f = &rp.fhs[i];
+        if (f->used == 0) return insert ? (tomb != NULL ? tomb : f) : NULL;
+        if (f->used < 0) {
+            if (tomb == NULL) tomb = f;
+        } else if (f->key == key) {
+            return f;
+        }
+    }
+}
+
+/**
+ * @fresh       set if `path' wasn't seen before
+ */
+static struct rp_node *rp_node_slot(const char *path, size_t len, int *fresh)
+{
+    size_t i = path_hash(path, len) & rp.node_mask;
+
+    *fresh = 0;
+    for (;; i = (i + 1) & rp.node_mask) {
+        struct rp_node *n = &rp.nodes[i];
+        if (n->path == NULL) {
+            n->path = strndup(path, len);
+            *fresh = 1;
+            return n->path != NULL ? n : NULL;
+        }
+        if (strlen(n->path) == len && !memcmp(n->path, path, len)) return n;
+    }
+}
+
+static int is_dir_op(unsigned op)
+{
+    return op == OP_opendir || op == OP_readdir || op == OP_releasedir ||
+            op == OP_fsyncdir || op == OP_rmdir;
+}
+
+/* Ops which bring their path into existence */
+static int is_create_op(unsigned op)
+{
+    return op == OP_create || op == OP_mknod || op == OP_mkdir || op == OP_symlink;
+}
+
+static int mkdirs(char *path)
+{
+    char *p;
+
+    for (p = path + rp.rootlen + 1; (p = strchr(p, '/')) != NULL; p++) {
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            *p = '/';
+            return -errno;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+/* Real blocks  a sparse file would make reads look free */
+static int fill_file(int fd, uint64_t size)
+{
+    uint64_t off;
+    size_t n;
+
+    for (off = 0; off < size; off += n) {
+        n = size - off < rp.bufsz ? (size_t) (size - off) : rp.bufsz;
+        if (pwrite(fd, rp.buf, n, (off_t) off) < 0) return -errno;
+    }
+    return 0;
+}
+
+/**
+ * Create what the trace expects to find in place
+ *  i.e. paths whose first appearance is a successful non-creating op
+ */
+static int rp_prepare(void)
+{
+    char path[PATH_MAX];
+    const struct trace_rec *r;
+    struct rp_node *n;
+    uint64_t end;
+    size_t i;
+    int fd, e, fresh;
+
+    rp.node_mask = rp_hash_size(rp.nrecs) - 1;
+    rp.nodes = (struct rp_node *) calloc(rp.node_mask + 1, sizeof(*rp.nodes));
+    if (rp.nodes == NULL) return -ENOMEM;
+
+    for (i = 0; i < rp.nrecs; i++) {
+        r = rp.recs[i].r;
+        if (r->pathlen == 0 || rp.recs[i].path[0] != '/') continue;
+
+        /* New name of rename/link never needs to pre-exist */
+        if (r->op == OP_rename || r->op == OP_link) {
+            n = rp_node_slot(rp.recs[i].path2, r->path2len, &fresh);
+            if (n == NULL) return -ENOMEM;
+            if (fresh) n->created = 1;
+        }
+
+        n = rp_node_slot(rp.recs[i].path, r->pathlen, &fresh);
+        if (n == NULL) return -ENOMEM;
+        if (fresh) n->created = is_create_op(r->op) || r->ret < 0;
+        if (n->created) continue;
+
+        if (is_dir_op(r->op)) n->dir = 1;
+        if ((r->op == OP_read || r->op == OP_read_buf) && r->ret >= 0) {
+            end = r->off + (r->op == OP_read ? (uint64_t) r->ret : r->size);
+            if (end > n->size) n->size = end;
+        }
+    }
+
+    for (i = 0; i <= rp.node_mask; i++) {
+        n = &rp.nodes[i];
+        if (n->path == NULL || n->created) continue;
+        if ((e = rp_path(path, n->path, strlen(n->path))) != 0) return e;
+        if ((e = mkdirs(path)) != 0) return e;
+
+        if (n->dir) {
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) return -errno;
+            continue;
+        }
+
+        fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd < 0) {
+            if (errno == EISDIR) continue;
+            return -errno;
+        }
+        e = fill_file(fd, n->size);
+        (void) close(fd);
+        if (e != 0) return e;
+    }
+
+    return 0;
+}
+
+static int rp_filler(void *buf, const char *name, const struct stat *st, off_t off)
+{
+    size_t *used = (size_t *) buf;
+    size_t sz = fuse_add_direntry(NULL, NULL, 0, name, st, off);
+
+    if (*used + sz > READDIR_BUFSZ) return 1;
+    *used += sz;
+    return 0;
+}
+
+/**
+ * Issue one record
+ * @return      callback result  or 1 if skipped
+ */
+static int rp_issue(const struct rp_rec *rec)
+{
+    const struct trace_rec *r = rec->r;
+    char path[PATH_MAX];
+    char path2[PATH_MAX];
+    const char *p2 = rec->path2;
+    struct fuse_file_info *fi = NULL;
+    struct fuse_file_info nfi;
+    struct rp_fh *f = NULL;
+    struct setattr_x sa;
+    struct timespec tv[2];
+    struct flock lck;
+    struct stat st;
+    struct statvfs svfs;
+    struct statfs sfs;
+    size_t size = r->size < rp.bufsz ? (size_t) r->size : rp.bufsz;
+    size_t used;
+    int e;
+
+    if (rp_path(path, rec->path, r->pathlen) != 0) return 1;
+
+    /* Second path rebased  symlink target only if absolute  xattr name never */
+    if (r->op == OP_rename || r->op == OP_link || r->op == OP_exchange ||
+            (r->op == OP_symlink && r->path2len != 0 && p2[0] == '/')) {
+        if (rp_path(path2, p2, r->path2len) != 0) return 1;
+    } else {
+        if (r->path2len >= PATH_MAX) return 1;
+        (void) memcpy(path2, p2, r->path2len);
+        path2[r->path2len] = '\0';
+    }
+    p2 = path2;
+
+    switch (r->op) {
+    case OP_open: case OP_create: case OP_opendir:
+        (void) memset(&nfi, 0, sizeof(nfi));
+        nfi.flags = (int) r->flags;
+        fi = &nfi;
+        break;
+    case OP_read: case OP_write: case OP_read_buf: case OP_write_buf:
+    case OP_flush: case OP_release: case OP_fsync: case OP_readdir:
+    case OP_releasedir: case OP_fsyncdir: case OP_ftruncate: case OP_fgetattr:
+    case OP_lock: case OP_flock: case OP_fallocate: case OP_fsetattr_x:
+        f = rp_fh_slot(r->fh, 0);
+        if (f == NULL) return 1;
+        fi = &f->fi;
+        break;
+    default:
+        break;
+    }
+
+    switch (r->op) {
+    case OP_getattr: e = loopback_op.getattr(path, &st); break;
+    case OP_readlink: e = loopback_op.readlink(path, rp.buf, size ? size : 1); break;
+    case OP_mknod: e = loopback_op.mknod(path, (mode_t) r->mode, (dev_t) r->off); break;
+    case OP_mkdir: e = loopback_op.mkdir(path, (mode_t) r->mode); break;
+    case OP_unlink: e = loopback_op.unlink(path); break;
+    case OP_rmdir: e = loopback_op.rmdir(path); break;
+    case OP_symlink: e = loopback_op.symlink(p2, path); break;
+    case OP_rename: e = loopback_op.rename(path, p2); break;
+    case OP_link: e = loopback_op.link(path, p2); break;
+    case OP_chmod: e = loopback_op.chmod(path, (mode_t) r->mode); break;
+    /* Ownership change mostly fails unprivileged  keep ours */
+    case OP_chown: e = loopback_op.chown(path, (uid_t) -1, (gid_t) -1); break;
+    case OP_truncate: e = loopback_op.truncate(path, (off_t) r->off); break;
+    case OP_open: e = loopback_op.open(path, fi); break;
+    case OP_create: e = loopback_op.create(path, (mode_t) r->mode, fi); break;
+    case OP_opendir: e = loopback_op.opendir(path, fi); break;
+    case OP_read:
+        e = loopback_op.read(path, rp.buf, size, (off_t) r->off, fi);
+        break;
+    case OP_write:
+        e = loopback_op.write(path, rp.buf, size, (off_t) r->off, fi);
+        break;
+#if FUSE_VERSION >= 29
+    case OP_read_buf:
+        if (loopback_op.read_buf == NULL) {
+            e = loopback_op.read(path, rp.buf, size, (off_t) r->off, fi);
+        } else {
+            struct fuse_bufvec *src = NULL;
+            struct fuse_bufvec dst = FUSE_BUFVEC_INIT(size);
+            e = loopback_op.read_buf(path, &src, size, (off_t) r->off, fi);
+            if (e == 0) {
+                ssize_t n;
+                dst.buf[0].mem = rp.buf;
+                n = fuse_buf_copy(&dst, src, 0);
+                if (n < 0) e = (int) n;
+            }
+            shim_free_buf(src);
+        }
+        break;
+    case OP_write_buf:
+        if (loopback_op.write_buf == NULL) {
+            e = loopback_op.write(path, rp.buf, size, (off_t) r->off, fi);
+        } else {
+            struct fuse_bufvec src = FUSE_BUFVEC_INIT(size);
+            src.buf[0].mem = rp.buf;
+            e = loopback_op.write_buf(path, &src, (off_t) r->off, fi);
+        }
+        break;
+#endif
+    case OP_statfs: e = loopback_op.statfs(path, &svfs); break;
+    case OP_flush: e = loopback_op.flush(path, fi); break;
+    case OP_release: e = loopback_op.release(path, fi); break;
+    case OP_fsync: e = loopback_op.fsync(path, (int) r->flags, fi); break;
+    case OP_setxattr:
+        e = loopback_op.setxattr(path, p2, rp.buf, size, (int) r->flags, (uint32_t) r->off);
+        break;
+    case OP_getxattr:
+        e = loopback_op.getxattr(path, p2, size ? rp.buf : NULL, size, (uint32_t) r->off);
+        break;
+    case OP_listxattr:
+        e = loopback_op.listxattr(path, size ? rp.buf : NULL, size);
+        break;
+    case OP_removexattr: e = loopback_op.removexattr(path, p2); break;
+    case OP_readdir:
+        used = 0;
+        e = loopback_op.readdir(path, &used, rp_filler, (off_t) r->off, fi);
+        break;
+    case OP_releasedir: e = loopback_op.releasedir(path, fi); break;
+    case OP_fsyncdir: e = loopback_op.fsyncdir(path, (int) r->flags, fi); break;
+    case OP_access: e = loopback_op.access(path, (int) r->flags); break;
+    case OP_ftruncate: e = loopback_op.ftruncate(path, (off_t) r->off, fi); break;
+    case OP_fgetattr: e = loopback_op.fgetattr(path, &st, fi); break;
+    case OP_lock:
+        (void) memset(&lck, 0, sizeof(lck));
+        lck.l_type = (short) r->mode;
+        lck.l_whence = SEEK_SET;
+        lck.l_start = (off_t) r->off;
+        lck.l_len = (off_t) r->size;
+        /* A single replay thread must never wait on itself */
+        e = loopback_op.lock(path, fi, (int) r->flags == F_SETLKW ? F_SETLK : (int) r->flags, &lck);
+        break;
+    case OP_utimens:
+        tv[0].tv_sec = (time_t) r->off;
+        tv[1].tv_sec = (time_t) r->size;
+        tv[0].tv_nsec = tv[1].tv_nsec = 0;
+        e = loopback_op.utimens(path, tv);
+        break;
+    case OP_flock: e = loopback_op.flock(path, fi, (int) r->flags | LOCK_NB); break;
+    case OP_fallocate:
+        e = loopback_op.fallocate(path, (int) r->flags, (off_t) r->off, (off_t) r->size, fi);
+        break;
+    case OP_statfs_x: e = loopback_op.statfs_x(path, &sfs); break;
+    case OP_setvolname: e = loopback_op.setvolname(rec->path); break;
+    case OP_exchange: e = loopback_op.exchange(path, p2, r->flags); break;
+    case OP_setbkuptime: case OP_setchgtime: case OP_setcrtime:
+        tv[0].tv_sec = (time_t) r->off;
+        tv[0].tv_nsec = (long) r->size;
+        e = r->op == OP_setbkuptime ? loopback_op.setbkuptime(path, tv) :
+            r->op == OP_setchgtime ? loopback_op.setchgtime(path, tv) :
+            loopback_op.setcrtime(path, tv);
+        break;
+    case OP_getxtimes: e = loopback_op.getxtimes(path, &tv[0], &tv[1]); break;
+    case OP_chflags: e = loopback_op.chflags(path, r->flags); break;
+    case OP_setattr_x: case OP_fsetattr_x:
+        /* Times weren't recorded  now is as good as any */
+        (void) memset(&sa, 0, sizeof(sa));
+        sa.valid = (int32_t) r->flags;
+        sa.mode = (mode_t) r->mode;
+        sa.uid = (uid_t) -1;
+        sa.gid = (gid_t) -1;
+        sa.size = (off_t) r->off;
+        (void) clock_gettime(CLOCK_REALTIME, &sa.acctime);
+        sa.modtime = sa.crtime = sa.chgtime = sa.bkuptime = sa.acctime;
+        e = r->op == OP_setattr_x ? loopback_op.setattr_x(path, &sa) :
+            loopback_op.fsetattr_x(path, &sa, fi);
+        break;
+    default:
+        return 1;
+    }
+
+    if (r->op == OP_open || r->op == OP_create || r->op == OP_opendir) {
+        if (e == 0 && r->ret == 0) {
+            f = rp_fh_slot(r->fh, 1);
+            f->key = r->fh;
+            f->used = 1;
+            f->fi = *fi;
+        } else if (e == 0) {
+            /* Recorded as failed  nothing will refer to it */
+            if (r->op == OP_opendir) (void) loopback_op.releasedir(path, fi);
+            else (void) loopback_op.release(path, fi);
+        }
+    } else if ((r->op == OP_release || r->op == OP_releasedir) && f != NULL) {
+        f->used = -1;
+    }
+
+    return e;
+}
+
+/* Same outcome  error codes must agree  byte counts needn't */
+static int rp_match(int e, int32_t ret)
+{
+    return e < 0 ? e == ret : ret >= 0;
+}
+
+static void rp_sleep_until(uint64_t t)
+{
+    struct timespec ts;
+    uint64_t now = now_ns();
+
+    if (t <= now) return;
+    ts.tv_sec = (time_t) ((t - now) / 1000000000ULL);
+    ts.tv_nsec = (long) ((t - now) % 1000000000ULL);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) continue;
+}
+
+static int rp_run(void)
+{
+    const struct trace_rec *r;
+    uint64_t t0, t1, span;
+    size_t i;
+    int e;
+
+    rp.fh_mask = rp_hash_size(rp.nrecs) - 1;
+    rp.fhs = (struct rp_fh *) calloc(rp.fh_mask + 1, sizeof(*rp.fhs));
+    if (rp.fhs == NULL) return -ENOMEM;
+
+    t0 = now_ns();
+    for (i = 0; i < rp.nrecs; i++) {
+        r = rp.recs[i].r;
+        if (rp.speed > 0) rp_sleep_until(t0 + (uint64_t) (r->start / rp.speed));
+
+        e = rp_issue(&rp.recs[i]);
+        if (e == 1) {
+            rp.skipped++;
+            continue;
+        }
+        rp.replayed++;
+        if (!rp_match(e, r->ret)) {
+            rp.mismatched++;
+            if (rp.verbose) {
+                fprintf(stderr, "#%zu %s %.*s  recorded: %d replayed: %d\n",
+                        i, op_names[r->op], (int) r->pathlen, rp.recs[i].path, r->ret, e);
+            }
+        }
+    }
+    t1 = now_ns();
+
+    span = rp.nrecs ? rp.recs[rp.nrecs - 1].r->start - rp.recs[0].r->start : 0;
+    printf("records: %zu replayed: %llu skipped: %llu mismatched: %llu\n",
+            rp.nrecs, (unsigned long long) rp.replayed,
+            (unsigned long long) rp.skipped, (unsigned long long) rp.mismatched);
+    printf("recorded span: %.3fs replay: %.3fs %.0f ops/s\n",
+            span / 1e9, (t1 - t0) / 1e9,
+            t1 > t0 ? rp.replayed * 1e9 / (t1 - t0) : 0.0);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s -d dir [-x speed] [-p] [-v] [-o fsopt[,...]] trace\n"
+        "  -d   scratch directory trace paths are rebased under\n"
+        "  -x   pace  1 original(default)  N times faster  0 back to back\n"
+        "  -p   create files and directories the trace expects to exist\n"
+        "  -v   print every op whose result differs from the recorded one\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    char opts[1024] = "op-stats";
+    char *fsargv[3] = {argv[0], "-o", opts};
+    struct fuse_args args = FUSE_ARGS_INIT(3, fsargv);
+    struct sbuf sb = {NULL, 0, 0, 0};
+    struct stat st;
+    char *p = NULL;
+    int c, fd, e;
+
+    while ((c = getopt(argc, argv, "d:x:pvo:h")) != -1) {
+        switch (c) {
+        case 'd': rp.root = optarg; break;
+        case 'x': rp.speed = strtod(optarg, NULL); break;
+        case 'p': rp.prepare = 1; break;
+        case 'v': rp.verbose = 1; break;
+        case 'o':
+            (void) strncat(opts, ",", sizeof(opts) - strlen(opts) - 1);
+            (void) strncat(opts, optarg, sizeof(opts) - strlen(opts) - 1);
+            break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (rp.root == NULL || optind + 1 != argc || !(rp.speed >= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+    rp.rootlen = strlen(rp.root);
+    while (rp.rootlen > 1 && rp.root[rp.rootlen - 1] == '/') rp.rootlen--;
+
+    if (lb_setup(&args) != 0) return 1;
+    if (trace_fd >= 0) {
+        fprintf(stderr, "refusing to trace a replay\n");
+        return 1;
+    }
+
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "cannot open %s  errno: %d\n", argv[optind], errno);
+        return 1;
+    }
+    p = (char *) malloc((size_t) st.st_size + 1);
+    if (p == NULL || pread(fd, p, (size_t) st.st_size, 0) != st.st_size) {
+        fprintf(stderr, "cannot read %s  errno: %d\n", argv[optind], errno);
+        return 1;
+    }
+    (void) close(fd);
+
+    e = rp_parse(p, (size_t) st.st_size);
+    if (e != 0) {
+        fprintf(stderr, "bad trace %s  errno: %d\n", argv[optind], -e);
+        return 1;
+    }
+
+    if (rp.prepare && (e = rp_prepare()) != 0) {
+        fprintf(stderr, "scratch tree prepare fail  errno: %d\n", -e);
+        return 1;
+    }
+
+    if (rp_run() != 0) return 1;
+
+    if (lb_stats_render(&sb) == 0) fputs(sb.p, stdout);
+    sbuf_free(&sb);
+    free(p);
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * Created 190619 lynnl
+ *
+ * Just enough of the Darwin API surface for loopbackfs/clockfs sources
+ *  to compile and run on Linux  force-included by bench/Makefile
+ *
+ * Calls with no Linux counterpart(getattrlist(2) family  exchangedata(2)
+ *  chflags(2)) fail with ENOTSUP  benchmarks shouldn't depend on them
+ *  except getattrlist(2) of common times(statx(2))  and setattrlist(2)
+ *  of modification/access times
+ */
+
+#ifndef SHIM_DARWIN_COMPAT_H
+#define SHIM_DARWIN_COMPAT_H
+#define _GNU_SOURCE 1
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/file.h>
+#include <sys/xattr.h>
+
+#define ENOATTR ENODATA
+#define XATTR_NOFOLLOW   0x0001
+#define XATTR_NOSECURITY 0x0008
+#define XATTR_NODEFAULT  0x0010
+#define XATTR_RESOURCEFORK_NAME "com.apple.ResourceFork"
+#define O_SYMLINK   O_PATH|O_NOFOLLOW
+#define O_EVTONLY   O_PATH
+#define F_FULLFSYNC 51
+#define F_GETPATH   50
+#define F_PREALLOCATE 42
+#define F_ALLOCATECONTIG 0x2
+#define F_ALLOCATEALL    0x4
+#define F_PEOFPOSMODE 3
+#define F_VOLPOSMODE  4
+typedef struct fstore { unsigned int fst_flags; int fst_posmode; off_t fst_offset; off_t fst_length; off_t fst_bytesalloc; } fstore_t;
+
+typedef uint32_t attrgroup_t;
+struct attrlist { unsigned short bitmapcount; uint16_t reserved; attrgroup_t commonattr, volattr, dirattr, fileattr, forkattr; };
+#define ATTR_BIT_MAP_COUNT 5
+#define ATTR_CMN_CRTIME   0x00000200
+#define ATTR_CMN_MODTIME  0x00000400
+#define ATTR_CMN_CHGTIME  0x00000800
+#define ATTR_CMN_ACCTIME  0x00001000
+#define ATTR_CMN_BKUPTIME 0x00002000
+#define FSOPT_NOFOLLOW    0x00000001
+
+
+/*
+ * Getting common times maps onto statx(2)  creation time is btime
+ *  zero if the fs doesn't keep one  and there's no backup time on Linux
+ * Packed as Darwin does  length first then times in attribute bit order
+ */
+static inline int shim_getattrlist(int dfd, const char *p, const struct attrlist *al, void *buf, size_t n, int flags)
+{
+    static const attrgroup_t order[] = {
+        ATTR_CMN_CRTIME, ATTR_CMN_MODTIME, ATTR_CMN_CHGTIME, ATTR_CMN_ACCTIME, ATTR_CMN_BKUPTIME,
+    };
+    const attrgroup_t known = ATTR_CMN_CRTIME | ATTR_CMN_MODTIME | ATTR_CMN_CHGTIME | ATTR_CMN_ACCTIME | ATTR_CMN_BKUPTIME;
+    char out[sizeof(uint32_t) + 5 * sizeof(struct timespec)];
+    struct timespec ts;
+    struct statx stx;
+    uint32_t len = sizeof(uint32_t);
+    size_t i;
+
+    if (al->bitmapcount != ATTR_BIT_MAP_COUNT || al->volattr || al->dirattr || al->fileattr || al->forkattr ||
+            (al->commonattr & ~known)) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    if (statx(dfd, p, flags, STATX_BASIC_STATS | STATX_BTIME, &stx) != 0) return -1;
+
+    for (i = 0; i < sizeof(order) / sizeof(*order); i++) {
+        if (!(al->commonattr & order[i])) continue;
+        ts.tv_sec = 0;
+        ts.tv_nsec = 0;
+        if (order[i] == ATTR_CMN_CRTIME && (stx.stx_mask & STATX_BTIME)) {
+            ts.tv_sec = stx.stx_btime.tv_sec;
+            ts.tv_nsec = stx.stx_btime.tv_nsec;
+        } else if (order[i] == ATTR_CMN_MODTIME) {
+            ts.tv_sec = stx.stx_mtime.tv_sec;
+            ts.tv_nsec = stx.stx_mtime.tv_nsec;
+        } else if (order[i] == ATTR_CMN_CHGTIME) {
+            ts.tv_sec = stx.stx_ctime.tv_sec;
+            ts.tv_nsec = stx.stx_ctime.tv_nsec;
+        } else if (order[i] == ATTR_CMN_ACCTIME) {
+            ts.tv_sec = stx.stx_atime.tv_sec;
+            ts.tv_nsec = stx.stx_atime.tv_nsec;
+        }
+        memcpy(out + len, &ts, sizeof(ts));
+        len += sizeof(ts);
+    }
+    memcpy(out, &len, sizeof(len));
+    /* Truncated to the caller's buffer  length still tells the full size */
+    memcpy(buf, out, len < n ? len : n);
+    return 0;
+}
+static inline int getattrlist(const char *p, void *a, void *b, size_t n, unsigned int o)
+{ return shim_getattrlist(AT_FDCWD, p, (const struct attrlist *) a, b, n, (o & FSOPT_NOFOLLOW) ? AT_SYMLINK_NOFOLLOW : 0); }
+static inline int fgetattrlist(int fd, void *a, void *b, size_t n, unsigned int o)
+{ (void) o; return shim_getattrlist(fd, "", (const struct attrlist *) a, b, n, AT_EMPTY_PATH); }
+
+/*
+ * Setting modification/access times maps onto utimensat(2)
+ *  buffer packed in attribute bit order  modtime before acctime
+ */
+static inline int shim_attr_times(const struct attrlist *al, const void *buf, size_t n, struct timespec tv[2])
+{
+    const struct timespec *ts = (const struct timespec *) buf;
+    size_t k = 0;
+
+    if (al->bitmapcount != ATTR_BIT_MAP_COUNT || al->volattr || al->dirattr || al->fileattr || al->forkattr ||
+            (al->commonattr & ~(ATTR_CMN_MODTIME | ATTR_CMN_ACCTIME)) || !al->commonattr) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    tv[0].tv_sec = tv[1].tv_sec = 0;
+    tv[0].tv_nsec = tv[1].tv_nsec = UTIME_OMIT;
+    if (al->commonattr & ATTR_CMN_MODTIME) tv[1] = ts[k++];
+    if (al->commonattr & ATTR_CMN_ACCTIME) tv[0] = ts[k++];
+    if (n < k * sizeof(*ts)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+static inline int setattrlist(const char *p, void *a, void *b, size_t n, unsigned int o)
+{
+    struct timespec tv[2];
+    if (shim_attr_times((const struct attrlist *) a, b, n, tv) != 0) return -1;
+    return utimensat(AT_FDCWD, p, tv, (o & FSOPT_NOFOLLOW) ? AT_SYMLINK_NOFOLLOW : 0);
+}
+static inline int fsetattrlist(int fd, void *a, void *b, size_t n, unsigned int o)
+{
+    struct timespec tv[2];
+    (void) o;
+    if (shim_attr_times((const struct attrlist *) a, b, n, tv) != 0) return -1;
+    return futimens(fd, tv);
+}
+/*
+ * F_GETPATH through /proc  F_FULLFSYNC is fsync(2)  which flushes the
+ *  drive cache on Linux already  other commands pass through
+ */
+static inline int shim_fcntl(int fd, int cmd, ...)
+{
+    char proc[32];
+    va_list ap;
+    void *arg;
+    ssize_t n;
+
+    va_start(ap, cmd);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if (cmd == F_FULLFSYNC) return fsync(fd);
+    if (cmd != F_GETPATH) return fcntl(fd, cmd, arg);
+    (void) snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fd);
+    n = readlink(proc, (char *) arg, PATH_MAX - 1);
+    if (n < 0) return -1;
+    ((char *) arg)[n] = '\0';
+    return 0;
+}
+#define fcntl shim_fcntl
+
+static inline int exchangedata(const char *a, const char *b, unsigned int o) { (void) a; (void) b; (void) o; errno = ENOTSUP; return -1; }
+static inline int chflags(const char *p, unsigned int f) { (void) p; (void) f; errno = ENOTSUP; return -1; }
+static inline int lchflags(const char *p, unsigned int f) { (void) p; (void) f; errno = ENOTSUP; return -1; }
+static inline int fchflags(int fd, unsigned int f) { (void) fd; (void) f; errno = ENOTSUP; return -1; }
+
+/* Darwin xattr(2) family carries position and options arguments */
+static inline ssize_t shim_getxattr(const char *p, const char *n, void *v, size_t s, uint32_t pos, int o)
+{ (void) pos; return (o & XATTR_NOFOLLOW) ? lgetxattr(p, n, v, s) : getxattr(p, n, v, s); }
+static inline int shim_setxattr(const char *p, const char *n, const void *v, size_t s, uint32_t pos, int o)
+{ (void) pos; (void) o; return lsetxattr(p, n, v, s, 0); }
+static inline ssize_t shim_listxattr(const char *p, char *b, size_t s, int o)
+{ return (o & XATTR_NOFOLLOW) ? llistxattr(p, b, s) : listxattr(p, b, s); }
+static inline int shim_removexattr(const char *p, const char *n, int o)
+{ return (o & XATTR_NOFOLLOW) ? lremovexattr(p, n) : removexattr(p, n); }
+static inline ssize_t shim_fgetxattr(int fd, const char *n, void *v, size_t s, uint32_t pos, int o)
+{ (void) pos; (void) o; return fgetxattr(fd, n, v, s); }
+static inline int shim_fsetxattr(int fd, const char *n, const void *v, size_t s, uint32_t pos, int o)
+{ (void) pos; (void) o; return fsetxattr(fd, n, v, s, 0); }
+static inline ssize_t shim_flistxattr(int fd, char *b, size_t s, int o)
+{ (void) o; return flistxattr(fd, b, s); }
+static inline int shim_fremovexattr(int fd, const char *n, int o)
+{ (void) o; return fremovexattr(fd, n); }
+#define getxattr shim_getxattr
+#define setxattr shim_setxattr
+#define listxattr shim_listxattr
+#define removexattr shim_removexattr
+#define fgetxattr shim_fgetxattr
+#define fsetxattr shim_fsetxattr
+#define flistxattr shim_flistxattr
+#define fremovexattr shim_fremovexattr
+
+struct setattr_x {
+    int32_t valid;
+    mode_t mode; uid_t uid; gid_t gid; off_t size;
+    struct timespec acctime, modtime, crtime, chgtime, bkuptime;
+    uint32_t flags;
+};
+#define SETATTR_WANTS_MODE(attr)     ((attr)->valid & (1 << 0))
+#define SETATTR_WANTS_UID(attr)      ((attr)->valid & (1 << 1))
+#define SETATTR_WANTS_GID(attr)      ((attr)->valid & (1 << 2))
+#define SETATTR_WANTS_SIZE(attr)     ((attr)->valid & (1 << 3))
+#define SETATTR_WANTS_ACCTIME(attr)  ((attr)->valid & (1 << 4))
+#define SETATTR_WANTS_MODTIME(attr)  ((attr)->valid & (1 << 5))
+#define SETATTR_WANTS_CRTIME(attr)   ((attr)->valid & (1 << 28))
+#define SETATTR_WANTS_CHGTIME(attr)  ((attr)->valid & (1 << 29))
+#define SETATTR_WANTS_BKUPTIME(attr) ((attr)->valid & (1 << 30))
+#define SETATTR_WANTS_FLAGS(attr)    ((attr)->valid & (1U << 31))
+
+#define st_atimespec st_atim
+#define st_mtimespec st_mtim
+#endif
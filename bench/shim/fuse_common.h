@@ -0,0 +1,76 @@
+/*
+ * Created 190619 lynnl
+ *
+ * osxfuse 2.x common API subset  see: fuse.h
+ */
+
+#ifndef SHIM_FUSE_COMMON_H
+#define SHIM_FUSE_COMMON_H
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include "darwin_compat.h"
+
+#define FUSE_MAJOR_VERSION 2
+#define FUSE_MINOR_VERSION 9
+#define FUSE_MAKE_VERSION(maj, min)  ((maj) * 10 + (min))
+#define FUSE_VERSION FUSE_MAKE_VERSION(FUSE_MAJOR_VERSION, FUSE_MINOR_VERSION)
+
+struct fuse_file_info {
+    int flags;
+    unsigned long fh_old;
+    int writepage;
+    unsigned int direct_io : 1;
+    unsigned int keep_cache : 1;
+    unsigned int flush : 1;
+    unsigned int nonseekable : 1;
+    unsigned int flock_release : 1;
+    unsigned int padding : 27;
+    uint64_t fh;
+    uint64_t lock_owner;
+};
+
+struct fuse_conn_info {
+    unsigned proto_major, proto_minor, async_read, max_write, max_readahead;
+    unsigned capable, want, max_background, congestion_threshold;
+    struct { unsigned case_insensitive:1, setvolname:1, xtimes:1; } enable;
+    unsigned reserved[22];
+};
+#define FUSE_ENABLE_SETVOLNAME(i)       ((i)->enable.setvolname = 1)
+#define FUSE_ENABLE_XTIMES(i)           ((i)->enable.xtimes = 1)
+#define FUSE_ENABLE_CASE_INSENSITIVE(i) ((i)->enable.case_insensitive = 1)
+
+struct fuse_session;
+struct fuse_chan;
+
+struct fuse_args { int argc; char **argv; int allocated; };
+#define FUSE_ARGS_INIT(argc, argv) { argc, argv, 0 }
+
+struct fuse_opt { const char *templ; unsigned long offset; int value; };
+#define FUSE_OPT_KEY(templ, key) { templ, -1U, key }
+#define FUSE_OPT_END { NULL, 0, 0 }
+#define FUSE_OPT_KEY_OPT     -1
+#define FUSE_OPT_KEY_NONOPT  -2
+#define FUSE_OPT_KEY_KEEP    -3
+#define FUSE_OPT_KEY_DISCARD -4
+typedef int (*fuse_opt_proc_t)(void *data, const char *arg, int key, struct fuse_args *outargs);
+int fuse_opt_parse(struct fuse_args *args, void *data, const struct fuse_opt opts[], fuse_opt_proc_t proc);
+int fuse_opt_add_arg(struct fuse_args *args, const char *arg);
+void fuse_opt_free_args(struct fuse_args *args);
+
+enum fuse_buf_flags { FUSE_BUF_IS_FD = (1 << 1), FUSE_BUF_FD_SEEK = (1 << 2), FUSE_BUF_FD_RETRY = (1 << 3) };
+enum fuse_buf_copy_flags { FUSE_BUF_NO_SPLICE = (1 << 1), FUSE_BUF_FORCE_SPLICE = (1 << 2), FUSE_BUF_SPLICE_MOVE = (1 << 3), FUSE_BUF_SPLICE_NONBLOCK = (1 << 4) };
+struct fuse_buf { size_t size; enum fuse_buf_flags flags; void *mem; int fd; off_t pos; };
+struct fuse_bufvec { size_t count; size_t idx; size_t off; struct fuse_buf buf[1]; };
+#define FUSE_BUFVEC_INIT(size__) ((struct fuse_bufvec) { 1, 0, 0, { { size__, (enum fuse_buf_flags) 0, NULL, -1, 0 } } })
+size_t fuse_buf_size(const struct fuse_bufvec *bufv);
+ssize_t fuse_buf_copy(struct fuse_bufvec *dst, struct fuse_bufvec *src, enum fuse_buf_copy_flags flags);
+
+int fuse_parse_cmdline(struct fuse_args *args, char **mountpoint, int *multithreaded, int *foreground);
+struct fuse_chan *fuse_mount(const char *mountpoint, struct fuse_args *args);
+void fuse_unmount(const char *mountpoint, struct fuse_chan *ch);
+int fuse_daemonize(int foreground);
+int fuse_set_signal_handlers(struct fuse_session *se);
+void fuse_remove_signal_handlers(struct fuse_session *se);
+#endif
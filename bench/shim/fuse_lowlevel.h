@@ -0,0 +1,125 @@
+/*
+ * Created 190619 lynnl
+ *
+ * Low-level osxfuse 2.x API subset  see: fuse.h
+ */
+
+#ifndef SHIM_FUSE_LOWLEVEL_H
+#define SHIM_FUSE_LOWLEVEL_H
+#include "fuse_common.h"
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/uio.h>
+
+#define FUSE_ROOT_ID 1
+typedef unsigned long fuse_ino_t;
+typedef struct fuse_req *fuse_req_t;
+
+struct fuse_entry_param {
+    fuse_ino_t ino;
+    unsigned long generation;
+    struct stat attr;
+    double attr_timeout;
+    double entry_timeout;
+};
+
+struct fuse_ctx { uid_t uid; gid_t gid; pid_t pid; mode_t umask; };
+
+#define FUSE_SET_ATTR_MODE      (1 << 0)
+#define FUSE_SET_ATTR_UID       (1 << 1)
+#define FUSE_SET_ATTR_GID       (1 << 2)
+#define FUSE_SET_ATTR_SIZE      (1 << 3)
+#define FUSE_SET_ATTR_ATIME     (1 << 4)
+#define FUSE_SET_ATTR_MTIME     (1 << 5)
+#define FUSE_SET_ATTR_ATIME_NOW (1 << 7)
+#define FUSE_SET_ATTR_MTIME_NOW (1 << 8)
+#define FUSE_SET_ATTR_BKUPTIME  (1 << 28)
+#define FUSE_SET_ATTR_CHGTIME   (1 << 29)
+#define FUSE_SET_ATTR_CRTIME    (1 << 30)
+#define FUSE_SET_ATTR_FLAGS     (1 << 31)
+
+struct fuse_lowlevel_ops {
+    void (*init) (void *userdata, struct fuse_conn_info *conn);
+    void (*destroy) (void *userdata);
+    void (*lookup) (fuse_req_t req, fuse_ino_t parent, const char *name);
+    void (*forget) (fuse_req_t req, fuse_ino_t ino, unsigned long nlookup);
+    void (*getattr) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+    void (*setattr) (fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set, struct fuse_file_info *fi);
+    void (*readlink) (fuse_req_t req, fuse_ino_t ino);
+    void (*mknod) (fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev);
+    void (*mkdir) (fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode);
+    void (*unlink) (fuse_req_t req, fuse_ino_t parent, const char *name);
+    void (*rmdir) (fuse_req_t req, fuse_ino_t parent, const char *name);
+    void (*symlink) (fuse_req_t req, const char *link, fuse_ino_t parent, const char *name);
+    void (*rename) (fuse_req_t req, fuse_ino_t parent, const char *name, fuse_ino_t newparent, const char *newname);
+    void (*link) (fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent, const char *newname);
+    void (*open) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+    void (*read) (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi);
+    void (*write) (fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size, off_t off, struct fuse_file_info *fi);
+    void (*flush) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+    void (*release) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+    void (*fsync) (fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi);
+    void (*opendir) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+    void (*readdir) (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi);
+    void (*releasedir) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+    void (*fsyncdir) (fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi);
+    void (*statfs) (fuse_req_t req, fuse_ino_t ino);
+    void (*setxattr) (fuse_req_t req, fuse_ino_t ino, const char *name, const char *value, size_t size, int flags, uint32_t position);
+    void (*getxattr) (fuse_req_t req, fuse_ino_t ino, const char *name, size_t size, uint32_t position);
+    void (*listxattr) (fuse_req_t req, fuse_ino_t ino, size_t size);
+    void (*removexattr) (fuse_req_t req, fuse_ino_t ino, const char *name);
+    void (*access) (fuse_req_t req, fuse_ino_t ino, int mask);
+    void (*create) (fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, struct fuse_file_info *fi);
+    void (*getlk) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi, struct flock *lock);
+    void (*setlk) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi, struct flock *lock, int sleep);
+    void (*bmap) (fuse_req_t req, fuse_ino_t ino, size_t blocksize, uint64_t idx);
+    void (*ioctl) (fuse_req_t req, fuse_ino_t ino, int cmd, void *arg, struct fuse_file_info *fi, unsigned flags, const void *in_buf, size_t in_bufsz, size_t out_bufsz);
+    void (*poll) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi, void *ph);
+    void (*write_buf) (fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *bufv, off_t off, struct fuse_file_info *fi);
+    void (*retrieve_reply) (fuse_req_t req, void *cookie, fuse_ino_t ino, off_t offset, struct fuse_bufvec *bufv);
+    void (*forget_multi) (fuse_req_t req, size_t count, void *forgets);
+    void (*flock) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi, int op);
+    void (*fallocate) (fuse_req_t req, fuse_ino_t ino, int mode, off_t offset, off_t length, struct fuse_file_info *fi);
+    void (*reserved00) (fuse_req_t, void *, void *, void *, void *, void *, void *, void *, void *);
+    void (*setvolname) (fuse_req_t req, const char *name);
+    void (*exchange) (fuse_req_t req, fuse_ino_t parent, const char *name, fuse_ino_t newparent, const char *newname, unsigned long options);
+    void (*getxtimes) (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+};
+
+int fuse_reply_err(fuse_req_t req, int err);
+void fuse_reply_none(fuse_req_t req);
+int fuse_reply_entry(fuse_req_t req, const struct fuse_entry_param *e);
+int fuse_reply_create(fuse_req_t req, const struct fuse_entry_param *e, const struct fuse_file_info *fi);
+int fuse_reply_attr(fuse_req_t req, const struct stat *attr, double attr_timeout);
+int fuse_reply_readlink(fuse_req_t req, const char *link);
+int fuse_reply_open(fuse_req_t req, const struct fuse_file_info *fi);
+int fuse_reply_write(fuse_req_t req, size_t count);
+int fuse_reply_buf(fuse_req_t req, const char *buf, size_t size);
+int fuse_reply_data(fuse_req_t req, struct fuse_bufvec *bufv, enum fuse_buf_copy_flags flags);
+int fuse_reply_iov(fuse_req_t req, const struct iovec *iov, int count);
+int fuse_reply_statfs(fuse_req_t req, const struct statvfs *stbuf);
+int fuse_reply_xattr(fuse_req_t req, size_t count);
+int fuse_reply_lock(fuse_req_t req, const struct flock *lock);
+int fuse_reply_xtimes(fuse_req_t req, const struct timespec *bkuptime, const struct timespec *crtime);
+size_t fuse_add_direntry(fuse_req_t req, char *buf, size_t bufsize, const char *name, const struct stat *stbuf, off_t off);
+void *fuse_req_userdata(fuse_req_t req);
+const struct fuse_ctx *fuse_req_ctx(fuse_req_t req);
+int fuse_lowlevel_notify_inval_inode(struct fuse_chan *ch, fuse_ino_t ino, off_t off, off_t len);
+int fuse_lowlevel_notify_inval_entry(struct fuse_chan *ch, fuse_ino_t parent, const char *name, size_t namelen);
+
+struct fuse_session *fuse_lowlevel_new(struct fuse_args *args, const struct fuse_lowlevel_ops *op, size_t op_size, void *userdata);
+void fuse_session_add_chan(struct fuse_session *se, struct fuse_chan *ch);
+void fuse_session_remove_chan(struct fuse_chan *ch);
+struct fuse_chan *fuse_session_next_chan(struct fuse_session *se, struct fuse_chan *ch);
+void fuse_session_process(struct fuse_session *se, const char *buf, size_t len, struct fuse_chan *ch);
+void fuse_session_destroy(struct fuse_session *se);
+void fuse_session_exit(struct fuse_session *se);
+void fuse_session_reset(struct fuse_session *se);
+int fuse_session_exited(struct fuse_session *se);
+int fuse_session_loop(struct fuse_session *se);
+int fuse_session_loop_mt(struct fuse_session *se);
+int fuse_chan_fd(struct fuse_chan *ch);
+size_t fuse_chan_bufsize(struct fuse_chan *ch);
+int fuse_chan_recv(struct fuse_chan **ch, char *buf, size_t size);
+#endif
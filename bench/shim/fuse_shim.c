@@ -0,0 +1,513 @@
+/*
+ * Created 190619 lynnl
+ *
+ * libfuse stand-ins for the in-process bench  see: fuse_shim.h
+ *
+ * Only what loopbackfs.c and clockfs sources reference is here
+ * Everything needing a kernel channel fails so an accidental
+ *  mount attempt from a fs main() bails out early
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "fuse.h"
+#include "fuse_lowlevel.h"
+#include "fuse_shim.h"
+
+/**
+ * Match a single `-o' option against templates
+ * Supports the subset loopbackfs/clockfs use: flags  %u  %lf  %s
+ * @return      1 if consumed  0 if not ours  -1 if malformed value
+ */
+static int opt_match(void *data, const struct fuse_opt *opts, const char *o)
+{
+    const char *pct;
+    void *dst;
+    size_t n;
+
+    for (; opts->templ != NULL; opts++) {
+        dst = (char *) data + opts->offset;
+        pct = strchr(opts->templ, '%');
+        if (pct == NULL) {
+            if (strcmp(opts->templ, o) != 0) continue;
+            *(int *) dst = opts->value;
+            return 1;
+        }
+
+        n = pct - opts->templ;
+        if (strncmp(opts->templ, o, n) != 0) continue;
+
+        if (strcmp(pct, "%s") == 0) {
+            *(char **) dst = strdup(o + n);
+            return *(char **) dst != NULL ? 1 : -1;
+        }
+        return sscanf(o + n, pct, dst) == 1 ? 1 : -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Unlike libfuse  unknown options are silently ignored
+ *  and `args' is left untouched
+ */
+int fuse_opt_parse(
+        struct fuse_args *args,
+        void *data,
+        const struct fuse_opt opts[],
+        fuse_opt_proc_t proc)
+{
+    char *s, *o, *save;
+    const char *arg;
+    int i, e = 0;
+
+    (void) proc;
+
+    for (i = 1; i < args->argc && e == 0; i++) {
+        if (strncmp(args->argv[i], "-o", 2) != 0) continue;
+
+        arg = args->argv[i][2] != '\0' ? args->argv[i] + 2 : args->argv[++i];
+        if (arg == NULL) return -1;
+
+        s = strdup(arg);
+        if (s == NULL) return -1;
+        for (o = strtok_r(s, ",", &save); o != NULL; o = strtok_r(NULL, ",", &save)) {
+            if (opt_match(data, opts, o) < 0) {
+                fprintf(stderr, "bad option value: %s\n", o);
+                e = -1;
+                break;
+            }
+        }
+        free(s);
+    }
+
+    return e;
+}
+
+int fuse_opt_add_arg(struct fuse_args *args, const char *arg)
+{
+    (void) args;
+    (void) arg;
+    return -1;
+}
+
+void fuse_opt_free_args(struct fuse_args *args)
+{
+    (void) args;
+}
+
+size_t fuse_buf_size(const struct fuse_bufvec *bufv)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < bufv->count; i++) n += bufv->buf[i].size;
+
+    return n;
+}
+
+/**
+ * Single segment copies only  which is all loopbackfs produces
+ * fd-to-fd copy(splice) isn't emulated
+ */
+ssize_t fuse_buf_copy(
+        struct fuse_bufvec *dst,
+        struct fuse_bufvec *src,
+        enum fuse_buf_copy_flags flags)
+{
+    struct fuse_buf *d = &dst->buf[dst->idx];
+    struct fuse_buf *s = &src->buf[src->idx];
+    size_t len = d->size < s->size ? d->size : s->size;
+    ssize_t n;
+
+    (void) flags;
+
+    if ((d->flags & FUSE_BUF_IS_FD) && (s->flags & FUSE_BUF_IS_FD)) {
+        return -ENOTSUP;
+    } else if (d->flags & FUSE_BUF_IS_FD) {
+        n = pwrite(d->fd, s->mem, len, d->pos);
+    } else if (s->flags & FUSE_BUF_IS_FD) {
+        n = pread(s->fd, d->mem, len, s->pos);
+    } else {
+        (void) memcpy(d->mem, s->mem, len);
+        n = (ssize_t) len;
+    }
+
+    return n < 0 ? -errno : n;
+}
+
+static int reply(fuse_req_t req, int err, size_t size)
+{
+    req->replied++;
+    req->err = err;
+    req->size = size;
+    return 0;
+}
+
+int fuse_reply_err(fuse_req_t req, int err)
+{
+    return reply(req, err, 0);
+}
+
+void fuse_reply_none(fuse_req_t req)
+{
+    (void) reply(req, 0, 0);
+}
+
+int fuse_reply_entry(fuse_req_t req, const struct fuse_entry_param *e)
+{
+    req->ino = e->ino;
+    req->attr = e->attr;
+    return reply(req, 0, 0);
+}
+
+int fuse_reply_create(
+        fuse_req_t req,
+        const struct fuse_entry_param *e,
+        const struct fuse_file_info *fi)
+{
+    req->fh = fi->fh;
+    return fuse_reply_entry(req, e);
+}
+
+int fuse_reply_attr(fuse_req_t req, const struct stat *attr, double attr_timeout)
+{
+    (void) attr_timeout;
+    req->attr = *attr;
+    return reply(req, 0, 0);
+}
+
+int fuse_reply_readlink(fuse_req_t req, const char *link)
+{
+    return reply(req, 0, strlen(link));
+}
+
+int fuse_reply_open(fuse_req_t req, const struct fuse_file_info *fi)
+{
+    req->fh = fi->fh;
+    return reply(req, 0, 0);
+}
+
+int fuse_reply_write(fuse_req_t req, size_t count)
+{
+    return reply(req, 0, count);
+}
+
+/**
+ * Copies into req->sink if any  as the kernel channel would have
+ */
+int fuse_reply_buf(fuse_req_t req, const char *buf, size_t size)
+{
+    if (req->sink != NULL && size != 0) {
+        (void) memcpy(req->sink, buf, size < req->sinksz ? size : req->sinksz);
+    }
+    return reply(req, 0, size);
+}
+
+int fuse_reply_data(
+        fuse_req_t req,
+        struct fuse_bufvec *bufv,
+        enum fuse_buf_copy_flags flags)
+{
+    size_t size = fuse_buf_size(bufv);
+    struct fuse_bufvec mem = FUSE_BUFVEC_INIT(size);
+    ssize_t n = (ssize_t) size;
+
+    if (req->sink != NULL) {
+        mem.buf[0].mem = req->sink;
+        mem.buf[0].size = size < req->sinksz ? size : req->sinksz;
+        n = fuse_buf_copy(&mem, bufv, flags);
+        if (n < 0) return reply(req, (int) -n, 0);
+    }
+
+    return reply(req, 0, (size_t) n);
+}
+
+int fuse_reply_iov(fuse_req_t req, const struct iovec *iov, int count)
+{
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < count; i++) size += iov[i].iov_len;
+
+    return reply(req, 0, size);
+}
+
+int fuse_reply_statfs(fuse_req_t req, const struct statvfs *stbuf)
+{
+    (void) stbuf;
+    return reply(req, 0, 0);
+}
+
+int fuse_reply_xattr(fuse_req_t req, size_t count)
+{
+    return reply(req, 0, count);
+}
+
+int fuse_reply_lock(fuse_req_t req, const struct flock *lock)
+{
+    (void) lock;
+    return reply(req, 0, 0);
+}
+
+int fuse_reply_xtimes(
+        fuse_req_t req,
+        const struct timespec *bkuptime,
+        const struct timespec *crtime)
+{
+    (void) bkuptime;
+    (void) crtime;
+    return reply(req, 0, 0);
+}
+
+/* Same record size as osxfuse/fuse/lib/fuse_lowlevel.c#fuse_dirent_size() */
+#define DIRENT_NAME_OFF     24
+#define DIRENT_ALIGN(x)     (((x) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1))
+
+size_t fuse_add_direntry(
+        fuse_req_t req,
+        char *buf,
+        size_t bufsize,
+        const char *name,
+        const struct stat *stbuf,
+        off_t off)
+{
+    size_t namelen = strlen(name);
+    size_t entsize = DIRENT_ALIGN(DIRENT_NAME_OFF + namelen);
+
+    (void) req;
+    (void) stbuf;
+    (void) off;
+
+    if (buf != NULL && entsize <= bufsize) {
+        (void) memset(buf, 0, DIRENT_NAME_OFF);
+        (void) memcpy(buf + DIRENT_NAME_OFF, name, namelen);
+    }
+
+    return entsize;
+}
+
+void *fuse_req_userdata(fuse_req_t req)
+{
+    (void) req;
+    return NULL;
+}
+
+const struct fuse_ctx *fuse_req_ctx(fuse_req_t req)
+{
+    static struct fuse_ctx ctx;
+    (void) req;
+    return &ctx;
+}
+
+struct fuse_context *fuse_get_context(void)
+{
+    static struct fuse_context ctx;
+    return &ctx;
+}
+
+/* No kernel cache to invalidate */
+int fuse_lowlevel_notify_inval_inode(
+        struct fuse_chan *ch,
+        fuse_ino_t ino,
+        off_t off,
+        off_t len)
+{
+    (void) ch;
+    (void) ino;
+    (void) off;
+    (void) len;
+    return 0;
+}
+
+int fuse_lowlevel_notify_inval_entry(
+        struct fuse_chan *ch,
+        fuse_ino_t parent,
+        const char *name,
+        size_t namelen)
+{
+    (void) ch;
+    (void) parent;
+    (void) name;
+    (void) namelen;
+    return 0;
+}
+
+/*
+ * Mount and session plumbing  never reached by the bench drivers
+ * They only exist so fs main()s link
+ */
+
+int fuse_main_real(
+        int argc,
+        char *argv[],
+        const struct fuse_operations *op,
+        size_t op_size,
+        void *user_data)
+{
+    (void) argc;
+    (void) argv;
+    (void) op;
+    (void) op_size;
+    (void) user_data;
+    return 1;
+}
+
+int fuse_parse_cmdline(
+        struct fuse_args *args,
+        char **mountpoint,
+        int *multithreaded,
+        int *foreground)
+{
+    (void) args;
+    (void) multithreaded;
+    (void) foreground;
+    *mountpoint = NULL;
+    return -1;
+}
+
+struct fuse_chan *fuse_mount(const char *mountpoint, struct fuse_args *args)
+{
+    (void) mountpoint;
+    (void) args;
+    errno = ENODEV;
+    return NULL;
+}
+
+void fuse_unmount(const char *mountpoint, struct fuse_chan *ch)
+{
+    (void) mountpoint;
+    (void) ch;
+}
+
+int fuse_daemonize(int foreground)
+{
+    (void) foreground;
+    return 0;
+}
+
+struct fuse *fuse_new(
+        struct fuse_chan *ch,
+        struct fuse_args *args,
+        const struct fuse_operations *op,
+        size_t op_size,
+        void *user_data)
+{
+    (void) ch;
+    (void) args;
+    (void) op;
+    (void) op_size;
+    (void) user_data;
+    return NULL;
+}
+
+void fuse_destroy(struct fuse *f)
+{
+    (void) f;
+}
+
+struct fuse_session *fuse_get_session(struct fuse *f)
+{
+    (void) f;
+    return NULL;
+}
+
+struct fuse_session *fuse_lowlevel_new(
+        struct fuse_args *args,
+        const struct fuse_lowlevel_ops *op,
+        size_t op_size,
+        void *userdata)
+{
+    (void) args;
+    (void) op;
+    (void) op_size;
+    (void) userdata;
+    return NULL;
+}
+
+int fuse_set_signal_handlers(struct fuse_session *se)
+{
+    (void) se;
+    return -1;
+}
+
+void fuse_remove_signal_handlers(struct fuse_session *se)
+{
+    (void) se;
+}
+
+void fuse_session_add_chan(struct fuse_session *se, struct fuse_chan *ch)
+{
+    (void) se;
+    (void) ch;
+}
+
+void fuse_session_remove_chan(struct fuse_chan *ch)
+{
+    (void) ch;
+}
+
+/* clock_update() calls this once at start  a NULL channel is fine */
+struct fuse_chan *fuse_session_next_chan(struct fuse_session *se, struct fuse_chan *ch)
+{
+    (void) se;
+    (void) ch;
+    return NULL;
+}
+
+void fuse_session_process(
+        struct fuse_session *se,
+        const char *buf,
+        size_t len,
+        struct fuse_chan *ch)
+{
+    (void) se;
+    (void) buf;
+    (void) len;
+    (void) ch;
+}
+
+void fuse_session_destroy(struct fuse_session *se)
+{
+    (void) se;
+}
+
+void fuse_session_exit(struct fuse_session *se)
+{
+    (void) se;
+}
+
+int fuse_session_exited(struct fuse_session *se)
+{
+    (void) se;
+    return 1;
+}
+
+int fuse_session_loop(struct fuse_session *se)
+{
+    (void) se;
+    return -1;
+}
+
+int fuse_session_loop_mt(struct fuse_session *se)
+{
+    (void) se;
+    return -1;
+}
+
+size_t fuse_chan_bufsize(struct fuse_chan *ch)
+{
+    (void) ch;
+    return 0;
+}
+
+int fuse_chan_recv(struct fuse_chan **ch, char *buf, size_t size)
+{
+    (void) ch;
+    (void) buf;
+    (void) size;
+    return -ENODEV;
+}
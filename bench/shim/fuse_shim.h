@@ -0,0 +1,56 @@
+/*
+ * Created 190619 lynnl
+ *
+ * Bench side of the libfuse shim  no kernel channel behind it
+ *
+ * Low-level callbacks reply into a caller-owned `struct fuse_req'
+ *  so the driver can check results without a session
+ */
+
+#ifndef SHIM_FUSE_SHIM_H
+#define SHIM_FUSE_SHIM_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "fuse_lowlevel.h"
+
+/**
+ * What the last fuse_reply_*() left behind
+ * `data' points into the callback's buffer  only valid inside reply
+ *  hence `sink' keeps a copy when set(see: fuse_reply_buf())
+ */
+struct fuse_req {
+    int replied;
+    int err;            /* Positive errno  0 if success */
+    size_t size;        /* Bytes replied  read/write/xattr/buf */
+    struct stat attr;   /* attr  entry  create */
+    fuse_ino_t ino;     /* entry  create */
+    uint64_t fh;        /* open  create */
+    char *sink;         /* Optional copy-out buffer for reply data */
+    size_t sinksz;
+};
+
+static inline void fuse_req_reset(struct fuse_req *req)
+{
+    req->replied = 0;
+    req->err = 0;
+    req->size = 0;
+}
+
+/**
+ * Release a read_buf() reply the way libfuse does after replying
+ *  every segment's mem then the bufvec itself(see: fuse.c fuse_free_buf())
+ * Freeing only the bufvec would hide a segment that isn't its own allocation
+ */
+static inline void shim_free_buf(struct fuse_bufvec *buf)
+{
+    size_t i;
+
+    if (buf == NULL) return;
+    for (i = 0; i < buf->count; i++) free(buf->buf[i].mem);
+    free(buf);
+}
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * Created 190619 lynnl
+ *
+ * fallocate() mode bits from osxfuse  see: loopbackfs.c#lb_fallocate()
+ */
+
+#ifndef SHIM_SYS_VNODE_H
+#define SHIM_SYS_VNODE_H
+#define PREALLOCATE         0x00000001
+#define ALLOCATECONTIG      0x00000002
+#define ALLOCATEALL         0x00000004
+#define ALLOCATEFROMPEOF    0x00000010
+#define ALLOCATEFROMVOL     0x00000020
+#endif
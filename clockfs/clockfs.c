@@ -17,6 +17,7 @@
 #endif
 
 #include <stdio.h>
+#include <stddef.h>     /* offsetof() */
 #include <assert.h>
 #include <errno.h>
 #include <string.h>
@@ -24,17 +25,48 @@
 #include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
-#include <unistd.h>     /* usleep(3) */
 
 #include <fuse.h>
 #include <fuse_lowlevel.h>
 
 #include "utils.h"
+#include "snapshot.h"
+#include "ticker.h"
+#include "datetime.h"
+
+struct clockfs_config {
+    unsigned resolution;    /* Update resolution in milliseconds */
+    int lazy;               /* Render on open  no clock_update() thread */
+    char *log_level;        /* err  warning  notice  debug */
+    int log_ring;           /* Log through per-thread rings  see: log.h */
+};
+
+static struct clockfs_config clockfs_cfg = {
+    .resolution = 250,
+};
 
-#define DATA_BUFSZ  64
+static struct fuse_opt clockfs_opts[] = {
+    {"resolution=%u", offsetof(struct clockfs_config, resolution), 0},
+    {"lazy", offsetof(struct clockfs_config, lazy), 1},
+    {"log-level=%s", offsetof(struct clockfs_config, log_level), 0},
+    {"log=ring", offsetof(struct clockfs_config, log_ring), 1},
+    {"log=sync", offsetof(struct clockfs_config, log_ring), 0},
+    FUSE_OPT_END,
+};
+
+static struct clock_ticker ticker = CLOCK_TICKER_INITIALIZER(250);
 
 static const char *file_path = "/clock.txt";
-static char file_data[DATA_BUFSZ];
+static struct clock_snapshot file_data;
+
+/**
+ * Per open file handle content in lazy mode  stored in fi->fh
+ * A read sequence of a handle always sees the same timestamp
+ */
+struct clock_fh {
+    size_t len;
+    char data[DATA_BUFSZ];
+};
 
 static int clock_getattr(const char *path, struct stat *stbuf)
 {
@@ -54,7 +86,7 @@ static int clock_getattr(const char *path, struct stat *stbuf)
 
         stbuf->st_mode = S_IFREG | 0444;    /* r--r--r-- */
         stbuf->st_nlink = 1;
-        stbuf->st_size = strlen(file_data);
+        stbuf->st_size = snapshot_read(&file_data, NULL);
     } else {
         /* No need to memset `stbuf' since it met an error */
 
@@ -66,6 +98,8 @@ static int clock_getattr(const char *path, struct stat *stbuf)
 
 static int clock_open(const char *path, struct fuse_file_info *fi)
 {
+    struct clock_fh *fh;
+
     assert_nonnull(path);
     assert_nonnull(fi);
 
@@ -79,6 +113,34 @@ static int clock_open(const char *path, struct fuse_file_info *fi)
         return -EACCES;     /* Only O_RDONLY access mode is allowed */
     }
 
+    if (clockfs_cfg.lazy) {
+        fh = (struct clock_fh *) malloc(sizeof(*fh));
+        if (fh == NULL) return -ENOMEM;
+        fh->len = fmt_datetime(fh->data, sizeof(fh->data));
+        fi->fh = (uint64_t) fh;
+        /* Bypass kernel page cache  content is per handle */
+        fi->direct_io = 1;
+    } else {
+        /* Wake up clock_update() if it's idle */
+        ticker_open(&ticker);
+    }
+
+    return 0;
+}
+
+static int clock_release(const char *path, struct fuse_file_info *fi)
+{
+    assert_nonnull(path);
+    assert_nonnull(fi);
+
+    SYSLOG_DBG("release()  path: %s fi->flags: %#x", path, fi->flags);
+
+    if (fi->fh != 0) {
+        free((struct clock_fh *) fi->fh);
+    } else {
+        ticker_release(&ticker);
+    }
+
     return 0;
 }
 
@@ -89,6 +151,9 @@ static int clock_read(
         off_t off,
         struct fuse_file_info *fi)
 {
+    struct clock_fh *fh;
+    char data[DATA_BUFSZ];
+    const char *p;
     size_t file_size;
 
     assert_nonnull(path);
@@ -96,24 +161,32 @@ static int clock_read(
     assert(off >= 0);
     assert_nonnull(fi);
 
-    SYSLOG_DBG("read()  path: %s size: %zu off: %lld fi->flags: %#x", path, sz, off, fi->flags);
+    SYSLOG_DBG("read()  path: %s size: %zu off: %lld fi->flags: %#x", path, sz, (long long) off, fi->flags);
 
     if (strcmp(path, file_path) != 0) {
         return -ENOENT;
     }
 
-    file_size = strlen(file_data);
+    if (fi->fh != 0) {
+        fh = (struct clock_fh *) fi->fh;
+        p = fh->data;
+        file_size = fh->len;
+    } else {
+        /* Work on a private copy  clock_update() may rewrite it meanwhile */
+        file_size = snapshot_read(&file_data, data);
+        p = data;
+    }
 
     /* Trying to read past EOF of file_path */
     if ((size_t) off >= file_size) {
-        SYSLOG_WARN("Read past EOF?!  off: %lld size: %zu", off, sz);
+        SYSLOG_WARN("Read past EOF?!  off: %lld size: %zu", (long long) off, sz);
         return 0;
     }
 
     if (off + sz > file_size)
         sz = file_size - off;   /* Trim the read to the file size */
 
-    (void) memcpy(buf, file_data + off, sz);
+    (void) memcpy(buf, p + off, sz);
 
     return (int) sz;
 }
@@ -131,7 +204,7 @@ static int clock_readdir(
     assert(off >= 0);
     assert_nonnull(fi);
 
-    SYSLOG_DBG("readdir()  path: %s off: %lld fi->flags: %#x", path, off, fi->flags);
+    SYSLOG_DBG("readdir()  path: %s off: %lld fi->flags: %#x", path, (long long) off, fi->flags);
 
     /* clockfs have only one directory(e.g. the root directory) */
     if (strcmp(path, "/") != 0) return -ENOENT;
@@ -143,33 +216,13 @@ static int clock_readdir(
     return 0;
 }
 
-static void fmt_datetime(char *str, size_t n)
-{
-    struct timeval tv;
-    struct tm *t;
-
-    assert_nonnull(str);
-    assert(n > 0);
-
-    (void) gettimeofday(&tv, NULL);     /* Won't fail */
-    t = localtime(&tv.tv_sec);
-    *str = '\0';
-
-    if (t != NULL) {
-        (void)
-        snprintf(str, n, "%2d/%02d/%02d %02d:%02d:%02d.%03d%+05ld\n",
-            (1900 + t->tm_year) % 100, t->tm_mon + 1, t->tm_mday,
-            t->tm_hour, t->tm_min, t->tm_sec,
-            tv.tv_usec / 1000, t->tm_gmtoff * 100 / 3600);
-    }
-}
-
-#define MSEC_PER_USEC   1000
-
 static void *clock_update(void *arg)
 {
     struct fuse_session *se;
     struct fuse_chan *ch;
+    char buf[DATA_BUFSZ];
+    size_t len;
+    uint64_t gen;
     int e;
 
     assert_nonnull(arg);
@@ -179,26 +232,31 @@ static void *clock_update(void *arg)
 
     LOG("clock update thread is up");
 
-    while (!fuse_session_exited(se)) {
-        fmt_datetime(file_data, sizeof(file_data));
-
-        /*
-         * fuse_lowlevel_notify_inval_inode() may return errno ENOTCONN (57)
-         * it means fs's backing `struct fuse_ll' not yet initialized
-         * case happens when function called sooner than fuse_session_loop()
-         * see: osxfuse/fuse/lib/fuse_lowlevel.c#fuse_lowlevel_notify_inval_inode
-         */
-        e = fuse_lowlevel_notify_inval_inode(ch, 2, 0, 0);
-        if (e != 0 && e != -ENOENT) {
+    do {
+        len = fmt_datetime(buf, sizeof(buf));
+        gen = snapshot_publish(&file_data, buf, len);
+        ticker_ticked(&ticker);
+
+        /* Skip invalidation if content unchanged  kernel's copy still valid */
+        if (gen != 0) {
             /*
-             * inode 2(the only regular file) may not yet present in this fs
-             * in such case fuse_lowlevel_notify_inval_inode() will return -ENOENT
+             * fuse_lowlevel_notify_inval_inode() may return errno ENOTCONN (57)
+             * it means fs's backing `struct fuse_ll' not yet initialized
+             * case happens when function called sooner than fuse_session_loop()
+             * see: osxfuse/fuse/lib/fuse_lowlevel.c#fuse_lowlevel_notify_inval_inode
              */
-            LOG_ERROR("fuse_lowlevel_notify_inval_inode() fail  errno: %d", -e);
+            e = fuse_lowlevel_notify_inval_inode(ch, 2, 0, 0);
+            if (e != 0 && e != -ENOENT) {
+                /*
+                 * inode 2(the only regular file) may not yet present in this fs
+                 * in such case fuse_lowlevel_notify_inval_inode() will return -ENOENT
+                 */
+                LOG_ERROR("fuse_lowlevel_notify_inval_inode() fail  errno: %d", -e);
+            }
         }
 
-        (void) usleep(250 * MSEC_PER_USEC);
-    }
+        /* Sleep till next resolution boundary  or until clock.txt opened */
+    } while (ticker_wait(&ticker) == 0);
 
     LOG("clock update thread going to die...");
     pthread_exit(NULL);
@@ -208,6 +266,7 @@ static struct fuse_operations clockfs_ops = {
     .getattr = clock_getattr,
     .open = clock_open,
     .read = clock_read,
+    .release = clock_release,
     .readdir = clock_readdir,
 };
 
@@ -225,16 +284,43 @@ int main(int argc, char *argv[])
     struct fuse *fuse;
     struct fuse_session *se;
     pthread_t clock_thread;
+    char buf[DATA_BUFSZ];
+    size_t len;
     int e;
 
     /* Setup syslog(3) */
     (void) setlogmask(LOG_UPTO(LOG_NOTICE));
 
+    if (fuse_opt_parse(&args, &clockfs_cfg, clockfs_opts, NULL) == -1) {
+        LOG_ERROR("fuse_opt_parse() fail");
+        e = 1;
+        goto out_args;
+    }
+
+    if (clockfs_cfg.resolution == 0) {
+        LOG_ERROR("resolution must be positive");
+        e = 1;
+        goto out_args;
+    }
+    ticker.resolution = clockfs_cfg.resolution;
+
+    e = log_parse_level(clockfs_cfg.log_level);
+    if (e < 0) {
+        LOG_ERROR("bad log-level: %s", clockfs_cfg.log_level);
+        e = 1;
+        goto out_args;
+    }
+    if (log_init(e, clockfs_cfg.log_ring) != 0) {
+        LOG_ERROR("log_init() fail  errno: %d", errno);
+        e = 1;
+        goto out_args;
+    }
+
     e = fuse_parse_cmdline(&args, &mountpoint, NULL, NULL);
     if (e == -1) {
         LOG_ERROR("fuse_parse_cmdline() fail");
         e = 1;
-        goto out_fail;
+        goto out_args;
     } else if (mountpoint == NULL) {
         if (argc == 1) LOG_ERROR("no mountpoint  -h for help");
         e = 2;
@@ -264,7 +350,11 @@ int main(int argc, char *argv[])
     if (fuse_set_signal_handlers(se) != -1) {
         LOG("type `umount %s' in shell for unmount", mountpoint);
 
-        if (pthread_create(&clock_thread, NULL, &clock_update, se) != 0) {
+        if (clockfs_cfg.lazy) {
+            /* Only for st_size  reads rendered per handle in clock_open() */
+            len = fmt_datetime(buf, sizeof(buf));
+            (void) snapshot_publish(&file_data, buf, len);
+        } else if (pthread_create(&clock_thread, NULL, &clock_update, se) != 0) {
             LOG_ERROR("pthread_create(3) fail  errno: %d", errno);
             e = 5;
             goto out_pthread;
@@ -280,10 +370,14 @@ int main(int argc, char *argv[])
         /* NOTE: is it's ok to call fuse_session_exit()? */
         fuse_session_exit(se);
 
-        e = pthread_join(clock_thread, NULL);
-        if (e != 0) {
-            LOG_ERROR("pthread_join(3) fail  errno: %d", e);
-            e = 7;
+        if (!clockfs_cfg.lazy) {
+            ticker_stop(&ticker);
+
+            e = pthread_join(clock_thread, NULL);
+            if (e != 0) {
+                LOG_ERROR("pthread_join(3) fail  errno: %d", e);
+                e = 7;
+            }
         }
 
 out_pthread:
@@ -299,8 +393,8 @@ out_fuse:
 out_chan:
     free(mountpoint);
 out_args:
+    log_fini();
     fuse_opt_free_args(&args);
-out_fail:
     return e;
 }
 
@@ -19,6 +19,7 @@
 #endif
 
 #include <stdio.h>
+#include <stddef.h>     /* offsetof() */
 #include <assert.h>
 #include <errno.h>
 #include <string.h>
@@ -26,16 +27,51 @@
 #include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
-#include <unistd.h>     /* usleep(3) */
 
 #include <fuse_lowlevel.h>
 
 #include "utils.h"
+#include "snapshot.h"
+#include "ticker.h"
+#include "datetime.h"
+#include "session.h"
+
+struct clockfs_ll_config {
+    unsigned threads;       /* FUSE worker threads */
+    unsigned resolution;    /* Update resolution in milliseconds */
+    int lazy;               /* Render on open  no clock_update() thread */
+    char *log_level;        /* err  warning  notice  debug */
+    int log_ring;           /* Log through per-thread rings  see: log.h */
+};
+
+static struct clockfs_ll_config clockfs_ll_cfg = {
+    .threads = 1,
+    .resolution = 250,
+};
 
-#define DATA_BUFSZ  64
+static struct fuse_opt clockfs_ll_opts[] = {
+    {"threads=%u", offsetof(struct clockfs_ll_config, threads), 0},
+    {"resolution=%u", offsetof(struct clockfs_ll_config, resolution), 0},
+    {"lazy", offsetof(struct clockfs_ll_config, lazy), 1},
+    {"log-level=%s", offsetof(struct clockfs_ll_config, log_level), 0},
+    {"log=ring", offsetof(struct clockfs_ll_config, log_ring), 1},
+    {"log=sync", offsetof(struct clockfs_ll_config, log_ring), 0},
+    FUSE_OPT_END,
+};
+
+static struct clock_ticker ticker = CLOCK_TICKER_INITIALIZER(250);
 
 static const char *file_name = "clock.txt";
-static char file_data[DATA_BUFSZ];
+static struct clock_snapshot file_data;
+
+/**
+ * Per open file handle content in lazy mode  stored in fi->fh
+ * A read sequence of a handle always sees the same timestamp
+ */
+struct clock_fh {
+    size_t len;
+    char data[DATA_BUFSZ];
+};
 
 static int clock_stat(fuse_ino_t ino, struct stat *stbuf)
 {
@@ -51,7 +87,7 @@ static int clock_stat(fuse_ino_t ino, struct stat *stbuf)
     case 2:
         stbuf->st_mode = S_IFREG | 0444;    /* r--r--r-- */
         stbuf->st_nlink = 1;
-        stbuf->st_size = strlen(file_data);
+        stbuf->st_size = snapshot_read(&file_data, NULL);
         break;
 
     default:
@@ -71,6 +107,7 @@ static void clock_ll_lookup(
 
     assert_nonnull(req);
     assert_nonnull(name);
+    UNUSED(e);
 
     SYSLOG_DBG("lookup()  parent: %#lx name: %s", parent, name);
 
@@ -100,6 +137,8 @@ static void clock_ll_getattr(
 
     assert_nonnull(req);
     assert(fi == NULL);
+    UNUSED(e);
+    UNUSED(fi);
 
     SYSLOG_DBG("getattr()  ino: %#lx", ino);
 
@@ -184,9 +223,10 @@ static void clock_ll_readdir(
     assert_nonnull(req);
     assert_nonnull(fi);
     assert(off >= 0);
+    UNUSED(e);
 
     SYSLOG_DBG("readdir()  ino: %#lx size: %zu off: %lld fi->flags: %#x",
-                        ino, size, off, fi->flags);
+                        ino, size, (long long) off, fi->flags);
 
     if (ino != 1) {     /* If not root directory */
         e = fuse_reply_err(req, ENOTDIR);
@@ -211,6 +251,7 @@ static void clock_ll_open(
         fuse_ino_t ino,
         struct fuse_file_info *fi)
 {
+    struct clock_fh *fh;
     int e;
 
     assert_nonnull(req);
@@ -224,12 +265,52 @@ static void clock_ll_open(
     } else if ((fi->flags & O_ACCMODE) != O_RDONLY) {
         e = fuse_reply_err(req, EACCES);
         assert(e == 0);
+    } else if (clockfs_ll_cfg.lazy) {
+        fh = (struct clock_fh *) malloc(sizeof(*fh));
+        if (fh == NULL) {
+            e = fuse_reply_err(req, ENOMEM);
+            assert(e == 0);
+            return;
+        }
+        fh->len = fmt_datetime(fh->data, sizeof(fh->data));
+        fi->fh = (uint64_t) fh;
+        /* Bypass kernel page cache  content is per handle */
+        fi->direct_io = 1;
+
+        e = fuse_reply_open(req, fi);
+        if (e != 0) free(fh);
     } else {
+        /* Wake up clock_update() if it's idle */
+        ticker_open(&ticker);
         e = fuse_reply_open(req, fi);
         assert(e == 0);
     }
 }
 
+static void clock_ll_release(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        struct fuse_file_info *fi)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    UNUSED(ino);
+    UNUSED(e);
+
+    SYSLOG_DBG("release()  ino: %#lx fi->flags: %#x", ino, fi->flags);
+
+    assert(ino == 2);
+    if (fi->fh != 0) {
+        free((struct clock_fh *) fi->fh);
+    } else {
+        ticker_release(&ticker);
+    }
+    e = fuse_reply_err(req, 0);
+    assert(e == 0);
+}
+
 static void clock_ll_read(
         fuse_req_t req,
         fuse_ino_t ino,
@@ -237,47 +318,38 @@ static void clock_ll_read(
         off_t off,
         struct fuse_file_info *fi)
 {
+    struct clock_fh *fh;
+    char data[DATA_BUFSZ];
+    size_t len;
     int e;
 
     assert_nonnull(req);
     assert_nonnull(fi);
     assert(off >= 0);
+    UNUSED(e);
 
     SYSLOG_DBG("read()  ino: %#lx size: %zu off: %lld fi->flags: %#x",
-                        ino, size, off, fi->flags);
+                        ino, size, (long long) off, fi->flags);
 
     assert(ino == 2);
-    e = reply_buf_limited(req, file_data, strlen(file_data), off, size);
-    assert(e == 0);
-}
-
-static void fmt_datetime(char *str, size_t n)
-{
-    struct timeval tv;
-    struct tm *t;
-
-    assert_nonnull(str);
-    assert(n > 0);
-
-    (void) gettimeofday(&tv, NULL);     /* Won't fail */
-    t = localtime(&tv.tv_sec);
-    *str = '\0';
-
-    if (t != NULL) {
-        (void)
-        snprintf(str, n, "%2d/%02d/%02d %02d:%02d:%02d.%03d%+05ld\n",
-            (1900 + t->tm_year) % 100, t->tm_mon + 1, t->tm_mday,
-            t->tm_hour, t->tm_min, t->tm_sec,
-            tv.tv_usec / 1000, t->tm_gmtoff * 100 / 3600);
+    if (fi->fh != 0) {
+        fh = (struct clock_fh *) fi->fh;
+        e = reply_buf_limited(req, fh->data, fh->len, off, size);
+    } else {
+        /* Work on a private copy  clock_update() may rewrite it meanwhile */
+        len = snapshot_read(&file_data, data);
+        e = reply_buf_limited(req, data, len, off, size);
     }
+    assert(e == 0);
 }
 
-#define MSEC_PER_USEC   1000
-
 static void *clock_update(void *arg)
 {
     struct fuse_session *se;
     struct fuse_chan *ch;
+    char buf[DATA_BUFSZ];
+    size_t len;
+    uint64_t gen;
     int e;
 
     assert_nonnull(arg);
@@ -285,26 +357,31 @@ static void *clock_update(void *arg)
     se = (struct fuse_session *) arg;
     ch = fuse_session_next_chan(se, NULL);
 
-    while (!fuse_session_exited(se)) {
-        fmt_datetime(file_data, sizeof(file_data));
-
-        /*
-         * fuse_lowlevel_notify_inval_inode() may return errno ENOTCONN (57)
-         * it means fs's backing `struct fuse_ll' not yet initialized
-         * case happens when function called sooner than fuse_session_loop()
-         * see: osxfuse/fuse/lib/fuse_lowlevel.c#fuse_lowlevel_notify_inval_inode
-         */
-        e = fuse_lowlevel_notify_inval_inode(ch, 2, 0, 0);
-        if (e != 0 && e != -ENOENT) {
+    do {
+        len = fmt_datetime(buf, sizeof(buf));
+        gen = snapshot_publish(&file_data, buf, len);
+        ticker_ticked(&ticker);
+
+        /* Skip invalidation if content unchanged  kernel's copy still valid */
+        if (gen != 0) {
             /*
-             * inode 2(the only regular file) may not yet present in this fs
-             * in such case fuse_lowlevel_notify_inval_inode() will return -ENOENT
+             * fuse_lowlevel_notify_inval_inode() may return errno ENOTCONN (57)
+             * it means fs's backing `struct fuse_ll' not yet initialized
+             * case happens when function called sooner than fuse_session_loop()
+             * see: osxfuse/fuse/lib/fuse_lowlevel.c#fuse_lowlevel_notify_inval_inode
              */
-            LOG_ERROR("fuse_lowlevel_notify_inval_inode() fail  errno: %d", -e);
+            e = fuse_lowlevel_notify_inval_inode(ch, 2, 0, 0);
+            if (e != 0 && e != -ENOENT) {
+                /*
+                 * inode 2(the only regular file) may not yet present in this fs
+                 * in such case fuse_lowlevel_notify_inval_inode() will return -ENOENT
+                 */
+                LOG_ERROR("fuse_lowlevel_notify_inval_inode() fail  errno: %d", -e);
+            }
         }
 
-        (void) usleep(250 * MSEC_PER_USEC);
-    }
+        /* Sleep till next resolution boundary  or until clock.txt opened */
+    } while (ticker_wait(&ticker) == 0);
 
     pthread_exit(NULL);
 }
@@ -315,6 +392,7 @@ static const struct fuse_lowlevel_ops clock_ll_ops = {
     .readdir = clock_ll_readdir,
     .open = clock_ll_open,
     .read = clock_ll_read,
+    .release = clock_ll_release,
 };
 
 int main(int argc, char *argv[])
@@ -324,16 +402,43 @@ int main(int argc, char *argv[])
     struct fuse_session *se;
     char *mountpoint = NULL;
     pthread_t clock_thread;
+    char buf[DATA_BUFSZ];
+    size_t len;
     int e;
 
     /* Setup syslog(3) */
     (void) setlogmask(LOG_UPTO(LOG_NOTICE));
 
+    if (fuse_opt_parse(&args, &clockfs_ll_cfg, clockfs_ll_opts, NULL) == -1) {
+        LOG_ERROR("fuse_opt_parse() fail");
+        e = 1;
+        goto out_args;
+    }
+
+    if (clockfs_ll_cfg.resolution == 0) {
+        LOG_ERROR("resolution must be positive");
+        e = 1;
+        goto out_args;
+    }
+    ticker.resolution = clockfs_ll_cfg.resolution;
+
+    e = log_parse_level(clockfs_ll_cfg.log_level);
+    if (e < 0) {
+        LOG_ERROR("bad log-level: %s", clockfs_ll_cfg.log_level);
+        e = 1;
+        goto out_args;
+    }
+    if (log_init(e, clockfs_ll_cfg.log_ring) != 0) {
+        LOG_ERROR("log_init() fail  errno: %d", errno);
+        e = 1;
+        goto out_args;
+    }
+
     e = fuse_parse_cmdline(&args, &mountpoint, NULL, NULL);
     if (e == -1) {
         LOG_ERROR("fuse_parse_cmdline() fail");
         e = 1;
-        goto out_fail;
+        goto out_args;
     } else if (mountpoint == NULL) {
         if (argc == 1) LOG_ERROR("no mountpoint  -h for help");
         e = 2;
@@ -362,13 +467,18 @@ int main(int argc, char *argv[])
 
         LOG("Type `umount %s' in shell to stop this fs", mountpoint);
 
-        if (pthread_create(&clock_thread, NULL, &clock_update, se) != 0) {
+        if (clockfs_ll_cfg.lazy) {
+            /* Only for st_size  reads rendered per handle in clock_ll_open() */
+            len = fmt_datetime(buf, sizeof(buf));
+            (void) snapshot_publish(&file_data, buf, len);
+        } else if (pthread_create(&clock_thread, NULL, &clock_update, se) != 0) {
             LOG_ERROR("pthread_create(3) fail  errno: %d", errno);
             e = 5;
             goto out_pthread;
         }
 
-        if (fuse_session_loop(se) == -1) {
+        /* -o threads=N  default single threaded fuse_session_loop() */
+        if (session_loop_pool(se, clockfs_ll_cfg.threads) == -1) {
             e = 6;
             LOG_ERROR("fuse_session_loop() fail");
         } else {
@@ -378,10 +488,14 @@ int main(int argc, char *argv[])
         /* NOTE: is it's ok to call fuse_session_exit()? */
         fuse_session_exit(se);
 
-        e = pthread_join(clock_thread, NULL);
-        if (e != 0) {
-            LOG_ERROR("pthread_join(3) fail  errno: %d", e);
-            e = 8;
+        if (!clockfs_ll_cfg.lazy) {
+            ticker_stop(&ticker);
+
+            e = pthread_join(clock_thread, NULL);
+            if (e != 0) {
+                LOG_ERROR("pthread_join(3) fail  errno: %d", e);
+                e = 8;
+            }
         }
 
 out_pthread:
@@ -398,8 +512,8 @@ out_se:
 out_chan:
     free(mountpoint);
 out_args:
+    log_fini();
     fuse_opt_free_args(&args);
-out_fail:
     return e;
 }
 
@@ -0,0 +1,166 @@
+/*
+ * Created 190617 lynnl
+ *
+ * localtime(3)-free timestamp formatter for clock file content
+ */
+
+#ifndef CLOCK_DATETIME_H
+#define CLOCK_DATETIME_H
+
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "utils.h"
+
+/*
+ * Broken-down local date and UTC offset  valid for [from, until)
+ *  the quarter-hour the fill happened in
+ * Time of day derived from seconds elapsed since base(local midnight)
+ *
+ * DST and zone transitions only happen on quarter-hour boundaries
+ *  thus cache never spans one  localtime_r(3) called
+ *  at most once per 15 minutes instead of once per tick
+ * Earlier seconds than the fill(callers racing  clock stepped back)
+ *  refill too  base and gmtoff may be those after a transition
+ */
+struct dt_cache {
+    pthread_mutex_t lock;
+    time_t base;        /* Local midnight in epoch seconds */
+    time_t from;
+    time_t until;       /* Exclusive */
+    long gmtoff;
+    int year;           /* Years since 1900 */
+    int mon;            /* [1, 12] */
+    int mday;           /* [1, 31] */
+};
+
+#define DT_QUARTER      (15 * 60)
+#define DT_DAY          (24 * 60 * 60)
+
+/* "YY/MM/DD HH:MM:SS.mmm+HHMM\n" */
+#define DT_LEN          27
+
+static struct dt_cache dt_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Refill cache for given epoch seconds  cache lock must be held
+ * @return      0 if success  -1 otherwise
+ */
+static int dt_cache_fill(struct dt_cache *c, time_t sec)
+{
+    struct tm tm;
+    time_t from, until;
+
+    if (localtime_r(&sec, &tm) == NULL) return -1;
+
+    c->base = sec - (tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec);
+    c->gmtoff = tm.tm_gmtoff;
+    c->year = tm.tm_year;
+    c->mon = tm.tm_mon + 1;
+    c->mday = tm.tm_mday;
+
+    from = sec - sec % DT_QUARTER;
+    c->from = from > c->base ? from : c->base;
+    until = from + DT_QUARTER;
+    if (until > c->base + DT_DAY) until = c->base + DT_DAY;
+    c->until = until;
+
+    return 0;
+}
+
+static inline char *put2(char *p, unsigned v)
+{
+    p[0] = (char) ('0' + v / 10 % 10);
+    p[1] = (char) ('0' + v % 10);
+    return p + 2;
+}
+
+/**
+ * Format given wall clock time  see: fmt_datetime()
+ * @return      length of formatted string
+ */
+static size_t fmt_datetime_at(char *str, size_t n, const struct timeval *tv)
+{
+    char tmp[DT_LEN + 1];
+    time_t sec;
+    long off;
+    long gmtoff;
+    int year, mon, mday;
+    char *p;
+    size_t len;
+    int e;
+
+    assert_nonnull(str);
+    assert(n > 0);
+    assert_nonnull(tv);
+
+    sec = tv->tv_sec;
+
+    (void) pthread_mutex_lock(&dt_cache.lock);
+    e = 0;
+    if (sec < dt_cache.from || sec >= dt_cache.until) {
+        e = dt_cache_fill(&dt_cache, sec);
+        if (e != 0) dt_cache.until = 0;     /* Force refill next time */
+    }
+    off = (long) (sec - dt_cache.base);
+    gmtoff = dt_cache.gmtoff;
+    year = dt_cache.year;
+    mon = dt_cache.mon;
+    mday = dt_cache.mday;
+    (void) pthread_mutex_unlock(&dt_cache.lock);
+
+    if (e != 0) {
+        *str = '\0';
+        return 0;
+    }
+
+    p = tmp;
+    p = put2(p, (unsigned) (1900 + year) % 100);
+    *p++ = '/';
+    p = put2(p, (unsigned) mon);
+    *p++ = '/';
+    p = put2(p, (unsigned) mday);
+    *p++ = ' ';
+    p = put2(p, (unsigned) (off / 3600));
+    *p++ = ':';
+    p = put2(p, (unsigned) (off / 60 % 60));
+    *p++ = ':';
+    p = put2(p, (unsigned) (off % 60));
+    *p++ = '.';
+    *p++ = (char) ('0' + tv->tv_usec / 100000);
+    p = put2(p, (unsigned) (tv->tv_usec / 1000 % 100));
+    if (gmtoff < 0) {
+        *p++ = '-';
+        gmtoff = -gmtoff;
+    } else {
+        *p++ = '+';
+    }
+    p = put2(p, (unsigned) (gmtoff / 3600));
+    p = put2(p, (unsigned) (gmtoff / 60 % 60));
+    *p++ = '\n';
+    assert(p - tmp == DT_LEN);
+
+    len = DT_LEN;
+    if (len >= n) len = n - 1;  /* Truncated */
+    (void) memcpy(str, tmp, len);
+    str[len] = '\0';
+
+    return len;
+}
+
+/**
+ * @return      length of formatted string
+ */
+static size_t fmt_datetime(char *str, size_t n)
+{
+    struct timeval tv;
+
+    (void) gettimeofday(&tv, NULL);     /* Won't fail */
+    return fmt_datetime_at(str, n, &tv);
+}
+
+#endif /* CLOCK_DATETIME_H */
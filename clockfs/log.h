@@ -0,0 +1,260 @@
+/*
+ * Created 190618 lynnl
+ *
+ * Leveled logging backend for clockfs
+ *
+ * Two backends:
+ *  sync    syslog(3) straight from the calling thread(default)
+ *  ring    record into a per-thread ring buffer  a flusher thread
+ *          drains all rings to syslog(3) in batches  so FUSE request
+ *          paths never block on the syslogd socket
+ *
+ * Rings are single producer(owner thread) single consumer(flusher)
+ *  neither side takes a lock  a full ring drops records and counts them
+ */
+
+#ifndef CLOCK_LOG_H
+#define CLOCK_LOG_H
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define LOG_RING_SLOTS      1024    /* Must be power of 2 */
+#define LOG_MSG_MAX         240
+
+struct log_rec {
+    int prio;
+    char msg[LOG_MSG_MAX];
+};
+
+struct log_ring {
+    struct log_ring *next;      /* Immutable once linked */
+    int in_use;                 /* Owned by a live thread */
+    uint32_t head;              /* Written by producer only */
+    uint32_t tail;              /* Written by consumer only */
+    uint64_t dropped;           /* Written by producer only */
+    uint64_t reported;          /* Drops already reported  consumer only */
+    struct log_rec rec[LOG_RING_SLOTS];
+};
+
+/*
+ * Records with priority numerically greater than this are discarded
+ * LOG_DEBUG enables SYSLOG_DBG()  which only exist in DEBUG builds
+ * SIGUSR2 toggles between LOG_DEBUG and the configured level
+ */
+static volatile sig_atomic_t log_level = LOG_NOTICE;
+static int log_level_base = LOG_NOTICE;
+
+static int log_use_ring;
+static struct log_ring *log_rings;  /* Push-only list */
+static pthread_key_t log_key;
+static pthread_t log_flusher;
+static int log_stop;
+
+#define log_enabled(prio)   ((prio) <= log_level)
+
+/**
+ * macOS 10.13+ LOG_INFO, LOG_DEBUG levels rejected(log nothing)
+ *  thus levels are only used for filtering  records go out as LOG_NOTICE
+ */
+static inline int log_syslog_prio(int prio)
+{
+    return prio > LOG_NOTICE ? LOG_NOTICE : prio;
+}
+
+static void log_ring_exit(void *arg)
+{
+    struct log_ring *r = (struct log_ring *) arg;
+    /* Flusher keeps draining it  a new thread may adopt it later */
+    __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static struct log_ring *log_ring_self(void)
+{
+    struct log_ring *r;
+    int expected;
+
+    r = (struct log_ring *) pthread_getspecific(log_key);
+    if (r != NULL) return r;
+
+    /* Adopt a ring left by an exited thread */
+    for (r = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        expected = 0;
+        if (__atomic_compare_exchange_n(&r->in_use, &expected, 1, 0,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (r == NULL) {
+        r = (struct log_ring *) calloc(1, sizeof(*r));
+        if (r == NULL) return NULL;
+        r->in_use = 1;
+        r->next = __atomic_load_n(&log_rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&log_rings, &r->next, r, 1,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            continue;
+        }
+    }
+
+    (void) pthread_setspecific(log_key, r);
+    return r;
+}
+
+static void log_vwrite(int prio, const char *fmt, va_list ap)
+{
+    struct log_ring *r;
+    struct log_rec *rec;
+    uint32_t head;
+
+    if (!log_use_ring || (r = log_ring_self()) == NULL) {
+        vsyslog(log_syslog_prio(prio), fmt, ap);
+        return;
+    }
+
+    head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == LOG_RING_SLOTS) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    rec = &r->rec[head & (LOG_RING_SLOTS - 1)];
+    rec->prio = prio;
+    (void) vsnprintf(rec->msg, sizeof(rec->msg), fmt, ap);
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void log_write(int prio, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3), unused));
+
+static void log_write(int prio, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    log_vwrite(prio, fmt, ap);
+    va_end(ap);
+}
+
+/**
+ * Drain every ring  only called from the flusher thread
+ */
+static void log_drain(void)
+{
+    struct log_ring *r;
+    struct log_rec *rec;
+    uint64_t dropped;
+    uint32_t head;
+    uint32_t tail;
+
+    for (r = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        for (tail = r->tail; tail != head; tail++) {
+            rec = &r->rec[tail & (LOG_RING_SLOTS - 1)];
+            syslog(log_syslog_prio(rec->prio), "%s", rec->msg);
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+        dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        if (dropped != r->reported) {
+            syslog(LOG_WARNING, "[WARN] log ring full  %llu records dropped\n",
+                    (unsigned long long) (dropped - r->reported));
+            r->reported = dropped;
+        }
+    }
+}
+
+#define LOG_FLUSH_INTERVAL_US   50000
+
+static void *log_flush_thread(void *arg)
+{
+    (void) arg;
+
+    while (!__atomic_load_n(&log_stop, __ATOMIC_ACQUIRE)) {
+        log_drain();
+        (void) usleep(LOG_FLUSH_INTERVAL_US);
+    }
+    log_drain();
+
+    return NULL;
+}
+
+static void log_sigusr2(int sig)
+{
+    (void) sig;
+    log_level = log_level == LOG_DEBUG ? log_level_base : LOG_DEBUG;
+}
+
+/**
+ * @level       initial level  see: log_level
+ * @ring        nonzero to use ring backend  starts the flusher thread
+ * @return      0 if success  -1 otherwise(errno set)
+ */
+static inline int log_init(int level, int ring)
+{
+    struct sigaction sa;
+    int e;
+
+    log_level = log_level_base = level;
+
+    (void) memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = log_sigusr2;
+    (void) sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR2, &sa, NULL) != 0) return -1;
+
+    if (!ring) return 0;
+
+    e = pthread_key_create(&log_key, log_ring_exit);
+    if (e == 0) e = pthread_create(&log_flusher, NULL, log_flush_thread, NULL);
+    if (e != 0) {
+        errno = e;
+        return -1;
+    }
+
+    log_use_ring = 1;
+    return 0;
+}
+
+/**
+ * Flush what's left and stop the flusher thread
+ * Records logged after this call go straight to syslog(3)
+ */
+static inline void log_fini(void)
+{
+    if (!log_use_ring) return;
+
+    __atomic_store_n(&log_stop, 1, __ATOMIC_RELEASE);
+    (void) pthread_join(log_flusher, NULL);
+    log_use_ring = 0;
+}
+
+#ifdef DEBUG
+#define LOG_LEVEL_DEFAULT   LOG_DEBUG
+#else
+#define LOG_LEVEL_DEFAULT   LOG_NOTICE
+#endif
+
+/**
+ * @name        NULL for default level
+ * @return      syslog(3) priority  -1 if name unknown
+ */
+static inline int log_parse_level(const char *name)
+{
+    if (name == NULL) return LOG_LEVEL_DEFAULT;
+    if (!strcmp(name, "notice")) return LOG_NOTICE;
+    if (!strcmp(name, "err")) return LOG_ERR;
+    if (!strcmp(name, "warning")) return LOG_WARNING;
+    if (!strcmp(name, "debug")) return LOG_DEBUG;
+    return -1;
+}
+
+#endif /* CLOCK_LOG_H */
@@ -0,0 +1,104 @@
+/*
+ * Created 190614 lynnl
+ *
+ * Multi-threaded FUSE session loop with a fixed size worker pool
+ *
+ * see:
+ *  osxfuse/fuse/lib/fuse_session.c#fuse_session_loop()
+ *  osxfuse/fuse/lib/fuse_loop_mt.c
+ */
+
+#ifndef CLOCK_SESSION_H
+#define CLOCK_SESSION_H
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <fuse_lowlevel.h>
+
+#include "utils.h"
+
+/**
+ * Worker loop  essentially fuse_session_loop()
+ * All workers read requests from the same channel concurrently
+ */
+static void *session_worker(void *arg)
+{
+    struct fuse_session *se = (struct fuse_session *) arg;
+    struct fuse_chan *ch;
+    struct fuse_chan *tmpch;
+    size_t bufsize;
+    char *buf;
+    int res = 0;
+
+    assert_nonnull(se);
+
+    ch = fuse_session_next_chan(se, NULL);
+    assert_nonnull(ch);
+
+    bufsize = fuse_chan_bufsize(ch);
+    buf = malloc(bufsize);
+    if (buf == NULL) {
+        LOG_ERROR("failed to allocate read buffer");
+        fuse_session_exit(se);
+        return (void *) -1L;
+    }
+
+    while (!fuse_session_exited(se)) {
+        tmpch = ch;
+        res = fuse_chan_recv(&tmpch, buf, bufsize);
+        if (res == -EINTR) continue;
+        if (res <= 0) break;
+
+        /* Don't get cancelled in the middle of a request */
+        (void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        fuse_session_process(se, buf, (size_t) res, tmpch);
+        (void) pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    }
+
+    free(buf);
+    /* Tell clock_update() and peers  unlike fuse_session_loop() we don't reset */
+    fuse_session_exit(se);
+    return res < 0 ? (void *) -1L : NULL;
+}
+
+/**
+ * Run session with `nthreads' workers(calling thread included)
+ * Returns once the session exited
+ * @return      0 on success  -1 otherwise
+ */
+static int session_loop_pool(struct fuse_session *se, unsigned nthreads)
+{
+    pthread_t *tids;
+    unsigned n;
+    unsigned i;
+    void *ret;
+    int e;
+
+    assert_nonnull(se);
+
+    if (nthreads <= 1) return fuse_session_loop(se);
+
+    tids = calloc(nthreads - 1, sizeof(*tids));
+    if (tids == NULL) return -1;
+
+    for (n = 0; n < nthreads - 1; n++) {
+        e = pthread_create(&tids[n], NULL, &session_worker, se);
+        if (e != 0) {
+            LOG_ERROR("pthread_create(3) fail  errno: %d  running with %u workers", e, n + 1);
+            break;
+        }
+    }
+
+    ret = session_worker(se);
+
+    /* Peers may still blocked in fuse_chan_recv() */
+    for (i = 0; i < n; i++) (void) pthread_cancel(tids[i]);
+    for (i = 0; i < n; i++) (void) pthread_join(tids[i], NULL);
+
+    free(tids);
+    return ret == NULL ? 0 : -1;
+}
+
+#endif /* CLOCK_SESSION_H */
@@ -0,0 +1,91 @@
+/*
+ * Created 190614 lynnl
+ *
+ * Clock file content shared by clock_update() thread and FUSE workers
+ */
+
+#ifndef CLOCK_SNAPSHOT_H
+#define CLOCK_SNAPSHOT_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define DATA_BUFSZ  64
+
+struct clock_slot {
+    uint64_t gen;           /* Generation of content  0 while being rewritten */
+    size_t len;             /* Precomputed strlen(data) */
+    char data[DATA_BUFSZ];
+};
+
+/*
+ * Versioned double-buffered snapshot
+ *  single writer(clock_update() thread)  multiple readers(FUSE workers)
+ *
+ * Writer fills the slot not currently published  then publishes its
+ *  generation  so readers copy a slot that's (nearly) never being written
+ * A slot's own generation doubles as a sequence lock:
+ *  writer zeroes it before touching the slot  reader retries if it changed
+ *  across its copy  which only happens if a reader stalled a whole period
+ * Neither side takes a lock
+ */
+struct clock_snapshot {
+    uint64_t gen;           /* Latest published generation */
+    struct clock_slot slot[2];
+};
+
+/**
+ * Publish new content  nothing done if content unchanged
+ * @return      new generation  0 if content unchanged
+ */
+static inline uint64_t snapshot_publish(struct clock_snapshot *s, const char *str, size_t len)
+{
+    uint64_t gen = __atomic_load_n(&s->gen, __ATOMIC_RELAXED);
+    struct clock_slot *cur = &s->slot[gen & 1];
+    struct clock_slot *next = &s->slot[(gen + 1) & 1];
+
+    if (len >= DATA_BUFSZ) len = DATA_BUFSZ - 1;
+
+    /* We're the only writer  no need to guard reading our own slot */
+    if (gen != 0 && cur->len == len && !memcmp(cur->data, str, len)) return 0;
+
+    __atomic_store_n(&next->gen, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    (void) memcpy(next->data, str, len);
+    next->data[len] = '\0';
+    next->len = len;
+
+    __atomic_store_n(&next->gen, gen + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->gen, gen + 1, __ATOMIC_RELEASE);
+
+    return gen + 1;
+}
+
+/**
+ * Take a consistent copy of latest content
+ * @buf         NULL if only length is wanted
+ * @return      length of content(buf is always NUL-terminated)
+ */
+static inline size_t snapshot_read(struct clock_snapshot *s, char buf[DATA_BUFSZ])
+{
+    struct clock_slot *slot;
+    uint64_t gen;
+    size_t len;
+
+    do {
+        gen = __atomic_load_n(&s->gen, __ATOMIC_ACQUIRE);
+        slot = &s->slot[gen & 1];
+
+        len = slot->len;
+        if (len >= DATA_BUFSZ) len = DATA_BUFSZ - 1;   /* Torn length  we'll retry */
+        if (buf != NULL) (void) memcpy(buf, slot->data, len);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&slot->gen, __ATOMIC_RELAXED) != gen);
+
+    if (buf != NULL) buf[len] = '\0';
+    return len;
+}
+
+#endif /* CLOCK_SNAPSHOT_H */
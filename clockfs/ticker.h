@@ -0,0 +1,139 @@
+/*
+ * Created 190616 lynnl
+ *
+ * Drives clock_update()  ticks on wall clock boundaries of a resolution
+ *  and goes idle while nobody have the clock file opened
+ */
+
+#ifndef CLOCK_TICKER_H
+#define CLOCK_TICKER_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "utils.h"
+
+struct clock_ticker {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned resolution;    /* In milliseconds */
+    unsigned nopen;         /* Opened handles of the clock file */
+    uint64_t ticks;         /* Completed ticks */
+    int kick;               /* A first opener waits  tick without aligning */
+    int stop;
+};
+
+#define CLOCK_TICKER_INITIALIZER(res) { \
+    .lock = PTHREAD_MUTEX_INITIALIZER,  \
+    .cond = PTHREAD_COND_INITIALIZER,   \
+    .resolution = (res),                \
+}
+
+/**
+ * Called by the updater once fresh content published
+ *  before notifying the kernel  so openers never wait on an invalidation
+ */
+static void ticker_ticked(struct clock_ticker *t)
+{
+    assert_nonnull(t);
+
+    (void) pthread_mutex_lock(&t->lock);
+    t->ticks++;
+    (void) pthread_cond_broadcast(&t->cond);
+    (void) pthread_mutex_unlock(&t->lock);
+}
+
+/**
+ * Sleep until next multiple of resolution in wall clock time
+ *  or indefinitely while no handle opened
+ * Leaving idle ticks at once  the first opener is waiting on it
+ *  only later ticks are aligned to the boundary
+ * @return      0 if should tick again  -1 if ticker stopped
+ */
+static int ticker_wait(struct clock_ticker *t)
+{
+    struct timeval tv;
+    struct timespec deadline;
+    uint64_t now;
+    uint64_t next;
+    int e;
+
+    assert_nonnull(t);
+    assert(t->resolution > 0);
+
+    (void) pthread_mutex_lock(&t->lock);
+
+    while (!t->stop) {
+        if (t->kick) {
+            t->kick = 0;
+            break;
+        }
+
+        if (t->nopen == 0) {
+            (void) pthread_cond_wait(&t->cond, &t->lock);
+            continue;
+        }
+
+        (void) gettimeofday(&tv, NULL);
+        now = (uint64_t) tv.tv_sec * 1000 + (uint64_t) tv.tv_usec / 1000;
+        next = (now / t->resolution + 1) * t->resolution;
+        deadline.tv_sec = (time_t) (next / 1000);
+        deadline.tv_nsec = (long) (next % 1000) * 1000000L;
+
+        e = pthread_cond_timedwait(&t->cond, &t->lock, &deadline);
+        if (e == ETIMEDOUT) break;
+        /* Woken up by an opener  recheck */
+    }
+
+    e = t->stop ? -1 : 0;
+    (void) pthread_mutex_unlock(&t->lock);
+    return e;
+}
+
+/**
+ * A handle of the clock file opened
+ * If ticker was idle  wait for a tick so the opener never sees stale content
+ *  the updater ticks right away rather than at the next boundary
+ * see: ticker_wait()  ticker_ticked()
+ */
+static void ticker_open(struct clock_ticker *t)
+{
+    uint64_t target;
+
+    assert_nonnull(t);
+
+    (void) pthread_mutex_lock(&t->lock);
+    if (t->nopen++ == 0) {
+        target = t->ticks + 1;
+        t->kick = 1;
+        (void) pthread_cond_broadcast(&t->cond);
+        while (t->ticks < target && !t->stop) {
+            (void) pthread_cond_wait(&t->cond, &t->lock);
+        }
+    }
+    (void) pthread_mutex_unlock(&t->lock);
+}
+
+static void ticker_release(struct clock_ticker *t)
+{
+    assert_nonnull(t);
+
+    (void) pthread_mutex_lock(&t->lock);
+    assert(t->nopen > 0);
+    t->nopen--;
+    (void) pthread_mutex_unlock(&t->lock);
+}
+
+static void ticker_stop(struct clock_ticker *t)
+{
+    assert_nonnull(t);
+
+    (void) pthread_mutex_lock(&t->lock);
+    t->stop = 1;
+    (void) pthread_cond_broadcast(&t->cond);
+    (void) pthread_mutex_unlock(&t->lock);
+}
+
+#endif /* CLOCK_TICKER_H */
@@ -5,8 +5,11 @@
 #ifndef FS_UTILS_H
 #define FS_UTILS_H
 
+#include <assert.h>
 #include <syslog.h>
 
+#include "log.h"
+
 /**
  * Should only used for `char[]'  NOT `char *'
  * Assume ends with null byte('\0')
@@ -19,21 +22,43 @@
     (void) printf(FSNAME ": " fmt "\n", ##__VA_ARGS__)
 #define LOG_ERROR(fmt, ...) \
     (void) fprintf(stderr, FSNAME ": [ERR] " fmt "\n", ##__VA_ARGS__)
-#define LOG_DBG(fmt, ...)   LOG("[DBG] " fmt, ##__VA_ARGS__)
 #define LOG_WARN(fmt, ...)  LOG("[WARN] " fmt, ##__VA_ARGS__)
 
 /**
+ * Leveled syslog(3) logging  see: log.h
+ * Records filtered by runtime log_level  before arguments evaluated
  * Do NOT use LOG_EMERG level  it'll broadcast to all users
- * macOS 10.13+ LOG_INFO, LOG_DEBUG levels rejected(log nothing)
  */
+#define LOG_EMIT(prio, fmt, ...)                                \
+    do {                                                        \
+        if (log_enabled(prio))                                  \
+            log_write(prio, fmt "\n", ##__VA_ARGS__);           \
+    } while (0)
+
+/*
+ * Compiled out in release builds  if (0) keeps format and arguments
+ *  type-checked and referenced  optimizer drops the call
+ */
+#define LOG_NOP(fmt, ...)                                       \
+    do {                                                        \
+        if (0) (void) printf(fmt, ##__VA_ARGS__);               \
+    } while (0)
+
 #define SYSLOG(fmt, ...)        \
-    syslog(LOG_NOTICE, fmt "\n", ##__VA_ARGS__)
+    LOG_EMIT(LOG_NOTICE, fmt, ##__VA_ARGS__)
 #define SYSLOG_ERR(fmt, ...)    \
-    syslog(LOG_ERR, "[ERR] " fmt "\n", ##__VA_ARGS__)
-#define SYSLOG_DBG(fmt, ...)    \
-    syslog(LOG_NOTICE, "[DBG] " fmt "\n", ##__VA_ARGS__)
+    LOG_EMIT(LOG_ERR, "[ERR] " fmt, ##__VA_ARGS__)
 #define SYSLOG_WARN(fmt, ...)   \
-    syslog(LOG_WARNING, "[WARN] " fmt "\n", ##__VA_ARGS__)
+    LOG_EMIT(LOG_WARNING, "[WARN] " fmt, ##__VA_ARGS__)
+
+#ifdef DEBUG
+#define LOG_DBG(fmt, ...)       LOG("[DBG] " fmt, ##__VA_ARGS__)
+#define SYSLOG_DBG(fmt, ...)    \
+    LOG_EMIT(LOG_DEBUG, "[DBG] " fmt, ##__VA_ARGS__)
+#else
+#define LOG_DBG(fmt, ...)       LOG_NOP(fmt, ##__VA_ARGS__)
+#define SYSLOG_DBG(fmt, ...)    LOG_NOP(fmt, ##__VA_ARGS__)
+#endif
 
 #define UNUSED(arg, ...)    (void) ((void) (arg), ##__VA_ARGS__)
 
@@ -24,35 +24,3616 @@
 #include <stdio.h>
 #include <stddef.h>     /* offsetof() */
 #include <stdlib.h>
+#include <stdarg.h>     /* va_list */
+#include <stdint.h>     /* SIZE_MAX */
 #include <string.h>
 #include <unistd.h>     /* readlink(2) */
+#include <fcntl.h>      /* open(2) */
 #include <dirent.h>     /* DIR */
 #include <errno.h>
+#include <limits.h>     /* PATH_MAX */
+#include <pthread.h>
+#include <signal.h>     /* sigwait(2) */
+#include <time.h>       /* clock_gettime(3) */
 
+#include <sys/param.h>  /* MIN() */
+#include <sys/uio.h>    /* struct iovec */
 #include <sys/stat.h>   /* umask(2) */
 #include <sys/stat.h>   /* lstat(2) */
 #include <sys/xattr.h>
 #include <sys/vnode.h>  /* PREALLOCATE */
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/io_uring.h>
+#endif
+
+#define FUSE_USE_VERSION            26
+#include <fuse.h>
+
+#include "utils.h"
+
+struct loopbackfs_config {
+    int ci;         /* Case insensitive? */
+    int copy_io;    /* Force read()/write() copy path instead of read_buf()/write_buf() */
+    double attr_ttl;        /* Attribute cache TTL in seconds  zero to disable */
+    unsigned attr_size;     /* Max attribute cache entries */
+    double neg_ttl;         /* Negative lookup cache TTL in seconds */
+    unsigned neg_size;      /* Max negative lookup cache entries */
+    int readdir_plus;       /* Fetch full attributes while listing directories */
+    unsigned readdir_batch; /* Directory entries buffered per opendir() handle */
+    int op_stats;           /* Per-operation counters and latency histograms */
+    char *ctl_dir;          /* Virtual control directory name at mount root */
+    char *trace;            /* Workload trace file  NULL if not tracing */
+    unsigned readahead;     /* Max read-ahead window in bytes per handle  zero to disable */
+    unsigned write_coalesce;    /* Write-back buffer in bytes per handle  zero to disable */
+    char *io_backend;       /* sync  threads  uring  NULL for sync */
+    unsigned io_depth;      /* Ring entries or pool threads */
+    unsigned fsync_group;   /* Group commit window in microseconds  zero to disable */
+    int full_fsync;         /* fsync() by F_FULLFSYNC  i.e. drive cache flushed too */
+    double xattr_ttl;       /* Extended attribute cache TTL in seconds  zero to disable */
+    unsigned xattr_size;    /* Max bytes held by extended attribute cache */
+    int fd_share;           /* Share backing fds between handles of the same file */
+};
+
+#define IO_DEPTH_DEFAULT    32
+
+static struct loopbackfs_config loopbackfs_cfg = {
+    .attr_size = 65536,
+    .neg_size = 16384,
+    .xattr_size = 4 << 20,
+    .readdir_batch = 1024,
+    .io_depth = IO_DEPTH_DEFAULT,
+};
+
+/*
+ * Loopback fs implementation
+ *
+ * NOTE: All following functions return 0 on success  -errno on failure
+ */
+
+#define RET_TO_ERRNO(e)   ((e < 0) ? -errno : 0)
+#define RET_IF_ERROR(stmt)  if ((stmt) < 0) return -errno
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * In-process attribute cache
+ *
+ * Keyed by path  entries expire after a TTL
+ *  and are invalidated by the mutating callbacks of this fs
+ * Changes made to the backing store behind our back(or through another
+ *  hard link of the same file) become visible after TTL at most
+ *  same semantics as kernel's own attr_timeout
+ * On a case-insensitive fs names differing in case reach the same file
+ *  so keys are compared with ASCII case folded(see: lb_cache.fold)
+ *  paths with other bytes aren't cached  Unicode folding and normalization
+ *  aren't worth replicating  their invalidations flush instead
+ */
+
+#define CACHE_CHAIN_MAX     4       /* Max entries per bucket */
+
+struct cache_entry {
+    struct cache_entry *next;
+    uint64_t expire;        /* now_ns() based */
+    uint64_t gen;           /* Cache generation when inserted */
+    uint32_t hash;
+    size_t len;
+    struct stat st;
+    int has_xtimes;         /* Set once getxtimes() attached them  see: cache_put_xtimes() */
+    struct timespec bkuptime;
+    struct timespec crtime;
+    char path[];
+};
+
+struct cache_bucket {
+    pthread_mutex_t lock;
+    struct cache_entry *head;   /* Most recently inserted first */
+    uint32_t count;
+    uint32_t seq;               /* Bumped by each invalidation */
+};
+
+/**
+ * Snapshot taken at lookup miss
+ * A result fetched after a miss is only inserted if no invalidation
+ *  happened in between  otherwise we may cache a pre-mutation result
+ */
+struct cache_ticket {
+    uint32_t hash;
+    uint32_t seq;
+    uint64_t gen;
+};
+
+struct lb_cache {
+    uint64_t ttl;               /* In nanoseconds  zero if disabled */
+    int fold;                   /* Keys case-insensitive  set once at setup */
+    uint32_t mask;              /* Bucket count - 1 */
+    struct cache_bucket *buckets;
+    uint64_t gen;               /* Bumped by cache_flush() */
+
+    /* Statistics */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invals;
+    uint64_t flushes;
+};
+
+static struct lb_cache attr_cache;
+
+/*
+ * Negative lookup cache
+ *
+ * Remembers paths lstat(2) reported ENOENT for  entries carry no stat data
+ * A miss can only turn into a hit by creating that name in its parent
+ *  directory(see: entry_changed())  or by making a directory or symlink
+ *  appear in the middle of it(see: lb_rename(), lb_symlink())
+ * Keys fold case like attr cache's  creating "/Foo" must drop "/foo"
+ */
+static struct lb_cache neg_cache;
+
+#define STAT_INC(v)     ((void) __atomic_add_fetch(&(v), 1, __ATOMIC_RELAXED))
+#define STAT_GET(v)     __atomic_load_n(&(v), __ATOMIC_RELAXED)
+
+static int cache_alloc(struct lb_cache *c, unsigned size)
+{
+    struct cache_bucket *buckets;
+    uint32_t n = 1;
+    uint32_t i;
+
+    assert_nonnull(c);
+    assert(size != 0);
+
+    while (n * CACHE_CHAIN_MAX < size && n < (1U << 24)) n <<= 1;
+
+    buckets = calloc(n, sizeof(*buckets));
+    if (buckets == NULL) return -ENOMEM;
+
+    for (i = 0; i < n; i++) {
+        (void) pthread_mutex_init(&buckets[i].lock, NULL);
+    }
+
+    c->mask = n - 1;
+    c->buckets = buckets;
+    return 0;
+}
+
+static int cache_init(struct lb_cache *c, double ttl, unsigned size)
+{
+    assert_nonnull(c);
+
+    (void) memset(c, 0, sizeof(*c));
+    if (ttl <= 0 || size == 0) return 0;
+
+    if (cache_alloc(c, size) != 0) return -ENOMEM;
+    c->ttl = (uint64_t) (ttl * 1e9);
+    return 0;
+}
+
+/**
+ * @return      1 if the backing store folds case  e.g. default APFS  HFS+
+ *  even if not mounted with `case-insensitive'  both names reach one file
+ */
+static int backing_ci(void)
+{
+#ifdef _PC_CASE_SENSITIVE
+    return pathconf("/", _PC_CASE_SENSITIVE) == 0;
+#else
+    return 0;
+#endif
+}
+
+static inline int cache_enabled(const struct lb_cache *c)
+{
+    /* Pairs with cache_set_ttl()  buckets visible once ttl is */
+    return __atomic_load_n(&c->ttl, __ATOMIC_ACQUIRE) != 0;
+}
+
+/**
+ * Change TTL at runtime  zero disables the cache
+ * Buckets allocated on first enable and never freed  lookups may still use them
+ * Caller should serialize calls  see: ctl_lock
+ */
+static int cache_set_ttl(struct lb_cache *c, double ttl, unsigned size)
+{
+    assert_nonnull(c);
+
+    if (ttl > 0 && size == 0) return -EINVAL;
+    if (ttl > 0 && c->buckets == NULL && cache_alloc(c, size) != 0) return -ENOMEM;
+
+    /*
+     * Invalidations are skipped while disabled  so drop everything
+     *  before lookups can see the cache enabled again
+     */
+    (void) __atomic_add_fetch(&c->gen, 1, __ATOMIC_RELEASE);
+    STAT_INC(c->flushes);
+    __atomic_store_n(&c->ttl, (uint64_t) (ttl * 1e9), __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* FNV-1a */
+static inline uint32_t path_hash(const char *path, size_t len)
+{
+    uint32_t h = 2166136261U;
+    while (len--) {
+        h ^= (unsigned char) *path++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static inline unsigned char fold_char(unsigned char ch)
+{
+    return ch >= 'A' && ch <= 'Z' ? (unsigned char) (ch - 'A' + 'a') : ch;
+}
+
+/*
+ * Path keys  shared by attr  negative and xattr caches
+ * @fold        see: lb_cache.fold
+ */
+
+/**
+ * @return      1 if `path' can be a key  0 if it must bypass
+ */
+static inline int key_keyable(int fold, const char *path, size_t len)
+{
+    if (!fold) return 1;
+    while (len--) {
+        if ((unsigned char) *path++ & 0x80) return 0;
+    }
+    return 1;
+}
+
+static inline uint32_t key_hash(int fold, const char *path, size_t len)
+{
+    uint32_t h = 2166136261U;
+
+    if (!fold) return path_hash(path, len);
+    while (len--) {
+        h ^= fold_char((unsigned char) *path++);
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/**
+ * @return      1 if `len' bytes at `a' and `b' are the same key
+ */
+static inline int key_match(int fold, const char *a, const char *b, size_t len)
+{
+    size_t i;
+
+    if (!fold) return !memcmp(a, b, len);
+    for (i = 0; i < len; i++) {
+        if (fold_char((unsigned char) a[i]) != fold_char((unsigned char) b[i])) return 0;
+    }
+    return 1;
+}
+
+static inline int cache_keyable(const struct lb_cache *c, const char *path, size_t len)
+{
+    return key_keyable(c->fold, path, len);
+}
+
+static inline uint32_t cache_hash(const struct lb_cache *c, const char *path, size_t len)
+{
+    return key_hash(c->fold, path, len);
+}
+
+static inline int entry_match(
+        const struct lb_cache *c,
+        const struct cache_entry *ent,
+        uint32_t h,
+        const char *path,
+        size_t len)
+{
+    return ent->hash == h && ent->len == len && key_match(c->fold, ent->path, path, len);
+}
+
+/**
+ * @st          NULL if caller only interested in presence
+ * @return      1 if hit(st filled)  0 otherwise(ticket filled)
+ */
+static int cache_lookup(
+        struct lb_cache *c,
+        const char *path,
+        struct stat *st,
+        struct cache_ticket *t)
+{
+    struct cache_bucket *b;
+    struct cache_entry *ent;
+    size_t len;
+    uint64_t gen;
+    int hit = 0;
+
+    assert_nonnull(path);
+    assert_nonnull(t);
+
+    len = strlen(path);
+    if (!cache_enabled(c) || !cache_keyable(c, path, len)) {
+        /* Void ticket in case cache enabled before cache_put()  see: cache_set_ttl() */
+        t->hash = 0;
+        t->seq = 0;
+        t->gen = UINT64_MAX;
+        return 0;
+    }
+
+    t->hash = cache_hash(c, path, len);
+    gen = __atomic_load_n(&c->gen, __ATOMIC_ACQUIRE);
+    b = &c->buckets[t->hash & c->mask];
+
+    (void) pthread_mutex_lock(&b->lock);
+    for (ent = b->head; ent != NULL; ent = ent->next) {
+        if (entry_match(c, ent, t->hash, path, len)) {
+            if (ent->gen == gen && ent->expire > now_ns()) {
+                if (st != NULL) *st = ent->st;
+                hit = 1;
+            }
+            break;
+        }
+    }
+    t->seq = b->seq;
+    t->gen = gen;
+    (void) pthread_mutex_unlock(&b->lock);
+
+    if (hit) {
+        STAT_INC(c->hits);
+    } else {
+        STAT_INC(c->misses);
+    }
+
+    return hit;
+}
+
+/**
+ * @st          NULL for a presence-only entry
+ */
+static void cache_put(
+        struct lb_cache *c,
+        const char *path,
+        const struct stat *st,
+        const struct cache_ticket *t)
+{
+    struct cache_bucket *b;
+    struct cache_entry *ent;
+    struct cache_entry *n;
+    struct cache_entry **pp;
+    size_t len;
+
+    assert_nonnull(path);
+    assert_nonnull(t);
+
+    if (!cache_enabled(c)) return;
+
+    len = strlen(path);
+    n = malloc(sizeof(*n) + len + 1);
+    if (n == NULL) return;      /* Caching is best-effort */
+
+    n->hash = t->hash;
+    n->len = len;
+    n->gen = t->gen;
+    n->has_xtimes = 0;
+    if (st != NULL) {
+        n->st = *st;
+    } else {
+        (void) memset(&n->st, 0, sizeof(n->st));
+    }
+    (void) memcpy(n->path, path, len + 1);
+
+    b = &c->buckets[t->hash & c->mask];
+
+    (void) pthread_mutex_lock(&b->lock);
+    if (b->seq != t->seq || __atomic_load_n(&c->gen, __ATOMIC_ACQUIRE) != t->gen) {
+        /* Invalidated since our lookup  result may be stale */
+        (void) pthread_mutex_unlock(&b->lock);
+        free(n);
+        return;
+    }
+
+    /* Drop old entry of the same path  and the oldest one if chain is full */
+    for (pp = &b->head; (ent = *pp) != NULL; ) {
+        if (entry_match(c, ent, n->hash, path, len) || (ent->next == NULL && b->count >= CACHE_CHAIN_MAX)) {
+            *pp = ent->next;
+            b->count--;
+            free(ent);
+            continue;
+        }
+        pp = &ent->next;
+    }
+
+    n->expire = now_ns() + STAT_GET(c->ttl);
+    n->next = b->head;
+    b->head = n;
+    b->count++;
+    (void) pthread_mutex_unlock(&b->lock);
+}
+
+/**
+ * Look up backup and creation times attached to a cached entry
+ * @return      1 if hit  0 otherwise(ticket filled for cache_put_xtimes())
+ */
+static int cache_get_xtimes(
+        struct lb_cache *c,
+        const char *path,
+        struct timespec *bkuptime,
+        struct timespec *crtime,
+        struct cache_ticket *t)
+{
+    struct cache_bucket *b;
+    struct cache_entry *ent;
+    size_t len;
+    uint64_t gen;
+    int hit = 0;
+
+    assert_nonnull(path);
+    assert_nonnull(bkuptime);
+    assert_nonnull(crtime);
+    assert_nonnull(t);
+
+    len = strlen(path);
+    if (!cache_enabled(c) || !cache_keyable(c, path, len)) {
+        t->hash = 0;
+        t->seq = 0;
+        t->gen = UINT64_MAX;
+        return 0;
+    }
+
+    t->hash = cache_hash(c, path, len);
+    gen = __atomic_load_n(&c->gen, __ATOMIC_ACQUIRE);
+    b = &c->buckets[t->hash & c->mask];
+
+    (void) pthread_mutex_lock(&b->lock);
+    for (ent = b->head; ent != NULL; ent = ent->next) {
+        if (entry_match(c, ent, t->hash, path, len)) {
+            if (ent->gen == gen && ent->expire > now_ns() && ent->has_xtimes) {
+                *bkuptime = ent->bkuptime;
+                *crtime = ent->crtime;
+                hit = 1;
+            }
+            break;
+        }
+    }
+    t->seq = b->seq;
+    t->gen = gen;
+    (void) pthread_mutex_unlock(&b->lock);
+
+    /* Not counted in cache stats  it's a getattrlist(2) saved  see: xtimes_stats */
+    return hit;
+}
+
+/**
+ * Attach backup and creation times to the cached entry of `path'
+ * No-op if there's none  they ride on attributes getattr() fetched
+ *  the entry keeps its own expiry
+ */
+static void cache_put_xtimes(
+        struct lb_cache *c,
+        const char *path,
+        const struct timespec *bkuptime,
+        const struct timespec *crtime,
+        const struct cache_ticket *t)
+{
+    struct cache_bucket *b;
+    struct cache_entry *ent;
+    size_t len;
+
+    assert_nonnull(path);
+    assert_nonnull(bkuptime);
+    assert_nonnull(crtime);
+    assert_nonnull(t);
+
+    if (!cache_enabled(c)) return;
+
+    len = strlen(path);
+    b = &c->buckets[t->hash & c->mask];
+
+    (void) pthread_mutex_lock(&b->lock);
+    if (b->seq == t->seq && __atomic_load_n(&c->gen, __ATOMIC_ACQUIRE) == t->gen) {
+        for (ent = b->head; ent != NULL; ent = ent->next) {
+            if (entry_match(c, ent, t->hash, path, len)) {
+                if (ent->gen == t->gen) {
+                    ent->bkuptime = *bkuptime;
+                    ent->crtime = *crtime;
+                    ent->has_xtimes = 1;
+                }
+                break;
+            }
+        }
+    }
+    (void) pthread_mutex_unlock(&b->lock);
+}
+
+/**
+ * Invalidate all entries at once  stale ones are freed lazily
+ * Used when a mutation affects paths we can't enumerate
+ *  e.g. renaming a directory changes all paths below it
+ */
+static void cache_flush(struct lb_cache *c)
+{
+    if (!cache_enabled(c)) return;
+    (void) __atomic_add_fetch(&c->gen, 1, __ATOMIC_RELEASE);
+    STAT_INC(c->flushes);
+}
+
+static void cache_invalidate_n(struct lb_cache *c, const char *path, size_t len)
+{
+    struct cache_bucket *b;
+    struct cache_entry *ent;
+    struct cache_entry **pp;
+    uint32_t h;
+
+    assert_nonnull(path);
+
+    if (!cache_enabled(c)) return;
+
+    if (!cache_keyable(c, path, len)) {
+        /* May alias cached names we can't tell */
+        cache_flush(c);
+        return;
+    }
+
+    h = cache_hash(c, path, len);
+    b = &c->buckets[h & c->mask];
+
+    (void) pthread_mutex_lock(&b->lock);
+    b->seq++;
+    for (pp = &b->head; (ent = *pp) != NULL; pp = &ent->next) {
+        if (entry_match(c, ent, h, path, len)) {
+            *pp = ent->next;
+            b->count--;
+            free(ent);
+            break;
+        }
+    }
+    (void) pthread_mutex_unlock(&b->lock);
+
+    STAT_INC(c->invals);
+}
+
+static inline void cache_invalidate(struct lb_cache *c, const char *path)
+{
+    if (cache_enabled(c)) cache_invalidate_n(c, path, strlen(path));
+}
+
+/**
+ * Invalidate parent directory of `path'
+ * Its mtime  and possibly st_nlink  changes when entries added/removed
+ */
+static void cache_invalidate_parent(struct lb_cache *c, const char *path)
+{
+    const char *p;
+
+    assert_nonnull(path);
+
+    if (!cache_enabled(c)) return;
+
+    p = strrchr(path, '/');
+    if (p == NULL) return;
+    /* Parent of "/foo" is "/" */
+    cache_invalidate_n(c, path, p == path ? 1 : (size_t) (p - path));
+}
+
+/*
+ * Extended attribute cache
+ *
+ * getxattr(2) results keyed by path and name  ENOATTR included
+ *  plus the filtered listxattr(2) name list of a path under the empty name
+ * All names of a path hash to the path's bucket  so a mutation drops
+ *  them in one pass(see: xattr_changed())
+ * Paths fold case like attr cache's  names never do
+ * Same staleness semantics as attr cache above
+ * Bounded by bytes rather than entries since values vary in size
+ *  larger ones than XATTR_VALUE_MAX  and position-based reads
+ *  (resource fork) always go to the backing store
+ */
+
+#define XATTR_VALUE_MAX         4096    /* Max value or name list cached */
+#define XATTR_CHAIN_MAX         16      /* Max entries per bucket */
+#define XATTR_BUCKET_BYTES      1024    /* Budget per bucket when sizing the table */
+
+struct xattr_entry {
+    struct xattr_entry *next;
+    uint64_t expire;        /* now_ns() based */
+    uint64_t gen;           /* Cache generation when inserted */
+    uint32_t hash;          /* Of path only */
+    int err;                /* -ENOATTR if negative */
+    size_t plen;
+    size_t nlen;
+    size_t vlen;
+    char key[];             /* Path  NUL  name  NUL  value */
+};
+
+struct xattr_bucket {
+    pthread_mutex_t lock;
+    struct xattr_entry *head;   /* Most recently inserted first */
+    uint32_t count;
+    uint32_t seq;               /* Bumped by each invalidation */
+};
+
+static struct {
+    uint64_t ttl;               /* In nanoseconds  zero if disabled */
+    uint64_t limit;             /* Max bytes charged */
+    int fold;                   /* see: lb_cache.fold */
+    uint32_t mask;              /* Bucket count - 1 */
+    struct xattr_bucket *buckets;
+    uint64_t gen;               /* Bumped by xattr_cache_flush() */
+
+    uint64_t bytes;             /* Charged by live entries and expired ones not yet reclaimed */
+    uint64_t entries;
+
+    /* Statistics */
+    uint64_t hits;
+    uint64_t neg_hits;          /* Hits of ENOATTR entries  also counted in hits */
+    uint64_t misses;
+    uint64_t bypassed;          /* Position-based  resource fork or too large */
+    uint64_t dropped;           /* Not inserted  over budget */
+    uint64_t invals;
+    uint64_t flushes;
+} xattr_cache;
+
+static inline size_t xattr_charge(const struct xattr_entry *ent)
+{
+    return sizeof(*ent) + ent->plen + ent->nlen + ent->vlen + 2;
+}
+
+static inline void xattr_entry_free(struct xattr_entry *ent)
+{
+    (void) __atomic_sub_fetch(&xattr_cache.bytes, xattr_charge(ent), __ATOMIC_RELAXED);
+    (void) __atomic_sub_fetch(&xattr_cache.entries, 1, __ATOMIC_RELAXED);
+    free(ent);
+}
+
+static int xattr_cache_alloc(unsigned limit)
+{
+    struct xattr_bucket *buckets;
+    uint32_t n = 1;
+    uint32_t i;
+
+    assert(limit != 0);
+
+    while ((uint64_t) n * XATTR_BUCKET_BYTES < limit && n < (1U << 20)) n <<= 1;
+
+    buckets = calloc(n, sizeof(*buckets));
+    if (buckets == NULL) return -ENOMEM;
+
+    for (i = 0; i < n; i++) {
+        (void) pthread_mutex_init(&buckets[i].lock, NULL);
+    }
+
+    xattr_cache.mask = n - 1;
+    xattr_cache.buckets = buckets;
+    return 0;
+}
+
+static int xattr_cache_init(double ttl, unsigned limit)
+{
+    (void) memset(&xattr_cache, 0, sizeof(xattr_cache));
+    xattr_cache.limit = limit;
+    if (ttl <= 0 || limit == 0) return 0;
+
+    if (xattr_cache_alloc(limit) != 0) return -ENOMEM;
+    xattr_cache.ttl = (uint64_t) (ttl * 1e9);
+    return 0;
+}
+
+static inline int xattr_cache_enabled(void)
+{
+    /* Pairs with xattr_cache_set_ttl()  buckets visible once ttl is */
+    return __atomic_load_n(&xattr_cache.ttl, __ATOMIC_ACQUIRE) != 0;
+}
+
+/**
+ * Drop every entry  unlike cache_flush() memory is reclaimed right away
+ *  so a flush-heavy workload can't fill the budget with dead entries
+ */
+static void xattr_cache_flush(void)
+{
+    struct xattr_bucket *b;
+    struct xattr_entry *ent;
+    uint32_t i;
+
+    if (xattr_cache.buckets == NULL) return;
+
+    /* Results fetched before this point won't be inserted */
+    (void) __atomic_add_fetch(&xattr_cache.gen, 1, __ATOMIC_RELEASE);
+    STAT_INC(xattr_cache.flushes);
+
+    for (i = 0; i <= xattr_cache.mask; i++) {
+        b = &xattr_cache.buckets[i];
+        (void) pthread_mutex_lock(&b->lock);
+        while ((ent = b->head) != NULL) {
+            b->head = ent->next;
+            xattr_entry_free(ent);
+        }
+        b->count = 0;
+        (void) pthread_mutex_unlock(&b->lock);
+    }
+}
+
+/**
+ * Change TTL at runtime  zero disables the cache
+ * see: cache_set_ttl()
+ */
+static int xattr_cache_set_ttl(double ttl)
+{
+    if (ttl > 0 && xattr_cache.limit == 0) return -EINVAL;
+    if (ttl > 0 && xattr_cache.buckets == NULL && xattr_cache_alloc(xattr_cache.limit) != 0) return -ENOMEM;
+
+    /* Invalidations are skipped while disabled */
+    xattr_cache_flush();
+    __atomic_store_n(&xattr_cache.ttl, (uint64_t) (ttl * 1e9), __ATOMIC_RELEASE);
+    return 0;
+}
+
+static inline int xattr_entry_match(
+        const struct xattr_entry *ent,
+        uint32_t h,
+        const char *path,
+        size_t plen,
+        const char *name,
+        size_t nlen)
+{
+    return ent->hash == h && ent->plen == plen && ent->nlen == nlen &&
+            key_match(xattr_cache.fold, ent->key, path, plen) &&
+            !memcmp(ent->key + plen + 1, name, nlen);
+}
+
+/**
+ * Look up a value or name list  and answer the call from it on hit
+ *  the way getxattr(2)/listxattr(2) would(size probe  ERANGE)
+ * @name        "" for the name list of `path'
+ * @res         call result if hit
+ * @return      1 if hit  0 otherwise(ticket filled)
+ */
+static int xattr_cache_lookup(
+        const char *path,
+        const char *name,
+        char *value,
+        size_t size,
+        struct cache_ticket *t,
+        int *res)
+{
+    struct xattr_bucket *b;
+    struct xattr_entry *ent;
+    size_t plen, nlen;
+    uint64_t gen;
+    int hit = 0;
+
+    assert_nonnull(path);
+    assert_nonnull(name);
+    assert_nonnull(t);
+    assert_nonnull(res);
+
+    plen = strlen(path);
+    if (!xattr_cache_enabled() || !key_keyable(xattr_cache.fold, path, plen)) {
+        /* Void ticket  see: cache_lookup() */
+        t->hash = 0;
+        t->seq = 0;
+        t->gen = UINT64_MAX;
+        return 0;
+    }
+
+    nlen = strlen(name);
+    t->hash = key_hash(xattr_cache.fold, path, plen);
+    gen = __atomic_load_n(&xattr_cache.gen, __ATOMIC_ACQUIRE);
+    b = &xattr_cache.buckets[t->hash & xattr_cache.mask];
+
+    (void) pthread_mutex_lock(&b->lock);
+    for (ent = b->head; ent != NULL; ent = ent->next) {
+        if (xattr_entry_match(ent, t->hash, path, plen, name, nlen)) {
+            if (ent->gen == gen && ent->expire > now_ns()) {
+                if (ent->err != 0) {
+                    *res = ent->err;
+                    STAT_INC(xattr_cache.neg_hits);
+                } else if (size == 0) {
+                    *res = (int) ent->vlen;
+                } else if (size < ent->vlen) {
+                    *res = -ERANGE;
+                } else {
+                    (void) memcpy(value, ent->key + plen + nlen + 2, ent->vlen);
+                    *res = (int) ent->vlen;
+                }
+                hit = 1;
+            }
+            break;
+        }
+    }
+    t->seq = b->seq;
+    t->gen = gen;
+    (void) pthread_mutex_unlock(&b->lock);
+
+    if (hit) {
+        STAT_INC(xattr_cache.hits);
+    } else {
+        STAT_INC(xattr_cache.misses);
+    }
+
+    return hit;
+}
+
+/**
+ * @err         0  or -ENOATTR for a negative entry(value ignored)
+ */
+static void xattr_cache_put(
+        const char *path,
+        const char *name,
+        const char *value,
+        size_t vlen,
+        int err,
+        const struct cache_ticket *t)
+{
+    struct xattr_bucket *b;
+    struct xattr_entry *ent;
+    struct xattr_entry *n;
+    struct xattr_entry **pp;
+    struct xattr_entry **tail;
+    uint64_t now;
+    size_t charge;
+
+    assert_nonnull(path);
+    assert_nonnull(name);
+    assert_nonnull(t);
+
+    if (!xattr_cache_enabled()) return;
+    if (err != 0) vlen = 0;
+    assert(vlen <= XATTR_VALUE_MAX);
+
+    n = malloc(sizeof(*n) + strlen(path) + strlen(name) + vlen + 2);
+    if (n == NULL) return;      /* Caching is best-effort */
+
+    n->hash = t->hash;
+    n->gen = t->gen;
+    n->err = err;
+    n->plen = strlen(path);
+    n->nlen = strlen(name);
+    n->vlen = vlen;
+    (void) memcpy(n->key, path, n->plen + 1);
+    (void) memcpy(n->key + n->plen + 1, name, n->nlen + 1);
+    if (vlen != 0) (void) memcpy(n->key + n->plen + n->nlen + 2, value, vlen);
+    charge = xattr_charge(n);
+
+    b = &xattr_cache.buckets[t->hash & xattr_cache.mask];
+    now = now_ns();
+
+    (void) pthread_mutex_lock(&b->lock);
+    if (b->seq != t->seq || __atomic_load_n(&xattr_cache.gen, __ATOMIC_ACQUIRE) != t->gen) {
+        /* Invalidated since our lookup  result may be stale */
+        (void) pthread_mutex_unlock(&b->lock);
+        free(n);
+        return;
+    }
+
+    /* Drop old entry of the same key and expired ones  and the oldest one if chain is full */
+    tail = NULL;
+    for (pp = &b->head; (ent = *pp) != NULL; ) {
+        if (xattr_entry_match(ent, n->hash, path, n->plen, name, n->nlen) ||
+                ent->expire <= now || (ent->next == NULL && b->count >= XATTR_CHAIN_MAX)) {
+            *pp = ent->next;
+            b->count--;
+            xattr_entry_free(ent);
+            continue;
+        }
+        tail = pp;
+        pp = &ent->next;
+    }
+
+    /* Over budget  evict from this bucket oldest first  give up if that's not enough */
+    while (STAT_GET(xattr_cache.bytes) + charge > xattr_cache.limit && tail != NULL) {
+        ent = *tail;
+        *tail = NULL;
+        b->count--;
+        xattr_entry_free(ent);
+        for (tail = NULL, pp = &b->head; *pp != NULL; pp = &(*pp)->next) tail = pp;
+    }
+    if (STAT_GET(xattr_cache.bytes) + charge > xattr_cache.limit) {
+        (void) pthread_mutex_unlock(&b->lock);
+        free(n);
+        STAT_INC(xattr_cache.dropped);
+        return;
+    }
+
+    (void) __atomic_add_fetch(&xattr_cache.bytes, charge, __ATOMIC_RELAXED);
+    (void) __atomic_add_fetch(&xattr_cache.entries, 1, __ATOMIC_RELAXED);
+    n->expire = now + STAT_GET(xattr_cache.ttl);
+    n->next = b->head;
+    b->head = n;
+    b->count++;
+    (void) pthread_mutex_unlock(&b->lock);
+}
+
+/**
+ * Drop all names of `path'  including its name list
+ */
+static void xattr_changed(const char *path)
+{
+    struct xattr_bucket *b;
+    struct xattr_entry *ent;
+    struct xattr_entry **pp;
+    size_t plen;
+    uint32_t h;
+
+    assert_nonnull(path);
+
+    if (!xattr_cache_enabled()) return;
+
+    plen = strlen(path);
+    if (!key_keyable(xattr_cache.fold, path, plen)) {
+        /* May alias cached names we can't tell */
+        xattr_cache_flush();
+        return;
+    }
+
+    h = key_hash(xattr_cache.fold, path, plen);
+    b = &xattr_cache.buckets[h & xattr_cache.mask];
+
+    (void) pthread_mutex_lock(&b->lock);
+    b->seq++;
+    for (pp = &b->head; (ent = *pp) != NULL; ) {
+        if (ent->hash == h && ent->plen == plen && key_match(xattr_cache.fold, ent->key, path, plen)) {
+            *pp = ent->next;
+            b->count--;
+            xattr_entry_free(ent);
+            continue;
+        }
+        pp = &ent->next;
+    }
+    (void) pthread_mutex_unlock(&b->lock);
+
+    STAT_INC(xattr_cache.invals);
+}
+
+/*
+ * Shorthands for mutating callbacks
+ */
+static inline void attr_changed(const char *path)
+{
+    cache_invalidate(&attr_cache, path);
+}
+
+/**
+ * A name added to or removed from its parent directory
+ */
+static inline void entry_changed(const char *path)
+{
+    cache_invalidate(&attr_cache, path);
+    cache_invalidate_parent(&attr_cache, path);
+    cache_invalidate(&neg_cache, path);
+    /* A new file at this path starts with none  an unlinked one took its own */
+    xattr_changed(path);
+}
+
+/*
+ * Growable text buffer  stats are rendered into it
+ */
+struct sbuf {
+    char *p;
+    size_t len;
+    size_t cap;
+    int err;        /* Out of memory  content truncated */
+};
+
+static void sbuf_printf(struct sbuf *b, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void sbuf_printf(struct sbuf *b, const char *fmt, ...)
+{
+    va_list ap;
+    size_t cap;
+    char *p;
+    int n;
+
+    assert_nonnull(b);
+    assert_nonnull(fmt);
+
+    while (!b->err) {
+        va_start(ap, fmt);
+        n = vsnprintf(b->cap ? b->p + b->len : NULL, b->cap - b->len, fmt, ap);
+        va_end(ap);
+
+        if (n < 0) {
+            b->err = 1;
+        } else if (b->len + n < b->cap) {
+            b->len += n;
+            break;
+        } else {
+            cap = b->cap ? b->cap : 4096;
+            while (cap <= b->len + n) cap <<= 1;
+            p = realloc(b->p, cap);
+            if (p == NULL) {
+                b->err = 1;
+            } else {
+                b->p = p;
+                b->cap = cap;
+            }
+        }
+    }
+}
+
+static inline void sbuf_free(struct sbuf *b)
+{
+    assert_nonnull(b);
+    free(b->p);
+    (void) memset(b, 0, sizeof(*b));
+}
+
+/*
+ * Per-operation instrumentation  see: `op-stats' option
+ *
+ * Every callback in loopback_op gets a stat_* wrapper recording
+ *  call count  errors by errno  bytes transferred and a log2 latency histogram
+ * Counters live in per-thread blocks written without atomics or locks
+ *  and are merged only when somebody reads them
+ */
+
+#define LB_OPS(X)                                           \
+    X(getattr) X(readlink) X(mknod) X(mkdir) X(unlink)      \
+    X(rmdir) X(symlink) X(rename) X(link) X(chmod)          \
+    X(chown) X(truncate) X(open) X(read) X(write)           \
+    X(statfs) X(flush) X(release) X(fsync)                  \
+    X(setxattr) X(getxattr) X(listxattr) X(removexattr)     \
+    X(opendir) X(readdir) X(releasedir) X(fsyncdir)         \
+    X(access) X(create) X(ftruncate) X(fgetattr) X(lock)    \
+    X(utimens) X(read_buf) X(write_buf) X(flock)            \
+    X(fallocate) X(statfs_x) X(setvolname) X(exchange)      \
+    X(setbkuptime) X(setchgtime) X(setcrtime) X(getxtimes)  \
+    X(chflags) X(setattr_x) X(fsetattr_x)
+
+enum lb_op {
+#define X(op)   OP_##op,
+    LB_OPS(X)
+#undef X
+    OP_MAX
+};
+
+static const char * const op_names[OP_MAX] = {
+#define X(op)   #op,
+    LB_OPS(X)
+#undef X
+};
+
+#define OPSTAT_BUCKETS      32      /* Bucket i counts latency in [2^(i-1), 2^i) ns */
+#define OPSTAT_ERRNO_MAX    128     /* Larger errno counted in the last slot */
+
+/* Made of uint64_t only  see: opstat_merge() */
+struct op_counter {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t bytes;
+    uint64_t ns;                    /* Total latency */
+    uint64_t lat[OPSTAT_BUCKETS];
+    uint64_t err[OPSTAT_ERRNO_MAX];
+};
+
+struct opstat_thread {
+    struct opstat_thread *next;
+    struct opstat_thread **pprev;
+    struct op_counter op[OP_MAX];
+};
+
+static int opstat_enabled;
+static pthread_key_t opstat_key;
+static pthread_mutex_t opstat_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct opstat_thread *opstat_live;   /* Protected by opstat_lock */
+static struct op_counter opstat_dead[OP_MAX];   /* Merged from exited threads */
+
+/* Only the owner thread writes  relaxed store keeps concurrent readers untorn */
+#define PCPU_ADD(v, n)  __atomic_store_n(&(v), (v) + (n), __ATOMIC_RELAXED)
+
+static void opstat_merge(struct op_counter *dst, const struct op_counter *src)
+{
+    uint64_t *d = (uint64_t *) dst;
+    const uint64_t *s = (const uint64_t *) src;
+    size_t i;
+
+    for (i = 0; i < sizeof(*src) / sizeof(*s); i++) {
+        d[i] += __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * pthread_key_create(3) destructor  libfuse retires idle worker threads
+ *  their counters must outlive them
+ */
+static void opstat_thread_exit(void *arg)
+{
+    struct opstat_thread *t = (struct opstat_thread *) arg;
+    int i;
+
+    assert_nonnull(t);
+
+    (void) pthread_mutex_lock(&opstat_lock);
+    *t->pprev = t->next;
+    if (t->next != NULL) t->next->pprev = t->pprev;
+    for (i = 0; i < OP_MAX; i++) opstat_merge(&opstat_dead[i], &t->op[i]);
+    (void) pthread_mutex_unlock(&opstat_lock);
+
+    free(t);
+}
+
+static int opstat_init(void)
+{
+    if (pthread_key_create(&opstat_key, opstat_thread_exit) != 0) return -1;
+    opstat_enabled = 1;
+    return 0;
+}
+
+static struct opstat_thread *opstat_self(void)
+{
+    struct opstat_thread *t;
+
+    t = (struct opstat_thread *) pthread_getspecific(opstat_key);
+    if (t != NULL) return t;
+
+    t = calloc(1, sizeof(*t));
+    if (t == NULL) return NULL;
+
+    if (pthread_setspecific(opstat_key, t) != 0) {
+        free(t);
+        return NULL;
+    }
+
+    (void) pthread_mutex_lock(&opstat_lock);
+    t->next = opstat_live;
+    if (t->next != NULL) t->next->pprev = &t->next;
+    t->pprev = &opstat_live;
+    opstat_live = t;
+    (void) pthread_mutex_unlock(&opstat_lock);
+
+    return t;
+}
+
+static inline unsigned lat_bucket(uint64_t ns)
+{
+    unsigned b = ns ? 64 - __builtin_clzll(ns) : 0;
+    return b < OPSTAT_BUCKETS ? b : OPSTAT_BUCKETS - 1;
+}
+
+/**
+ * @e       return value of the wrapped callback
+ * @bytes   bytes transferred  only counted on success
+ * @t0      now_ns() before the callback
+ */
+static void opstat_record(enum lb_op op, int e, uint64_t bytes, uint64_t t0)
+{
+    struct opstat_thread *t;
+    struct op_counter *c;
+    unsigned err;
+    uint64_t ns;
+
+    /* Wrappers are also installed for tracing alone */
+    if (!opstat_enabled) return;
+
+    ns = now_ns() - t0;
+    t = opstat_self();
+    if (t == NULL) return;
+
+    c = &t->op[op];
+    PCPU_ADD(c->calls, 1);
+    PCPU_ADD(c->ns, ns);
+    PCPU_ADD(c->lat[lat_bucket(ns)], 1);
+
+    if (e < 0) {
+        err = (unsigned) -e;
+        if (err >= OPSTAT_ERRNO_MAX) err = OPSTAT_ERRNO_MAX - 1;
+        PCPU_ADD(c->errors, 1);
+        PCPU_ADD(c->err[err], 1);
+    } else {
+        PCPU_ADD(c->bytes, bytes);
+    }
+}
+
+/**
+ * @return      upper bound in microseconds of the q-quantile latency
+ */
+static double opstat_quantile(const struct op_counter *c, double q)
+{
+    uint64_t want = (uint64_t) (c->calls * q);
+    uint64_t sum = 0;
+    unsigned i;
+
+    for (i = 0; i < OPSTAT_BUCKETS - 1; i++) {
+        sum += c->lat[i];
+        if (sum > want) break;
+    }
+
+    return (double) (1ULL << i) / 1000.0;
+}
+
+static void opstat_render(struct sbuf *b)
+{
+    struct opstat_thread *t;
+    struct op_counter *tot;
+    struct op_counter *c;
+    int i, j;
+
+    if (!opstat_enabled) {
+        sbuf_printf(b, "op stats disabled  mount with -o op-stats\n");
+        return;
+    }
+
+    tot = calloc(OP_MAX, sizeof(*tot));
+    if (tot == NULL) {
+        b->err = 1;
+        return;
+    }
+
+    (void) pthread_mutex_lock(&opstat_lock);
+    for (i = 0; i < OP_MAX; i++) opstat_merge(&tot[i], &opstat_dead[i]);
+    for (t = opstat_live; t != NULL; t = t->next) {
+        for (i = 0; i < OP_MAX; i++) opstat_merge(&tot[i], &t->op[i]);
+    }
+    (void) pthread_mutex_unlock(&opstat_lock);
+
+    for (i = 0; i < OP_MAX; i++) {
+        c = &tot[i];
+        if (c->calls == 0) continue;
+
+        sbuf_printf(b, "op %s  calls: %llu errors: %llu bytes: %llu avg: %.1fus p50: <%.1fus p99: <%.1fus\n",
+                op_names[i], (unsigned long long) c->calls,
+                (unsigned long long) c->errors, (unsigned long long) c->bytes,
+                c->ns / 1000.0 / c->calls,
+                opstat_quantile(c, 0.50), opstat_quantile(c, 0.99));
+
+        if (c->errors == 0) continue;
+        sbuf_printf(b, "op %s  errno:", op_names[i]);
+        for (j = 0; j < OPSTAT_ERRNO_MAX; j++) {
+            if (c->err[j] != 0) {
+                sbuf_printf(b, " %d(%llu)", j, (unsigned long long) c->err[j]);
+            }
+        }
+        sbuf_printf(b, "\n");
+    }
+
+    free(tot);
+}
+
+/*
+ * Workload trace  see: `trace=' option
+ *
+ * Each completed callback appends a fixed-size struct trace_rec
+ *  followed by its path and path2(no NUL)  zero padded to TRACE_ALIGN
+ * Records land in completion order  replayers should order them by `start'
+ * Data payloads aren't recorded  a replay writes filler bytes
+ *
+ * The trace file must not live under the mount point
+ *  its write(2) would reenter this fs while trace_lock held
+ * see: bench/lbreplay.c
+ */
+
+#define TRACE_MAGIC         0x5254424cU     /* "LBTR" little-endian */
+#define TRACE_VERSION       1
+#define TRACE_BUFSZ         (256 * 1024)
+#define TRACE_ALIGN         8
+#define TRACE_RECSZ(r)      \
+    ((sizeof(r) + (r).pathlen + (r).path2len + TRACE_ALIGN - 1) & ~(size_t) (TRACE_ALIGN - 1))
+
+struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t epoch;         /* CLOCK_REALTIME ns at trace start */
+};
+
+/* No implicit padding  written as is */
+struct trace_rec {
+    uint64_t start;         /* ns since trace start */
+    uint64_t off;           /* Offset  length  uid  etc.  see: OPSTAT_WRAP() users */
+    uint64_t size;
+    uint64_t fh;            /* fi->fh  after the call for open/create/opendir */
+    int32_t ret;            /* Callback return value */
+    uint32_t flags;         /* Open flags  xattr options  setattr_x valid bits  etc. */
+    uint32_t mode;
+    uint32_t dur;           /* ns  saturated */
+    uint16_t op;            /* enum lb_op  new ops only appended to LB_OPS() */
+    uint16_t pathlen;
+    uint16_t path2len;      /* Second path  symlink target or xattr name */
+    uint16_t reserved;
+};
+
+/* Call arguments worth recording  see: TA() */
+struct trace_args {
+    const char *path;
+    const char *path2;
+    uint64_t off;
+    uint64_t size;
+    uint32_t flags;
+    uint32_t mode;
+    uint64_t fh;
+};
+
+static int trace_fd = -1;
+static uint64_t trace_t0;           /* now_ns() at trace start */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *trace_buf;             /* Protected by trace_lock */
+static size_t trace_len;
+
+/* Statistics */
+static uint64_t trace_records;
+static uint64_t trace_bytes;
+static uint64_t trace_errors;       /* Records lost  short or failed write(2) */
+
+static int trace_write(const void *p, size_t len)
+{
+    ssize_t n;
+
+    while (len != 0) {
+        n = write(trace_fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        p = (const char *) p + n;
+        len -= (size_t) n;
+    }
+
+    return 0;
+}
+
+static int trace_open(const char *path)
+{
+    struct trace_header h;
+    struct timespec ts;
+
+    assert_nonnull(path);
+
+    trace_buf = malloc(TRACE_BUFSZ);
+    if (trace_buf == NULL) return -ENOMEM;
+
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd < 0) {
+        free(trace_buf);
+        trace_buf = NULL;
+        return -errno;
+    }
+
+    (void) clock_gettime(CLOCK_REALTIME, &ts);
+    h.magic = TRACE_MAGIC;
+    h.version = TRACE_VERSION;
+    h.epoch = (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+    trace_t0 = now_ns();
+
+    if (trace_write(&h, sizeof(h)) != 0) {
+        (void) close(trace_fd);
+        trace_fd = -1;
+        free(trace_buf);
+        trace_buf = NULL;
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/* Called with trace_lock held */
+static void trace_flush_locked(void)
+{
+    if (trace_len == 0) return;
+    if (trace_write(trace_buf, trace_len) != 0) trace_errors++;
+    trace_len = 0;
+}
+
+static void trace_flush(void)
+{
+    if (trace_fd < 0) return;
+    (void) pthread_mutex_lock(&trace_lock);
+    trace_flush_locked();
+    (void) pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_record(enum lb_op op, int e, uint64_t t0, const struct trace_args *a)
+{
+    uint64_t dur = now_ns() - t0;
+    struct trace_rec r;
+    size_t len, len2, sz;
+
+    assert_nonnull(a);
+
+    len = a->path != NULL ? strnlen(a->path, UINT16_MAX) : 0;
+    len2 = a->path2 != NULL ? strnlen(a->path2, UINT16_MAX) : 0;
+
+    r.start = t0 - trace_t0;
+    r.off = a->off;
+    r.size = a->size;
+    r.fh = a->fh;
+    r.ret = e;
+    r.flags = a->flags;
+    r.mode = a->mode;
+    r.dur = dur > UINT32_MAX ? UINT32_MAX : (uint32_t) dur;
+    r.op = (uint16_t) op;
+    r.pathlen = (uint16_t) len;
+    r.path2len = (uint16_t) len2;
+    r.reserved = 0;
+
+    sz = TRACE_RECSZ(r);
+
+    (void) pthread_mutex_lock(&trace_lock);
+    if (trace_len + sz > TRACE_BUFSZ) trace_flush_locked();
+    if (sz <= TRACE_BUFSZ) {
+        (void) memcpy(trace_buf + trace_len, &r, sizeof(r));
+        (void) memcpy(trace_buf + trace_len + sizeof(r), a->path, len);
+        (void) memcpy(trace_buf + trace_len + sizeof(r) + len, a->path2, len2);
+        (void) memset(trace_buf + trace_len + sizeof(r) + len + len2, 0,
+                        sz - sizeof(r) - len - len2);
+        trace_len += sz;
+        trace_records++;
+        trace_bytes += sz;
+    }
+    (void) pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_render(struct sbuf *b)
+{
+    if (trace_fd < 0) return;
+
+    (void) pthread_mutex_lock(&trace_lock);
+    sbuf_printf(b, "trace  file: %s records: %llu bytes: %llu errors: %llu\n",
+            loopbackfs_cfg.trace, (unsigned long long) trace_records,
+            (unsigned long long) trace_bytes, (unsigned long long) trace_errors);
+    (void) pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * I/O backends  see: `io-backend=' option
+ *  data movement of regular files(pread  pwrite  fsync  preallocate)
+ *  is funnelled through lb_io as a struct io_req
+ *
+ * sync     done right on the fuse worker thread  the default
+ * threads  queued to a pool of io-depth threads
+ * uring    Linux io_uring(2) with io-depth entries  callers arriving while
+ *          another one is inside io_uring_enter(2) have their requests
+ *          submitted by it in the same batch  completions are reaped
+ *          by a dedicated thread  if the ring breaks  requests on it fail
+ *          with EIO and later ones run sync
+ *
+ * Callbacks are synchronous in the high-level API  a caller always waits
+ *  for its own request  concurrency comes from fuse worker threads
+ * Backend threads are started at first I/O  fuse_main() may daemonize via fork(2)
+ */
+
+enum io_op {
+    IO_PREAD,
+    IO_PWRITE,
+    IO_FSYNC,
+    IO_PREALLOC,
+};
+
+struct io_req {
+    enum io_op op;
+    int fd;
+    struct iovec iov;       /* IO_PREAD  IO_PWRITE */
+    off_t off;
+    int datasync;           /* IO_FSYNC */
+    fstore_t *fst;          /* IO_PREALLOC */
+    ssize_t res;            /* -errno on failure */
+
+    /* Async backends only */
+    int done;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct io_req *next;    /* Pool queue  uring requests */
+    struct io_req **pprev;  /* uring requests */
+};
+
+struct lb_io_backend {
+    const char *name;
+    int (*start)(unsigned depth);       /* @return 0 or -errno */
+    void (*submit)(struct io_req *r);   /* NULL if synchronous */
+    void (*render)(struct sbuf *b);
+};
+
+static struct {
+    uint64_t reqs;
+    uint64_t submits;       /* io_uring_enter(2) calls  pool wakeups */
+    uint64_t max_batch;     /* Most requests per submit  deepest pool queue */
+} io_stats;
+
+/**
+ * Perform `r' on the calling thread
+ * @return      syscall result  -errno on failure
+ */
+static ssize_t io_exec(struct io_req *r)
+{
+    ssize_t n;
+
+    switch (r->op) {
+    case IO_PREAD:
+        n = pread(r->fd, r->iov.iov_base, r->iov.iov_len, r->off);
+        break;
+    case IO_PWRITE:
+        n = pwrite(r->fd, r->iov.iov_base, r->iov.iov_len, r->off);
+        break;
+    case IO_FSYNC:
+        n = loopbackfs_cfg.full_fsync ? fcntl(r->fd, F_FULLFSYNC) : fsync(r->fd);
+        break;
+    case IO_PREALLOC:
+        n = fcntl(r->fd, F_PREALLOCATE, r->fst);
+        break;
+    default:
+        errno = EINVAL;
+        n = -1;
+        break;
+    }
+
+    return n < 0 ? -errno : n;
+}
+
+static void io_complete(struct io_req *r, ssize_t res)
+{
+    (void) pthread_mutex_lock(&r->lock);
+    r->res = res;
+    r->done = 1;
+    (void) pthread_cond_signal(&r->cond);
+    (void) pthread_mutex_unlock(&r->lock);
+}
+
+static inline void io_max(uint64_t *max, uint64_t n)
+{
+    uint64_t m = STAT_GET(*max);
+    while (n > m && !__atomic_compare_exchange_n(max, &m, n, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) continue;
+}
+
+static const struct lb_io_backend io_sync = {"sync", NULL, NULL, NULL};
+
+static const struct lb_io_backend *lb_io = &io_sync;
+static pthread_once_t io_once = PTHREAD_ONCE_INIT;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct io_req *head;
+    struct io_req **tail;
+    unsigned queued;
+    unsigned nthreads;
+} io_pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, &io_pool.head, 0, 0,
+};
+
+static void *io_pool_worker(void *arg)
+{
+    struct io_req *r;
+
+    UNUSED(arg);
+
+    for (;;) {
+        (void) pthread_mutex_lock(&io_pool.lock);
+        while (io_pool.head == NULL) (void) pthread_cond_wait(&io_pool.cond, &io_pool.lock);
+        r = io_pool.head;
+        io_pool.head = r->next;
+        if (io_pool.head == NULL) io_pool.tail = &io_pool.head;
+        io_pool.queued--;
+        (void) pthread_mutex_unlock(&io_pool.lock);
+
+        io_complete(r, io_exec(r));
+    }
+
+    return NULL;
+}
+
+static int io_pool_start(unsigned depth)
+{
+    pthread_t tid;
+    unsigned i;
+    int e = EINVAL;
+
+    for (i = 0; i < depth; i++) {
+        e = pthread_create(&tid, NULL, &io_pool_worker, NULL);
+        if (e != 0) break;
+        (void) pthread_detach(tid);
+    }
+
+    /* Run with what we got */
+    io_pool.nthreads = i;
+    return i != 0 ? 0 : -e;
+}
+
+static void io_pool_submit(struct io_req *r)
+{
+    r->next = NULL;
+
+    (void) pthread_mutex_lock(&io_pool.lock);
+    *io_pool.tail = r;
+    io_pool.tail = &r->next;
+    io_max(&io_stats.max_batch, ++io_pool.queued);
+    (void) pthread_cond_signal(&io_pool.cond);
+    (void) pthread_mutex_unlock(&io_pool.lock);
+
+    STAT_INC(io_stats.submits);
+}
+
+static void io_pool_render(struct sbuf *b)
+{
+    sbuf_printf(b, "io backend: threads  threads: %u requests: %llu queue max: %llu\n",
+            io_pool.nthreads,
+            (unsigned long long) STAT_GET(io_stats.reqs),
+            (unsigned long long) STAT_GET(io_stats.max_batch));
+}
+
+static const struct lb_io_backend io_threads = {
+    "threads", io_pool_start, io_pool_submit, io_pool_render,
+};
+
+#ifdef __linux__
+static struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    pthread_mutex_t lock;   /* Guards fields below and SQ */
+    pthread_cond_t slot;    /* Signalled when inflight drops below entries */
+    unsigned tail;          /* Our copy of *sq_tail */
+    unsigned pending;       /* In SQ but not yet io_uring_enter(2)ed */
+    unsigned inflight;      /* Bounded by entries  CQ(2x) never overflows */
+    struct io_req *reqs;    /* Queued or in flight */
+    int submitting;
+    int broken;             /* io_uring_enter(2) failed for good  see: io_uring_break() */
+} ring = {
+    .fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .slot = PTHREAD_COND_INITIALIZER,
+};
+
+static inline int sys_io_uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline void io_uring_link(struct io_req *r)
+{
+    r->next = ring.reqs;
+    if (r->next != NULL) r->next->pprev = &r->next;
+    r->pprev = &ring.reqs;
+    ring.reqs = r;
+}
+
+static inline void io_uring_unlink(struct io_req *r)
+{
+    *r->pprev = r->next;
+    if (r->next != NULL) r->next->pprev = r->pprev;
+}
+
+/**
+ * Give up the ring  ring lock must be held
+ * Requests on it fail with EIO  waiters would hang otherwise
+ *  and I/O goes sync from now on
+ */
+static void io_uring_break(int err)
+{
+    struct io_req *r;
+
+    SYSLOG_ERR("io_uring_enter(2) fail  errno: %d  falling back to sync", err);
+
+    ring.broken = 1;
+    __atomic_store_n(&lb_io, &io_sync, __ATOMIC_RELEASE);
+
+    while ((r = ring.reqs) != NULL) {
+        io_uring_unlink(r);
+        io_complete(r, -EIO);
+    }
+    ring.pending = 0;
+    ring.inflight = 0;
+    (void) pthread_cond_broadcast(&ring.slot);
+}
+
+static void *io_uring_reaper(void *arg)
+{
+    struct io_uring_cqe *cqe;
+    struct io_req *r;
+    unsigned head, tail, n;
+    int e;
+
+    UNUSED(arg);
+
+    for (;;) {
+        head = *ring.cq_head;
+        tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (sys_io_uring_enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                e = errno;
+                (void) pthread_mutex_lock(&ring.lock);
+                if (!ring.broken) io_uring_break(e);
+                (void) pthread_mutex_unlock(&ring.lock);
+                break;
+            }
+            continue;
+        }
+
+        (void) pthread_mutex_lock(&ring.lock);
+        if (ring.broken) {
+            /* Requests of these CQEs already failed  may be gone */
+            (void) pthread_mutex_unlock(&ring.lock);
+            break;
+        }
+        for (n = 0; head != tail; head++, n++) {
+            cqe = &ring.cqes[head & ring.cq_mask];
+            r = (struct io_req *) (uintptr_t) cqe->user_data;
+            io_uring_unlink(r);
+            io_complete(r, cqe->res);
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+        if (ring.inflight == ring.entries) (void) pthread_cond_broadcast(&ring.slot);
+        ring.inflight -= n;
+        (void) pthread_mutex_unlock(&ring.lock);
+    }
+
+    return NULL;
+}
+
+static int io_uring_start(unsigned depth)
+{
+    struct io_uring_params p;
+    size_t sqsz, cqsz;
+    char *sq, *cq = MAP_FAILED;
+    unsigned *array;
+    pthread_t tid;
+    unsigned i;
+    int e;
+
+    (void) memset(&p, 0, sizeof(p));
+    ring.fd = (int) syscall(__NR_io_uring_setup, depth, &p);
+    if (ring.fd < 0) return -errno;
+
+    sqsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) sqsz = cqsz = MAX(sqsz, cqsz);
+
+    sq = mmap(NULL, sqsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring.fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) goto out_errno;
+    cq = (p.features & IORING_FEAT_SINGLE_MMAP) ? sq :
+            mmap(NULL, cqsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring.fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) goto out_errno;
+    ring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) goto out_errno;
+
+    ring.entries = p.sq_entries;
+    ring.sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    ring.sq_mask = *(unsigned *) (sq + p.sq_off.ring_mask);
+    ring.cq_head = (unsigned *) (cq + p.cq_off.head);
+    ring.cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    ring.cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    ring.tail = *ring.sq_tail;
+
+    /* SQE i always sits in slot i  no indirection */
+    array = (unsigned *) (sq + p.sq_off.array);
+    for (i = 0; i < p.sq_entries; i++) array[i] = i;
+
+    e = pthread_create(&tid, NULL, &io_uring_reaper, NULL);
+    if (e != 0) {
+        errno = e;
+        goto out_errno;
+    }
+    (void) pthread_detach(tid);
+    return 0;
+
+out_errno:
+    /* Mappings go with the fd */
+    e = -errno;
+    (void) close(ring.fd);
+    ring.fd = -1;
+    return e;
+}
+
+static void io_uring_prep(struct io_uring_sqe *sqe, struct io_req *r)
+{
+    (void) memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = r->fd;
+    sqe->user_data = (uint64_t) (uintptr_t) r;
+
+    switch (r->op) {
+    case IO_PREAD:
+    case IO_PWRITE:
+        /* READV/WRITEV over READ/WRITE  works since 5.1 */
+        sqe->opcode = r->op == IO_PREAD ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = (uint64_t) (uintptr_t) &r->iov;
+        sqe->len = 1;
+        sqe->off = (uint64_t) r->off;
+        break;
+    case IO_FSYNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        if (r->datasync) sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        break;
+    default:
+        /* Filtered by io_uring_submit() */
+        sqe->opcode = IORING_OP_NOP;
+        break;
+    }
+}
+
+static void io_uring_submit(struct io_req *r)
+{
+    unsigned n;
+    int e;
+
+    if (r->op == IO_PREALLOC) {
+        /* F_PREALLOCATE has no io_uring counterpart */
+        io_complete(r, io_exec(r));
+        return;
+    }
+
+    (void) pthread_mutex_lock(&ring.lock);
+    while (!ring.broken && ring.inflight == ring.entries) {
+        (void) pthread_cond_wait(&ring.slot, &ring.lock);
+    }
+    if (ring.broken) {
+        /* Picked the backend before it broke */
+        (void) pthread_mutex_unlock(&ring.lock);
+        io_complete(r, io_exec(r));
+        return;
+    }
+    ring.inflight++;
+    io_uring_link(r);
+
+    io_uring_prep(&ring.sqes[ring.tail & ring.sq_mask], r);
+    __atomic_store_n(ring.sq_tail, ++ring.tail, __ATOMIC_RELEASE);
+    ring.pending++;
+
+    /* Submit for everyone who queued while we were in the syscall */
+    if (!ring.submitting) {
+        ring.submitting = 1;
+        while (ring.pending != 0) {
+            n = ring.pending;
+            ring.pending = 0;
+            (void) pthread_mutex_unlock(&ring.lock);
+            e = sys_io_uring_enter(n, 0, 0);
+            if (e < 0) e = -errno;
+            (void) pthread_mutex_lock(&ring.lock);
+
+            /* Reaper gave up meanwhile */
+            if (ring.broken) break;
+            if (e < 0) {
+                if (e != -EINTR && e != -EAGAIN && e != -EBUSY) {
+                    /* Only a broken ring gets here */
+                    io_uring_break(-e);
+                    break;
+                }
+                e = 0;
+            }
+            STAT_INC(io_stats.submits);
+            io_max(&io_stats.max_batch, (unsigned) e);
+            ring.pending += n - (unsigned) e;
+        }
+        ring.submitting = 0;
+    }
+
+    (void) pthread_mutex_unlock(&ring.lock);
+}
+
+static void io_uring_render(struct sbuf *b)
+{
+    uint64_t reqs = STAT_GET(io_stats.reqs);
+    uint64_t submits = STAT_GET(io_stats.submits);
+
+    sbuf_printf(b, "io backend: uring  entries: %u requests: %llu submits(io_uring_enter): %llu batch avg: %.2f max: %llu\n",
+            ring.entries, (unsigned long long) reqs, (unsigned long long) submits,
+            submits ? (double) reqs / submits : 0.0,
+            (unsigned long long) STAT_GET(io_stats.max_batch));
+}
+
+static const struct lb_io_backend io_ring = {
+    "uring", io_uring_start, io_uring_submit, io_uring_render,
+};
+#endif
+
+static const struct lb_io_backend *io_backends[] = {
+    &io_sync,
+    &io_threads,
+#ifdef __linux__
+    &io_ring,
+#endif
+};
+
+static inline const struct lb_io_backend *io_backend(void)
+{
+    return __atomic_load_n(&lb_io, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @return      0 if `name' is a backend of this platform
+ */
+static int io_select(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(io_backends) / sizeof(*io_backends); i++) {
+        if (!strcmp(name, io_backends[i]->name)) {
+            lb_io = io_backends[i];
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+static void io_start(void)
+{
+    const struct lb_io_backend *b = lb_io;
+    int e;
+
+    e = b->start(loopbackfs_cfg.io_depth);
+    if (e != 0 && b != &io_threads) {
+        SYSLOG_WARN("io backend %s unavailable  errno: %d  trying threads", b->name, -e);
+        b = &io_threads;
+        e = b->start(loopbackfs_cfg.io_depth);
+    }
+    if (e != 0) {
+        SYSLOG_WARN("io backend %s unavailable  errno: %d  staying sync", b->name, -e);
+        b = &io_sync;
+    }
+
+    __atomic_store_n(&lb_io, b, __ATOMIC_RELEASE);
+}
+
+/**
+ * Run `r' through current backend and wait for it
+ * @return      see: io_exec()
+ */
+static ssize_t io_run(struct io_req *r)
+{
+    const struct lb_io_backend *b = io_backend();
+
+    if (b->submit == NULL) return io_exec(r);
+
+    (void) pthread_once(&io_once, io_start);
+    b = io_backend();
+    if (b->submit == NULL) return io_exec(r);
+
+    STAT_INC(io_stats.reqs);
+    r->done = 0;
+    (void) pthread_mutex_init(&r->lock, NULL);
+    (void) pthread_cond_init(&r->cond, NULL);
+
+    b->submit(r);
+
+    (void) pthread_mutex_lock(&r->lock);
+    while (!r->done) (void) pthread_cond_wait(&r->cond, &r->lock);
+    (void) pthread_mutex_unlock(&r->lock);
+
+    (void) pthread_cond_destroy(&r->cond);
+    (void) pthread_mutex_destroy(&r->lock);
+    return r->res;
+}
+
+/**
+ * @return      non-zero if data should be handed to libfuse in memory
+ *              fd-backed buffers would bypass the backend
+ */
+static inline int io_async(void)
+{
+    return io_backend()->submit != NULL;
+}
+
+static ssize_t io_pread(int fd, void *buf, size_t sz, off_t off)
+{
+    struct io_req r;
+
+    r.op = IO_PREAD;
+    r.fd = fd;
+    r.iov.iov_base = buf;
+    r.iov.iov_len = sz;
+    r.off = off;
+    return io_run(&r);
+}
+
+static ssize_t io_pwrite(int fd, const void *buf, size_t sz, off_t off)
+{
+    struct io_req r;
+
+    r.op = IO_PWRITE;
+    r.fd = fd;
+    r.iov.iov_base = (void *) buf;
+    r.iov.iov_len = sz;
+    r.off = off;
+    return io_run(&r);
+}
+
+static int io_fsync(int fd, int datasync)
+{
+    struct io_req r;
+
+    r.op = IO_FSYNC;
+    r.fd = fd;
+    r.datasync = datasync;
+    return (int) io_run(&r);
+}
+
+static int io_prealloc(int fd, fstore_t *fst)
+{
+    struct io_req r;
+
+    r.op = IO_PREALLOC;
+    r.fd = fd;
+    r.fst = fst;
+    return (int) io_run(&r);
+}
+
+static void io_render_stats(struct sbuf *b)
+{
+    const struct lb_io_backend *be = io_backend();
+    if (be->render != NULL) be->render(b);
+}
+
+/*
+ * Group commit  see: `fsync-group=' option(window in microseconds)
+ *  fsync() and fsyncdir() callers queue to a flusher thread  which waits
+ *  out the window after the first one arrives so concurrent callers can
+ *  join  then makes the whole batch durable at once:
+ *
+ * Linux    one syncfs(2) per backing file system  which only reports
+ *          writeback errors of the files it flushed since 5.8  refused on
+ *          older kernels  where it could lose an error fsync(2) returns
+ * Darwin   each caller fsync(2)s its own fd first  on its own thread  then
+ *          the batch needs one F_FULLFSYNC per device(it flushes the whole
+ *          drive cache  once is enough)  without `full-fsync' there's
+ *          nothing left to batch  so refused too
+ *
+ * Linux does a batch of one as a plain fsync  every caller returns only
+ *  after the batch carrying it is durable
+ */
+
+struct fsg_req {
+    int fd;
+    int res;                /* -errno on failure */
+    int done;               /* Under fsg.lock */
+    int settled;            /* Flusher private */
+    dev_t dev;
+    struct fsg_req *next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* Flusher waits for a queue */
+    pthread_cond_t done;    /* Callers wait for their batch */
+    struct fsg_req *queue;
+    int running;
+} fsg = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0,
+};
+
+static pthread_once_t fsg_once = PTHREAD_ONCE_INIT;
+
+static struct {
+    uint64_t reqs;
+    uint64_t batches;
+    uint64_t max_batch;
+    uint64_t syncs;         /* Durability syscalls actually issued */
+    uint64_t wait_ns;       /* Summed over callers */
+} fsg_stats;
+
+/**
+ * Give every request on the same device as `r' result `e'
+ */
+static void fsg_settle(struct fsg_req *batch, const struct fsg_req *r, int e)
+{
+    struct fsg_req *q;
+
+    for (q = batch; q != NULL; q = q->next) {
+        if (!q->settled && q->dev == r->dev) {
+            q->res = e;
+            q->settled = 1;
+        }
+    }
+}
+
+/**
+ * @return      NULL if group commit can batch here  why not otherwise
+ */
+static const char *fsg_unsupported(void)
+{
+#ifdef __linux__
+    struct utsname u;
+    unsigned major, minor;
+
+    if (uname(&u) != 0 || sscanf(u.release, "%u.%u", &major, &minor) != 2) {
+        return "kernel version unknown";
+    }
+    if (major < 5 || (major == 5 && minor < 8)) {
+        return "syncfs(2) may lose writeback errors before Linux 5.8";
+    }
+    return NULL;
+#else
+    return loopbackfs_cfg.full_fsync ? NULL : "only F_FULLFSYNC batches  needs full-fsync";
+#endif
+}
+
+/**
+ * Make every fd in `batch' durable  fills res
+ */
+static void fsg_commit(struct fsg_req *batch, unsigned n)
+{
+    struct fsg_req *r;
+    int e;
+
+#ifdef __linux__
+    if (n == 1) {
+        batch->res = io_fsync(batch->fd, 0);
+        STAT_INC(fsg_stats.syncs);
+        return;
+    }
+#else
+    UNUSED(n);
+#endif
+
+    for (r = batch; r != NULL; r = r->next) {
+        if (r->settled) continue;
+#ifdef __linux__
+        e = RET_TO_ERRNO(syncfs(r->fd));
+#else
+        e = RET_TO_ERRNO(fcntl(r->fd, F_FULLFSYNC));
+#endif
+        STAT_INC(fsg_stats.syncs);
+        fsg_settle(batch, r, e);
+    }
+}
+
+static void *fsg_flusher(void *arg)
+{
+    struct fsg_req *batch, *r;
+    struct timespec ts;
+    unsigned window;
+    unsigned n;
+
+    UNUSED(arg);
+
+    for (;;) {
+        (void) pthread_mutex_lock(&fsg.lock);
+        while (fsg.queue == NULL) (void) pthread_cond_wait(&fsg.work, &fsg.lock);
+        (void) pthread_mutex_unlock(&fsg.lock);
+
+        /* Let concurrent callers join */
+        window = loopbackfs_cfg.fsync_group;
+        ts.tv_sec = window / 1000000;
+        ts.tv_nsec = (long) (window % 1000000) * 1000;
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) continue;
+
+        (void) pthread_mutex_lock(&fsg.lock);
+        batch = fsg.queue;
+        fsg.queue = NULL;
+        (void) pthread_mutex_unlock(&fsg.lock);
+
+        for (n = 0, r = batch; r != NULL; r = r->next) n++;
+        STAT_INC(fsg_stats.batches);
+        io_max(&fsg_stats.max_batch, n);
+
+        fsg_commit(batch, n);
+
+        (void) pthread_mutex_lock(&fsg.lock);
+        for (r = batch; r != NULL; r = r->next) r->done = 1;
+        (void) pthread_cond_broadcast(&fsg.done);
+        (void) pthread_mutex_unlock(&fsg.lock);
+    }
+
+    return NULL;
+}
+
+static void fsg_start(void)
+{
+    pthread_t tid;
+
+    /* Started lazily  fuse_main() may daemonize via fork(2) */
+    if (pthread_create(&tid, NULL, &fsg_flusher, NULL) != 0) {
+        SYSLOG_WARN("pthread_create(3) fail  fsync group commit unavailable");
+        return;
+    }
+    (void) pthread_detach(tid);
+    fsg.running = 1;
+}
+
+/**
+ * fsync(2) `fd' by group commit if enabled
+ * @return      0 if durable  -errno otherwise
+ */
+static int lb_sync_fd(int fd, int datasync)
+{
+    struct fsg_req r;
+    struct stat st;
+    uint64_t t0;
+
+    if (loopbackfs_cfg.fsync_group == 0) return io_fsync(fd, datasync);
+
+    (void) pthread_once(&fsg_once, fsg_start);
+    if (!fsg.running) return io_fsync(fd, datasync);
+
+    t0 = now_ns();
+    if (fstat(fd, &st) != 0) return -errno;
+#ifndef __linux__
+    /* Own data goes out in parallel  the batch only flushes drive cache */
+    if (fsync(fd) != 0) return -errno;
+#endif
+    r.dev = st.st_dev;
+    r.fd = fd;
+    r.res = 0;
+    r.done = 0;
+    r.settled = 0;
+
+    (void) pthread_mutex_lock(&fsg.lock);
+    r.next = fsg.queue;
+    fsg.queue = &r;
+    (void) pthread_cond_signal(&fsg.work);
+    while (!r.done) (void) pthread_cond_wait(&fsg.done, &fsg.lock);
+    (void) pthread_mutex_unlock(&fsg.lock);
+
+    STAT_INC(fsg_stats.reqs);
+    (void) __atomic_add_fetch(&fsg_stats.wait_ns, now_ns() - t0, __ATOMIC_RELAXED);
+    return r.res;
+}
+
+static void fsg_render_stats(struct sbuf *b)
+{
+    uint64_t reqs = STAT_GET(fsg_stats.reqs);
+    uint64_t batches = STAT_GET(fsg_stats.batches);
+
+    if (loopbackfs_cfg.fsync_group == 0 && reqs == 0) return;
+
+    sbuf_printf(b, "fsync group  window: %uus requests: %llu batches: %llu batch avg: %.2f max: %llu syncs: %llu wait avg: %.1fus\n",
+            loopbackfs_cfg.fsync_group, (unsigned long long) reqs,
+            (unsigned long long) batches, batches ? (double) reqs / batches : 0.0,
+            (unsigned long long) STAT_GET(fsg_stats.max_batch),
+            (unsigned long long) STAT_GET(fsg_stats.syncs),
+            reqs ? STAT_GET(fsg_stats.wait_ns) / 1e3 / reqs : 0.0);
+}
+
+/*
+ * Open file handle  hung off fi->fh of regular files
+ *  read-ahead and write coalescing below both live in it
+ *
+ * Read-ahead  see: `readahead=' option
+ *  a handle reading sequentially gets a private buffer filled by one pread(2)
+ *  of a window  doubled on each refill up to the configured max
+ *  following reads are then copied from memory
+ * Buffered data is dropped once anything changes file content through this fs
+ *  by any name of the same inode(see: data_changed())
+ * Changes behind our back are seen at next refill  a read is served from
+ *  the buffer only if all of it is there  so a file growing under us is reread
+ */
+
+#define RA_WINDOW_MIN       (128 * 1024)
+#define DATA_GEN_STRIPES    1024    /* Must be power of 2 */
+
+struct lb_readahead {
+    pthread_mutex_t lock;
+    char *buf;
+    size_t cap;             /* Max window  size of buf */
+    size_t window;          /* Size of next fill */
+    off_t start;            /* File offset of buf[0] */
+    size_t len;             /* Valid bytes in buf */
+    off_t next;             /* Where a sequential reader continues */
+    uint32_t gen;           /* data_gen[] of the inode at fill */
+};
+
+struct lb_wbuf;
+
+struct lb_backing;
+
+struct lb_file {
+    int fd;
+    struct lb_backing *bk;      /* NULL if fd private to this handle  see: fd_open() */
+    int lock_fd;                /* fd flock(2)ed instead of a shared one  -1 till decided */
+    struct lb_readahead *ra;    /* NULL if read-ahead disabled at open */
+    struct lb_wbuf *wb;         /* NULL if write coalescing disabled or read-only */
+    dev_t dev;                  /* Valid only if read-ahead or write coalescing enabled */
+    ino_t ino;                  /*  zero otherwise */
+};
+
+/* Bumped by data_changed()  striped by (st_dev, st_ino) as write coalescing */
+static uint32_t data_gen[DATA_GEN_STRIPES];
+static unsigned ra_live;        /* Open handles with read-ahead */
+
+static struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t fills;
+    uint64_t bytes;         /* Read by fills */
+    uint64_t stale;         /* Buffered range invalidated by data_changed() */
+} ra_stats;
+
+static inline uint32_t *data_gen_slot(dev_t dev, ino_t ino)
+{
+    uint64_t h = ((uint64_t) ino ^ ((uint64_t) dev << 32)) * 0x9e3779b97f4a7c15ULL;
+    return &data_gen[h >> 54 & (DATA_GEN_STRIPES - 1)];
+}
+
+static inline void data_gen_bump(dev_t dev, ino_t ino)
+{
+    (void) __atomic_add_fetch(data_gen_slot(dev, ino), 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * File content at `path' changed by path
+ */
+static void data_changed(const char *path)
+{
+    struct stat st;
+
+    if (STAT_GET(ra_live) == 0) return;
+    /* Renamed or removed meanwhile  nothing left to key by */
+    if (stat(path, &st) == 0) data_gen_bump(st.st_dev, st.st_ino);
+}
+
+/**
+ * File content changed through handle `f'
+ */
+static void data_changed_file(const struct lb_file *f)
+{
+    struct stat st;
+
+    if (STAT_GET(ra_live) == 0) return;
+    if (f->ino != 0) {
+        data_gen_bump(f->dev, f->ino);
+    } else if (fstat(f->fd, &st) == 0) {
+        /* Opened while read-ahead and write coalescing both disabled */
+        data_gen_bump(st.st_dev, st.st_ino);
+    }
+}
+
+/*
+ * Write coalescing  see: `write-coalesce=' option
+ *  a writable handle keeps one dirty extent in memory
+ *  a write adjacent to or overlapping it is merged  anything else
+ *  (or a merge that would outgrow the buffer) flushes it first by one pwrite(2)
+ *  writes as large as the buffer skip it
+ *
+ * Dirty data is flushed by flush()  fsync()  release()
+ *  and before anything through this fs could observe the file without it:
+ *  a read through any handle starting below the dirty end
+ *  (a gap before the extent may be a hole not yet on disk)
+ *  getattr()  size changes  exchange()  and writes through other handles
+ * Handles are matched by (st_dev, st_ino) taken at open  hard links and
+ *  renames need no special care  other processes on the backing fs
+ *  see dirty data only once flushed  as with any write-back cache
+ *
+ * Errors of deferred writes are reported by next flush()/fsync()/release()
+ */
+
+#define WB_STRIPES      64      /* Must be power of 2 */
+
+struct lb_wbuf {
+    char *buf;
+    size_t cap;
+    off_t start;            /* File offset of buf[0] */
+    size_t len;             /* Dirty bytes  zero if clean */
+    int err;                /* Deferred write error  -errno */
+    struct lb_file *next;   /* Dirty list of the stripe */
+};
+
+/* Dirty handles by inode  a stripe lock guards wb of every handle in it */
+static struct wb_stripe {
+    pthread_mutex_t lock;
+    struct lb_file *dirty;
+    unsigned ndirty;
+} wb_stripes[WB_STRIPES];
+
+static unsigned wb_ndirty;      /* Sum over stripes  fast path when zero */
+
+static struct {
+    uint64_t writes;        /* Absorbed into a buffer */
+    uint64_t flushes;       /* pwrite(2) of a dirty extent */
+    uint64_t bytes;         /* Written by flushes */
+    uint64_t forced;        /* Flushes on behalf of other ops  see above */
+    uint64_t errors;
+} wb_stats;
+
+static void wb_init(void)
+{
+    int i;
+    for (i = 0; i < WB_STRIPES; i++) {
+        (void) pthread_mutex_init(&wb_stripes[i].lock, NULL);
+    }
+}
+
+static inline struct wb_stripe *wb_stripe_of(dev_t dev, ino_t ino)
+{
+    uint64_t h = ((uint64_t) ino ^ ((uint64_t) dev << 32)) * 0x9e3779b97f4a7c15ULL;
+    return &wb_stripes[h >> 58 & (WB_STRIPES - 1)];
+}
+
+/**
+ * Write out dirty extent of `f'  stripe lock held
+ * Buffered data is dropped even if pwrite(2) fails
+ * @return      0 if clean or written  -errno otherwise
+ */
+static int wb_flush_locked(struct wb_stripe *s, struct lb_file *f)
+{
+    struct lb_wbuf *wb = f->wb;
+    struct lb_file **pp;
+    size_t done = 0;
+    ssize_t n;
+    int e = 0;
+
+    if (wb == NULL || wb->len == 0) return 0;
+
+    while (done < wb->len) {
+        n = io_pwrite(f->fd, wb->buf + done, wb->len - done, wb->start + (off_t) done);
+        if (n < 0) {
+            if (n == -EINTR) continue;
+            e = (int) n;
+            STAT_INC(wb_stats.errors);
+            break;
+        }
+        done += (size_t) n;
+    }
+    STAT_INC(wb_stats.flushes);
+    (void) __atomic_add_fetch(&wb_stats.bytes, (uint64_t) done, __ATOMIC_RELAXED);
+
+    for (pp = &s->dirty; *pp != f; pp = &(*pp)->wb->next) continue;
+    *pp = wb->next;
+    wb->next = NULL;
+    wb->len = 0;
+    (void) __atomic_sub_fetch(&s->ndirty, 1, __ATOMIC_RELAXED);
+    (void) __atomic_sub_fetch(&wb_ndirty, 1, __ATOMIC_RELAXED);
+    return e;
+}
+
+/**
+ * Flush dirty handles of an inode whose extent ends past `below'
+ *  errors are left for the owning handle to report
+ * @except      handle to skip  NULL if none
+ * @return      number of handles flushed
+ */
+static int wb_sync(dev_t dev, ino_t ino, const struct lb_file *except, off_t below)
+{
+    struct wb_stripe *s;
+    struct lb_file *f, *next;
+    int n = 0;
+    int e;
+
+    if (STAT_GET(wb_ndirty) == 0) return 0;
+
+    s = wb_stripe_of(dev, ino);
+    if (STAT_GET(s->ndirty) == 0) return 0;
+
+    (void) pthread_mutex_lock(&s->lock);
+    for (f = s->dirty; f != NULL; f = next) {
+        next = f->wb->next;
+        if (f == except || f->ino != ino || f->dev != dev) continue;
+        if (f->wb->start + (off_t) f->wb->len <= below) continue;
+        e = wb_flush_locked(s, f);
+        if (e != 0 && f->wb->err == 0) f->wb->err = e;
+        STAT_INC(wb_stats.forced);
+        n++;
+    }
+    (void) pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+/**
+ * Flush every handle of the file `st' describes
+ * @return      non-zero if anything flushed  `st' should be refetched
+ */
+static inline int wb_sync_stat(const struct stat *st)
+{
+    if (STAT_GET(wb_ndirty) == 0 || !S_ISREG(st->st_mode)) return 0;
+    return wb_sync(st->st_dev, st->st_ino, NULL, 0);
+}
+
+/**
+ * Flush every handle of `path'  before it's changed by path
+ */
+static void wb_sync_path(const char *path)
+{
+    struct stat st;
+
+    if (STAT_GET(wb_ndirty) == 0) return;
+    if (stat(path, &st) == 0) (void) wb_sync_stat(&st);
+}
+
+/**
+ * Flush every handle of the inode of `f'  errors left for the owners
+ */
+static inline void wb_sync_inode(const struct lb_file *f)
+{
+    (void) wb_sync(f->dev, f->ino, NULL, 0);
+}
+
+/**
+ * Flush `f' and every other handle of its inode
+ * @return      deferred error of `f' if any  cleared
+ */
+static int wb_sync_file(struct lb_file *f)
+{
+    struct wb_stripe *s;
+    int e;
+
+    if (f->wb == NULL) {
+        wb_sync_inode(f);
+        return 0;
+    }
+
+    s = wb_stripe_of(f->dev, f->ino);
+    (void) wb_sync(f->dev, f->ino, f, 0);
+
+    (void) pthread_mutex_lock(&s->lock);
+    e = wb_flush_locked(s, f);
+    if (e == 0) e = f->wb->err;
+    f->wb->err = 0;
+    (void) pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+/**
+ * pwrite(2) through write buffer of the handle if any
+ * @return      bytes written(or buffered)  -errno otherwise
+ */
+static ssize_t lb_file_write(struct lb_file *f, const char *buf, size_t sz, off_t off)
+{
+    struct lb_wbuf *wb = f->wb;
+    struct wb_stripe *s;
+    off_t start, end;
+    int e;
+
+    if (wb == NULL) return io_pwrite(f->fd, buf, sz, off);
+
+    /* Older data of other handles must land first */
+    (void) wb_sync(f->dev, f->ino, f, 0);
+
+    s = wb_stripe_of(f->dev, f->ino);
+    (void) pthread_mutex_lock(&s->lock);
+
+    if (wb->len != 0) {
+        start = MIN(wb->start, off);
+        end = MAX(wb->start + (off_t) wb->len, off + (off_t) sz);
+        if (off > wb->start + (off_t) wb->len || off + (off_t) sz < wb->start ||
+                (size_t) (end - start) > wb->cap) {
+            e = wb_flush_locked(s, f);
+            if (e != 0) {
+                (void) pthread_mutex_unlock(&s->lock);
+                return e;
+            }
+        } else {
+            if (start < wb->start) {
+                (void) memmove(wb->buf + (wb->start - start), wb->buf, wb->len);
+            }
+            (void) memcpy(wb->buf + (off - start), buf, sz);
+            wb->start = start;
+            wb->len = (size_t) (end - start);
+            (void) pthread_mutex_unlock(&s->lock);
+            STAT_INC(wb_stats.writes);
+            return (ssize_t) sz;
+        }
+    }
+
+    if (sz >= wb->cap) {
+        /* Buffering buys nothing */
+        (void) pthread_mutex_unlock(&s->lock);
+        return io_pwrite(f->fd, buf, sz, off);
+    }
+
+    (void) memcpy(wb->buf, buf, sz);
+    wb->start = off;
+    wb->len = sz;
+    wb->next = s->dirty;
+    s->dirty = f;
+    STAT_INC(s->ndirty);
+    STAT_INC(wb_ndirty);
+    (void) pthread_mutex_unlock(&s->lock);
+    STAT_INC(wb_stats.writes);
+    return (ssize_t) sz;
+}
+
+static void wb_render_stats(struct sbuf *b)
+{
+    uint64_t writes = STAT_GET(wb_stats.writes);
+    uint64_t flushes = STAT_GET(wb_stats.flushes);
+
+    if (loopbackfs_cfg.write_coalesce == 0) return;
+
+    /* Each buffered write would've been a pwrite(2) */
+    sbuf_printf(b, "write coalescing  writes: %llu flushes(pwrite): %llu saved: %llu bytes: %llu forced: %llu errors: %llu\n",
+            (unsigned long long) writes, (unsigned long long) flushes,
+            (unsigned long long) (writes - flushes),
+            (unsigned long long) STAT_GET(wb_stats.bytes),
+            (unsigned long long) STAT_GET(wb_stats.forced),
+            (unsigned long long) STAT_GET(wb_stats.errors));
+}
+
+/*
+ * Backing fd table  see: `fd-share' option
+ *
+ * Handles opened with the same access mode on the same inode share one
+ *  backing fd  so a file held open by many processes costs one fd
+ * Sharded by inode  each shard with its own lock  no global lock
+ * The inode is looked up by a fresh lstat(2)  never attr cache
+ *  a stale identity would hand out the fd of another file
+ * Only plain opens share(see: FD_SHARE_IGNORED)  e.g. O_APPEND  O_SYNC
+ *  or open-time locks get a private fd  as does every handle if disabled
+ * flock(2) locks the open file description  so a handle locking a shared
+ *  fd either takes it out of sharing if alone on it  or reopens the file
+ *  from the fd for a lock fd of its own(see: lb_flock())
+ *  the reopen fails if the file was unlinked or no longer grants the access
+ *  mode since  flock(2) of such a handle fails where unshared it wouldn't
+ */
+
+#define FD_SHARDS           64      /* Must be power of 2 */
+#define LOCK_FD_BACKING     (-2)    /* lb_file.lock_fd  handle locks its own backing fd */
+#define FD_SHARE_IGNORED    (O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC)
+
+struct lb_backing {
+    struct lb_backing *next;
+    dev_t dev;
+    ino_t ino;
+    int accmode;
+    int fd;
+    unsigned refs;          /* Handles using fd */
+    int excl;               /* Claimed by its only handle  no longer shared */
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct lb_backing *head;
+} fd_shards[FD_SHARDS];
+
+static struct {
+    uint64_t handles;       /* Open now */
+    uint64_t fds;           /* Open now  incl. private and lock fds */
+    uint64_t handles_max;
+    uint64_t fds_max;
+    uint64_t opens;
+    uint64_t shared;        /* Opens served by an already open fd */
+} fd_stats;
+
+static void fd_init(void)
+{
+    unsigned i;
+    for (i = 0; i < FD_SHARDS; i++) {
+        (void) pthread_mutex_init(&fd_shards[i].lock, NULL);
+    }
+}
+
+static inline void fd_gauge_inc(uint64_t *v, uint64_t *max)
+{
+    io_max(max, __atomic_add_fetch(v, 1, __ATOMIC_RELAXED));
+}
+
+static inline unsigned fd_shard_of(dev_t dev, ino_t ino)
+{
+    uint64_t h = ((uint64_t) ino ^ ((uint64_t) dev << 32)) * 0x9e3779b97f4a7c15ULL;
+    return (unsigned) (h >> 58) & (FD_SHARDS - 1);
+}
+
+static void fd_render_stats(struct sbuf *b)
+{
+    uint64_t opens = STAT_GET(fd_stats.opens);
+
+    if (opens == 0) return;
+
+    sbuf_printf(b, "handles  open: %llu (max %llu) backing fds: %llu (max %llu) opens: %llu shared(open saved): %llu\n",
+            (unsigned long long) STAT_GET(fd_stats.handles),
+            (unsigned long long) STAT_GET(fd_stats.handles_max),
+            (unsigned long long) STAT_GET(fd_stats.fds),
+            (unsigned long long) STAT_GET(fd_stats.fds_max),
+            (unsigned long long) opens,
+            (unsigned long long) STAT_GET(fd_stats.shared));
+}
+
+/**
+ * Take a reference of the backing fd of (dev  ino  accmode) if open
+ */
+static struct lb_backing *fd_lookup(dev_t dev, ino_t ino, int accmode)
+{
+    unsigned s = fd_shard_of(dev, ino);
+    struct lb_backing *bk;
+
+    (void) pthread_mutex_lock(&fd_shards[s].lock);
+    for (bk = fd_shards[s].head; bk != NULL; bk = bk->next) {
+        if (bk->ino == ino && bk->dev == dev && bk->accmode == accmode && !bk->excl) {
+            bk->refs++;
+            break;
+        }
+    }
+    (void) pthread_mutex_unlock(&fd_shards[s].lock);
+
+    return bk;
+}
+
+/**
+ * Publish a freshly opened `fd'  or take the one another opener published first
+ * @return      backing now referenced  NULL if out of memory(fd stays private)
+ */
+static struct lb_backing *fd_insert(dev_t dev, ino_t ino, int accmode, int fd)
+{
+    unsigned s = fd_shard_of(dev, ino);
+    struct lb_backing *bk;
+    struct lb_backing *n;
+
+    n = malloc(sizeof(*n));
+    if (n == NULL) return NULL;
+    n->dev = dev;
+    n->ino = ino;
+    n->accmode = accmode;
+    n->fd = fd;
+    n->refs = 1;
+    n->excl = 0;
+
+    (void) pthread_mutex_lock(&fd_shards[s].lock);
+    for (bk = fd_shards[s].head; bk != NULL; bk = bk->next) {
+        if (bk->ino == ino && bk->dev == dev && bk->accmode == accmode && !bk->excl) {
+            bk->refs++;
+            break;
+        }
+    }
+    if (bk == NULL) {
+        n->next = fd_shards[s].head;
+        fd_shards[s].head = n;
+    }
+    (void) pthread_mutex_unlock(&fd_shards[s].lock);
+
+    if (bk != NULL) {
+        /* Lost the race  ours is redundant */
+        free(n);
+        (void) close(fd);
+        (void) __atomic_sub_fetch(&fd_stats.fds, 1, __ATOMIC_RELAXED);
+        STAT_INC(fd_stats.shared);
+        return bk;
+    }
+
+    return n;
+}
+
+/**
+ * @return      faccessat(2) mode open(2) with `accmode' checks
+ */
+static inline int fd_access_mode(int accmode)
+{
+    switch (accmode) {
+    case O_WRONLY:
+        return W_OK;
+    case O_RDWR:
+        return R_OK | W_OK;
+    default:
+        return R_OK;
+    }
+}
+
+/**
+ * open(2) for a handle  through the table if sharing enabled
+ * @bk          backing referenced  NULL if `fd' is private to the handle
+ * @return      fd if success  -errno otherwise
+ */
+static int fd_open(const char *path, int flags, mode_t mode, struct lb_backing **bk)
+{
+    int accmode = flags & O_ACCMODE;
+    struct stat st;
+    int fd;
+
+    assert_nonnull(path);
+    assert_nonnull(bk);
+
+    *bk = NULL;
+    STAT_INC(fd_stats.opens);
+
+    if (__atomic_load_n(&loopbackfs_cfg.fd_share, __ATOMIC_RELAXED) && !(flags & ~FD_SHARE_IGNORED)) {
+        /*
+         * Creating or truncating must go through open(2)
+         * A shared fd skips its permission check  mode or ACL may have changed
+         *  since the fd was opened
+         */
+        if (!(flags & (O_CREAT | O_TRUNC)) && lstat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+                faccessat(AT_FDCWD, path, fd_access_mode(accmode), AT_EACCESS) == 0 &&
+                (*bk = fd_lookup(st.st_dev, st.st_ino, accmode)) != NULL) {
+            STAT_INC(fd_stats.shared);
+            return (*bk)->fd;
+        }
+
+        fd = open(path, flags, mode);
+        if (fd < 0) return -errno;
+        fd_gauge_inc(&fd_stats.fds, &fd_stats.fds_max);
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            *bk = fd_insert(st.st_dev, st.st_ino, accmode, fd);
+            if (*bk != NULL) return (*bk)->fd;
+        }
+        return fd;
+    }
+
+    fd = open(path, flags, mode);
+    if (fd < 0) return -errno;
+    fd_gauge_inc(&fd_stats.fds, &fd_stats.fds_max);
+    return fd;
+}
+
+/**
+ * Take `bk' out of sharing if the caller's handle is its only user
+ * @return      1 if the handle has the fd to itself  0 otherwise
+ */
+static int fd_claim(struct lb_backing *bk)
+{
+    unsigned s = fd_shard_of(bk->dev, bk->ino);
+    int mine;
+
+    (void) pthread_mutex_lock(&fd_shards[s].lock);
+    if (bk->refs == 1) bk->excl = 1;
+    mine = bk->excl;
+    (void) pthread_mutex_unlock(&fd_shards[s].lock);
+
+    return mine;
+}
+
+/**
+ * Open the file behind shared `bk' once more
+ * Resolved from the fd rather than a FUSE path  which may since name
+ *  another file or none
+ * @return      fd if success  -errno otherwise
+ */
+static int fd_reopen(const struct lb_backing *bk)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    int fd;
+
+    if (fcntl(bk->fd, F_GETPATH, path) < 0) return -errno;
+
+    fd = open(path, bk->accmode | O_NOFOLLOW);
+    if (fd < 0) return -errno;
+    if (fstat(fd, &st) != 0 || st.st_dev != bk->dev || st.st_ino != bk->ino) {
+        /* Renamed over between F_GETPATH and open(2) */
+        (void) close(fd);
+        return -ENOLCK;
+    }
+
+    return fd;
+}
 
-#define FUSE_USE_VERSION            26
-#include <fuse.h>
+/**
+ * Drop a handle's use of `fd'  closed once no handle uses it
+ * @return      0 if success  -errno if close(2) failed
+ */
+static int fd_close(struct lb_backing *bk, int fd)
+{
+    unsigned s;
+    struct lb_backing **pp;
+
+    if (bk != NULL) {
+        s = fd_shard_of(bk->dev, bk->ino);
+        (void) pthread_mutex_lock(&fd_shards[s].lock);
+        if (--bk->refs != 0) {
+            (void) pthread_mutex_unlock(&fd_shards[s].lock);
+            return 0;
+        }
+        for (pp = &fd_shards[s].head; *pp != bk; pp = &(*pp)->next) continue;
+        *pp = bk->next;
+        (void) pthread_mutex_unlock(&fd_shards[s].lock);
+        fd = bk->fd;
+        free(bk);
+    }
 
-#include "utils.h"
+    (void) __atomic_sub_fetch(&fd_stats.fds, 1, __ATOMIC_RELAXED);
+    return RET_TO_ERRNO(close(fd));
+}
 
-struct loopbackfs_config {
-    int ci;     /* Case insensitive? */
-};
+static inline struct lb_file *get_file(const struct fuse_file_info *fi)
+{
+    assert_nonnull(fi);
+    return (struct lb_file *) fi->fh;
+}
+
+static inline int lb_fd(const struct fuse_file_info *fi)
+{
+    return get_file(fi)->fd;
+}
+
+/**
+ * Wrap `fd' from fd_open() into fi->fh  drops it on failure
+ */
+static int lb_file_new(struct fuse_file_info *fi, int fd, struct lb_backing *bk)
+{
+    size_t cap = loopbackfs_cfg.readahead;
+    size_t wcap = loopbackfs_cfg.write_coalesce;
+    struct lb_readahead *ra = NULL;
+    struct lb_wbuf *wb = NULL;
+    struct lb_file *f;
+    struct stat st;
+    int e = -ENOMEM;
+
+    f = calloc(1, sizeof(*f));
+    if (f == NULL) goto out_fail;
+
+    if (wcap != 0 || cap != 0) {
+        /* Identity for write coalescing and read-ahead  see: wb_sync() data_changed() */
+        if (bk != NULL) {
+            f->dev = bk->dev;
+            f->ino = bk->ino;
+        } else if (fstat(fd, &st) == 0) {
+            f->dev = st.st_dev;
+            f->ino = st.st_ino;
+        } else {
+            e = -errno;
+            goto out_fail;
+        }
+    }
+
+    if (wcap != 0) {
+        if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+            wb = calloc(1, sizeof(*wb));
+            if (wb == NULL) goto out_fail;
+            wb->buf = malloc(wcap);
+            if (wb->buf == NULL) goto out_fail;
+            wb->cap = wcap;
+        }
+    }
+
+    /* Write-only handles never read */
+    if (cap != 0 && (fi->flags & O_ACCMODE) != O_WRONLY) {
+        ra = calloc(1, sizeof(*ra));
+        if (ra == NULL) goto out_fail;
+        ra->buf = malloc(cap);
+        if (ra->buf == NULL) goto out_fail;
+        (void) pthread_mutex_init(&ra->lock, NULL);
+        ra->cap = cap;
+        ra->window = MIN(cap, RA_WINDOW_MIN);
+        ra->next = 0;
+        STAT_INC(ra_live);
+    }
+
+    f->fd = fd;
+    f->bk = bk;
+    f->lock_fd = -1;
+    f->ra = ra;
+    f->wb = wb;
+    fi->fh = (uint64_t) f;
+    fd_gauge_inc(&fd_stats.handles, &fd_stats.handles_max);
+    return 0;
+
+out_fail:
+    if (ra != NULL) free(ra->buf);
+    free(ra);
+    if (wb != NULL) free(wb->buf);
+    free(wb);
+    free(f);
+    (void) fd_close(bk, fd);
+    return e;
+}
+
+/**
+ * @return      0 if dirty data written and close(2) succeeded  -errno otherwise
+ */
+static int lb_file_free(struct lb_file *f)
+{
+    int e = 0;
+    int e2;
+
+    assert_nonnull(f);
+
+    if (f->wb != NULL) {
+        e = wb_sync_file(f);
+        free(f->wb->buf);
+        free(f->wb);
+    }
+    if (f->lock_fd >= 0) {
+        (void) close(f->lock_fd);
+        (void) __atomic_sub_fetch(&fd_stats.fds, 1, __ATOMIC_RELAXED);
+    }
+    e2 = fd_close(f->bk, f->fd);
+    if (e == 0) e = e2;
+    if (f->ra != NULL) {
+        (void) pthread_mutex_destroy(&f->ra->lock);
+        free(f->ra->buf);
+        free(f->ra);
+        (void) __atomic_sub_fetch(&ra_live, 1, __ATOMIC_RELAXED);
+    }
+    free(f);
+    (void) __atomic_sub_fetch(&fd_stats.handles, 1, __ATOMIC_RELAXED);
+    return e;
+}
+
+/**
+ * pread(2) through read-ahead buffer of the handle if any
+ * @return      bytes read  -errno otherwise
+ */
+static ssize_t lb_file_read(
+        struct lb_file *f,
+        char *buf,
+        size_t sz,
+        off_t off)
+{
+    struct lb_readahead *ra = f->ra;
+    uint32_t gen;
+    ssize_t n;
+    off_t end;
+
+    /* Read-after-write  see: wb_sync() */
+    (void) wb_sync(f->dev, f->ino, NULL, off);
+
+    if (ra == NULL) return io_pread(f->fd, buf, sz, off);
+
+    (void) pthread_mutex_lock(&ra->lock);
+    gen = __atomic_load_n(data_gen_slot(f->dev, f->ino), __ATOMIC_ACQUIRE);
+
+    /* A read reaching past EOF of last fill goes to disk  the file may have grown */
+    end = ra->start + (off_t) ra->len;
+    if (ra->len != 0 && off >= ra->start && off + (off_t) sz <= end) {
+        if (ra->gen == gen) {
+            (void) memcpy(buf, ra->buf + (off - ra->start), sz);
+            n = (ssize_t) sz;
+            ra->next = off + n;
+            (void) pthread_mutex_unlock(&ra->lock);
+            STAT_INC(ra_stats.hits);
+            return n;
+        }
+        STAT_INC(ra_stats.stale);
+    }
+    STAT_INC(ra_stats.misses);
+
+    if (off != ra->next) {
+        /* Random access  start over with a small window */
+        ra->window = MIN(ra->cap, RA_WINDOW_MIN);
+        ra->len = 0;
+    } else if (sz < ra->window) {
+        n = io_pread(f->fd, ra->buf, ra->window, off);
+        if (n < 0) {
+            ra->len = 0;
+            (void) pthread_mutex_unlock(&ra->lock);
+            return n;
+        }
+        STAT_INC(ra_stats.fills);
+        (void) __atomic_add_fetch(&ra_stats.bytes, (uint64_t) n, __ATOMIC_RELAXED);
+
+        ra->start = off;
+        ra->len = (size_t) n;
+        ra->gen = gen;
+        ra->window = MIN(ra->window * 2, ra->cap);
+
+        n = (ssize_t) MIN(sz, (size_t) n);
+        (void) memcpy(buf, ra->buf, (size_t) n);
+        ra->next = off + n;
+        (void) pthread_mutex_unlock(&ra->lock);
+        return n;
+    }
+
+    /* Not worth buffering  or larger than the window */
+    n = io_pread(f->fd, buf, sz, off);
+    if (n >= 0) ra->next = off + n;
+    (void) pthread_mutex_unlock(&ra->lock);
+    return n;
+}
+
+static void ra_render_stats(struct sbuf *b)
+{
+    uint64_t hits = STAT_GET(ra_stats.hits);
+    uint64_t misses = STAT_GET(ra_stats.misses);
+
+    if (loopbackfs_cfg.readahead == 0 && hits + misses == 0) return;
+
+    /* Every hit is a pread(2) saved */
+    sbuf_printf(b, "read-ahead  hits(pread saved): %llu misses: %llu hit rate: %.1f%% fills: %llu bytes: %llu stale: %llu\n",
+            (unsigned long long) hits, (unsigned long long) misses,
+            hits + misses ? hits * 100.0 / (hits + misses) : 0.0,
+            (unsigned long long) STAT_GET(ra_stats.fills),
+            (unsigned long long) STAT_GET(ra_stats.bytes),
+            (unsigned long long) STAT_GET(ra_stats.stale));
+}
+
+static void cache_render_stats(struct sbuf *b, const char *name, struct lb_cache *c)
+{
+    uint64_t hits = STAT_GET(c->hits);
+    uint64_t misses = STAT_GET(c->misses);
+
+    /* Every hit of either cache is an lstat(2) saved */
+    sbuf_printf(b, "%s cache  hits(lstat saved): %llu misses: %llu hit rate: %.1f%% invalidations: %llu flushes: %llu\n",
+            name, (unsigned long long) hits, (unsigned long long) misses,
+            hits + misses ? hits * 100.0 / (hits + misses) : 0.0,
+            (unsigned long long) STAT_GET(c->invals),
+            (unsigned long long) STAT_GET(c->flushes));
+}
+
+static void xattr_cache_render_stats(struct sbuf *b)
+{
+    uint64_t hits = STAT_GET(xattr_cache.hits);
+    uint64_t misses = STAT_GET(xattr_cache.misses);
+
+    if (!xattr_cache_enabled() && hits + misses == 0) return;
+
+    /* Every hit is a getxattr(2) or listxattr(2) saved */
+    sbuf_printf(b, "xattr cache  hits: %llu negative hits: %llu misses: %llu hit rate: %.1f%% bypassed: %llu dropped: %llu invalidations: %llu flushes: %llu entries: %llu bytes: %llu\n",
+            (unsigned long long) hits,
+            (unsigned long long) STAT_GET(xattr_cache.neg_hits),
+            (unsigned long long) misses,
+            hits + misses ? hits * 100.0 / (hits + misses) : 0.0,
+            (unsigned long long) STAT_GET(xattr_cache.bypassed),
+            (unsigned long long) STAT_GET(xattr_cache.dropped),
+            (unsigned long long) STAT_GET(xattr_cache.invals),
+            (unsigned long long) STAT_GET(xattr_cache.flushes),
+            (unsigned long long) STAT_GET(xattr_cache.entries),
+            (unsigned long long) STAT_GET(xattr_cache.bytes));
+}
+
+static void xattr_render_stats(struct sbuf *);
+static void sa_render_stats(struct sbuf *);
+static void xtimes_render_stats(struct sbuf *);
+
+/**
+ * Render all statistics as text lines
+ * Caller should sbuf_free() even on failure
+ * @return      0 if success  -ENOMEM otherwise
+ */
+static int lb_stats_render(struct sbuf *b)
+{
+    assert_nonnull(b);
+
+    cache_render_stats(b, "attr", &attr_cache);
+    cache_render_stats(b, "negative", &neg_cache);
+    xattr_cache_render_stats(b);
+    ra_render_stats(b);
+    wb_render_stats(b);
+    io_render_stats(b);
+    fsg_render_stats(b);
+    xattr_render_stats(b);
+    sa_render_stats(b);
+    xtimes_render_stats(b);
+    fd_render_stats(b);
+    opstat_render(b);
+    trace_render(b);
+
+    return b->err ? -ENOMEM : 0;
+}
+
+/**
+ * Dump statistics to syslog(3)
+ * Triggered by SIGUSR1(e.g. `pkill -USR1 loopbackfs') and at unmount
+ */
+static void lb_dump_stats(void)
+{
+    struct sbuf b = {NULL, 0, 0, 0};
+    char *line;
+    char *nl;
+
+    if (lb_stats_render(&b) != 0) SYSLOG_WARN("stats truncated  out of memory");
 
-static struct loopbackfs_config loopbackfs_cfg; /* Zeroed out */
+    for (line = b.p; line != NULL && line < b.p + b.len; line = nl + 1) {
+        nl = strchr(line, '\n');
+        if (nl == NULL) {
+            SYSLOG("%s", line);     /* Truncated last line */
+            break;
+        }
+        *nl = '\0';
+        SYSLOG("%s", line);
+    }
+
+    sbuf_free(&b);
+}
+
+/**
+ * SIGUSR1 is blocked in all threads(see: main())  we wait for it here
+ *  so stats dumping needs no async-signal-safety
+ */
+static void *stats_signal_thread(void *arg)
+{
+    sigset_t set;
+    int sig;
+
+    UNUSED(arg);
+
+    (void) sigemptyset(&set);
+    (void) sigaddset(&set, SIGUSR1);
+
+    while (1) {
+        if (sigwait(&set, &sig) == 0 && sig == SIGUSR1) lb_dump_stats();
+    }
+
+    return NULL;
+}
 
 /*
- * Loopback fs implementation
+ * Virtual control directory at mount root  not backed by the underlying fs
+ *  name configurable via `ctl-dir=' option  empty name disables it
  *
- * NOTE: All following functions return 0 on success  -errno on failure
+ *  stats       lb_stats_render() output
+ *  cache       cache parameters and counters  write `flush [attr|negative]'
+ *  config      current settings  write `key=value' lines for runtime tuning
+ *
+ * Content rendered at open time into a struct sbuf hung off fi->fh
+ *  writes are applied line by line as they arrive
  */
 
-#define RET_TO_ERRNO(e)   ((e < 0) ? -errno : 0)
-#define RET_IF_ERROR(stmt)  if ((stmt) < 0) return -errno
+#define CTL_DIR_DEFAULT     ".loopbackfs"
+
+enum ctl_node {
+    CTL_NONE = 0,   /* Regular path */
+    CTL_ROOT,
+    CTL_STATS,
+    CTL_CACHE,
+    CTL_CONFIG,
+    CTL_BAD,        /* Nonexistent path under control directory */
+};
+
+struct ctl_file {
+    const char *name;
+    int (*render)(struct sbuf *);
+    /* NULL if read-only  @line is NUL-terminated without newline */
+    int (*write)(char *line);
+};
+
+static int cache_render(struct sbuf *);
+static int cache_ctl_write(char *);
+static int config_render(struct sbuf *);
+static int config_ctl_write(char *);
+
+static const struct ctl_file ctl_files[] = {
+    [CTL_STATS] = {"stats", lb_stats_render, NULL},
+    [CTL_CACHE] = {"cache", cache_render, cache_ctl_write},
+    [CTL_CONFIG] = {"config", config_render, config_ctl_write},
+};
+
+static char ctl_prefix[NAME_MAX + 2];   /* "/" followed by control directory name */
+static size_t ctl_prefix_len;           /* Zero if disabled */
+
+/* Serializes runtime tuning writes */
+static pthread_mutex_t ctl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int ctl_init(const char *name)
+{
+    size_t len;
+
+    assert_nonnull(name);
+
+    len = strlen(name);
+    if (len == 0) return 0;     /* Disabled */
+    if (len > NAME_MAX || strchr(name, '/') != NULL ||
+            !strcmp(name, ".") || !strcmp(name, "..")) {
+        return -EINVAL;
+    }
+
+    ctl_prefix[0] = '/';
+    (void) memcpy(ctl_prefix + 1, name, len + 1);
+    ctl_prefix_len = len + 1;
+    return 0;
+}
+
+static enum ctl_node ctl_node(const char *path)
+{
+    const char *p;
+    int i;
+
+    assert_nonnull(path);
+
+    /* Regular paths pay only for this single character comparison */
+    if (ctl_prefix_len == 0 || path[1] != ctl_prefix[1]) return CTL_NONE;
+    if (strncmp(path, ctl_prefix, ctl_prefix_len) != 0) return CTL_NONE;
+
+    p = path + ctl_prefix_len;
+    if (*p == '\0') return CTL_ROOT;
+    if (*p++ != '/') return CTL_NONE;   /* e.g. /.loopbackfsrc */
+
+    for (i = CTL_STATS; i < CTL_BAD; i++) {
+        if (strcmp(p, ctl_files[i].name) == 0) return (enum ctl_node) i;
+    }
+    return CTL_BAD;
+}
+
+/* Reject namespace and attribute changes under control directory */
+#define CTL_DENY(path)      if (ctl_node(path) != CTL_NONE) return -EPERM
+
+static inline int ctl_writable(enum ctl_node n)
+{
+    return n > CTL_ROOT && n < CTL_BAD && ctl_files[n].write != NULL;
+}
+
+static int ctl_getattr(enum ctl_node n, struct stat *st)
+{
+    assert_nonnull(st);
+
+    (void) memset(st, 0, sizeof(*st));
+    st->st_uid = getuid();
+    st->st_gid = getgid();
+
+    if (n == CTL_ROOT) {
+        st->st_mode = S_IFDIR | 0555;   /* r-xr-xr-x */
+        st->st_nlink = 2;
+    } else if (n > CTL_ROOT && n < CTL_BAD) {
+        /* Size unknown till rendered  opened with direct_io */
+        st->st_mode = S_IFREG | (ctl_writable(n) ? 0644 : 0444);
+        st->st_nlink = 1;
+    } else {
+        return -ENOENT;
+    }
+
+    return 0;
+}
+
+static int ctl_open(enum ctl_node n, struct fuse_file_info *fi)
+{
+    struct sbuf *b;
+
+    assert_nonnull(fi);
+
+    if (n == CTL_ROOT) return -EISDIR;
+    if (n == CTL_BAD) return -ENOENT;
+    if ((fi->flags & O_ACCMODE) != O_RDONLY && !ctl_writable(n)) return -EACCES;
+
+    b = calloc(1, sizeof(*b));
+    if (b == NULL) return -ENOMEM;
+
+    if (ctl_files[n].render(b) != 0 || b->err) {
+        sbuf_free(b);
+        free(b);
+        return -ENOMEM;
+    }
+
+    fi->fh = (uint64_t) b;
+    fi->direct_io = 1;
+    return 0;
+}
+
+/**
+ * @return      pointer to content at `off'  *sz trimmed to what's available
+ */
+static const char *ctl_data(struct fuse_file_info *fi, size_t *sz, off_t off)
+{
+    struct sbuf *b;
+
+    assert_nonnull(fi);
+    assert_nonnull(sz);
+
+    b = (struct sbuf *) fi->fh;
+    assert_nonnull(b);
+
+    if (off < 0 || (size_t) off >= b->len) {
+        *sz = 0;
+        return b->p;
+    }
+    if (*sz > b->len - off) *sz = b->len - off;
+    return b->p + off;
+}
+
+/**
+ * Apply each line of a write  file offset is irrelevant
+ * @return      bytes consumed  -errno of the first rejected line otherwise
+ */
+static int ctl_write(enum ctl_node n, const char *buf, size_t sz)
+{
+    char *s;
+    char *line;
+    char *nl;
+    size_t len;
+    int e = 0;
+
+    assert_nonnull(buf);
+
+    if (!ctl_writable(n)) return -EACCES;
+    if (sz > INT_MAX) return -EFBIG;
+
+    s = malloc(sz + 1);
+    if (s == NULL) return -ENOMEM;
+    (void) memcpy(s, buf, sz);
+    s[sz] = '\0';
+
+    (void) pthread_mutex_lock(&ctl_lock);
+    for (line = s; e == 0 && line < s + sz; line = nl + 1) {
+        nl = strchr(line, '\n');
+        if (nl == NULL) nl = s + sz;
+        *nl = '\0';
+
+        len = strlen(line);
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len != 0) e = ctl_files[n].write(line);
+    }
+    (void) pthread_mutex_unlock(&ctl_lock);
+
+    free(s);
+    return e != 0 ? e : (int) sz;
+}
+
+static void ctl_release(struct fuse_file_info *fi)
+{
+    struct sbuf *b;
+
+    assert_nonnull(fi);
+
+    b = (struct sbuf *) fi->fh;
+    if (b != NULL) {
+        sbuf_free(b);
+        free(b);
+    }
+}
+
+static void ctl_readdir(void *buf, fuse_fill_dir_t filler)
+{
+    int i;
+
+    (void) filler(buf, ".", NULL, 0);
+    (void) filler(buf, "..", NULL, 0);
+    for (i = CTL_STATS; i < CTL_BAD; i++) {
+        (void) filler(buf, ctl_files[i].name, NULL, 0);
+    }
+}
+
+/**
+ * Truncating or touching a writable control file(e.g. `echo ... > config')
+ *  is a no-op  anything else is rejected
+ */
+static inline int ctl_settable(enum ctl_node n)
+{
+    return ctl_writable(n) ? 0 : -EPERM;
+}
+
+static int cache_render(struct sbuf *b)
+{
+    sbuf_printf(b, "attr cache  ttl: %.3fs max entries: %u\n",
+            STAT_GET(attr_cache.ttl) / 1e9, loopbackfs_cfg.attr_size);
+    sbuf_printf(b, "negative cache  ttl: %.3fs max entries: %u\n",
+            STAT_GET(neg_cache.ttl) / 1e9, loopbackfs_cfg.neg_size);
+    sbuf_printf(b, "xattr cache  ttl: %.3fs max bytes: %u\n",
+            STAT_GET(xattr_cache.ttl) / 1e9, loopbackfs_cfg.xattr_size);
+    cache_render_stats(b, "attr", &attr_cache);
+    cache_render_stats(b, "negative", &neg_cache);
+    xattr_cache_render_stats(b);
+    return b->err ? -ENOMEM : 0;
+}
+
+static int cache_ctl_write(char *line)
+{
+    assert_nonnull(line);
+
+    if (!strcmp(line, "flush")) {
+        cache_flush(&attr_cache);
+        cache_flush(&neg_cache);
+        xattr_cache_flush();
+    } else if (!strcmp(line, "flush attr")) {
+        cache_flush(&attr_cache);
+    } else if (!strcmp(line, "flush negative")) {
+        cache_flush(&neg_cache);
+    } else if (!strcmp(line, "flush xattr")) {
+        xattr_cache_flush();
+    } else {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int level;
+} log_levels[] = {
+    {"err", LOG_ERR},
+    {"warning", LOG_WARNING},
+    {"notice", LOG_NOTICE},
+};
+
+static int log_level = LOG_NOTICE;
+
+static int config_render(struct sbuf *b)
+{
+    const char *level = "?";
+    size_t i;
+
+    for (i = 0; i < sizeof(log_levels) / sizeof(*log_levels); i++) {
+        if (log_levels[i].level == log_level) level = log_levels[i].name;
+    }
+
+    /* Settings marked with `*' can be changed by writing `key=value' */
+    sbuf_printf(b, "case-insensitive=%d\n", loopbackfs_cfg.ci);
+    sbuf_printf(b, "io=%s\n", loopbackfs_cfg.copy_io ? "copy" : "zero-copy");
+    sbuf_printf(b, "attr-cache-ttl=%g *\n", loopbackfs_cfg.attr_ttl);
+    sbuf_printf(b, "attr-cache-size=%u\n", loopbackfs_cfg.attr_size);
+    sbuf_printf(b, "neg-cache-ttl=%g *\n", loopbackfs_cfg.neg_ttl);
+    sbuf_printf(b, "neg-cache-size=%u\n", loopbackfs_cfg.neg_size);
+    sbuf_printf(b, "xattr-cache-ttl=%g *\n", loopbackfs_cfg.xattr_ttl);
+    sbuf_printf(b, "xattr-cache-size=%u\n", loopbackfs_cfg.xattr_size);
+    sbuf_printf(b, "readdir-plus=%d *\n", loopbackfs_cfg.readdir_plus);
+    sbuf_printf(b, "readdir-batch=%u\n", loopbackfs_cfg.readdir_batch);
+    sbuf_printf(b, "op-stats=%d\n", loopbackfs_cfg.op_stats);
+    sbuf_printf(b, "ctl-dir=%s\n", ctl_prefix + 1);
+    sbuf_printf(b, "trace=%s\n", loopbackfs_cfg.trace ? loopbackfs_cfg.trace : "");
+    sbuf_printf(b, "readahead=%u *\n", loopbackfs_cfg.readahead);
+    sbuf_printf(b, "write-coalesce=%u\n", loopbackfs_cfg.write_coalesce);
+    sbuf_printf(b, "io-backend=%s\n", io_backend()->name);
+    sbuf_printf(b, "io-depth=%u\n", loopbackfs_cfg.io_depth);
+    sbuf_printf(b, "fsync-group=%u *\n", loopbackfs_cfg.fsync_group);
+    sbuf_printf(b, "full-fsync=%d\n", loopbackfs_cfg.full_fsync);
+    sbuf_printf(b, "fd-share=%d *\n", loopbackfs_cfg.fd_share);
+    sbuf_printf(b, "log-level=%s *\n", level);
+
+    return b->err ? -ENOMEM : 0;
+}
+
+/**
+ * @return      0 if `s' is a whole non-negative number
+ */
+static int parse_ttl(const char *s, double *out)
+{
+    char *end;
+    double d;
+
+    errno = 0;
+    d = strtod(s, &end);
+    if (errno != 0 || end == s || *end != '\0' || !(d >= 0)) return -EINVAL;
+    *out = d;
+    return 0;
+}
+
+/**
+ * @return      0 if `s' is a whole number fitting in unsigned
+ */
+static int parse_size(const char *s, unsigned *out)
+{
+    unsigned long long v;
+    char *end;
+
+    errno = 0;
+    v = strtoull(s, &end, 10);
+    if (errno != 0 || end == s || *end != '\0' || *s == '-' || v > UINT_MAX) return -EINVAL;
+    *out = (unsigned) v;
+    return 0;
+}
+
+/**
+ * Called with ctl_lock held
+ */
+static int config_ctl_write(char *line)
+{
+    unsigned size;
+    char *val;
+    double ttl;
+    size_t i;
+    int e;
+
+    assert_nonnull(line);
+
+    val = strchr(line, '=');
+    if (val == NULL) return -EINVAL;
+    *val++ = '\0';
+
+    if (!strcmp(line, "attr-cache-ttl")) {
+        if ((e = parse_ttl(val, &ttl)) != 0) return e;
+        /* see: lb_setup() */
+        if (ttl == 0 && loopbackfs_cfg.readdir_plus) return -EINVAL;
+        if ((e = cache_set_ttl(&attr_cache, ttl, loopbackfs_cfg.attr_size)) != 0) return e;
+        loopbackfs_cfg.attr_ttl = ttl;
+    } else if (!strcmp(line, "neg-cache-ttl")) {
+        if ((e = parse_ttl(val, &ttl)) != 0) return e;
+        if ((e = cache_set_ttl(&neg_cache, ttl, loopbackfs_cfg.neg_size)) != 0) return e;
+        loopbackfs_cfg.neg_ttl = ttl;
+    } else if (!strcmp(line, "xattr-cache-ttl")) {
+        if ((e = parse_ttl(val, &ttl)) != 0) return e;
+        if ((e = xattr_cache_set_ttl(ttl)) != 0) return e;
+        loopbackfs_cfg.xattr_ttl = ttl;
+    } else if (!strcmp(line, "readdir-plus")) {
+        if (strcmp(val, "0") && strcmp(val, "1")) return -EINVAL;
+        if (*val == '1' && !cache_enabled(&attr_cache)) return -EINVAL;
+        /* Takes effect from next opendir() */
+        loopbackfs_cfg.readdir_plus = *val == '1';
+    } else if (!strcmp(line, "readahead")) {
+        if ((e = parse_size(val, &size)) != 0) return e;
+        /* Takes effect from next open() */
+        loopbackfs_cfg.readahead = size;
+    } else if (!strcmp(line, "fsync-group")) {
+        if ((e = parse_size(val, &size)) != 0) return e;
+        if (size != 0 && fsg_unsupported() != NULL) return -ENOTSUP;
+        /* Read by next fsync()  a batch already waiting keeps its window */
+        loopbackfs_cfg.fsync_group = size;
+    } else if (!strcmp(line, "fd-share")) {
+        if (strcmp(val, "0") && strcmp(val, "1")) return -EINVAL;
+        /* Takes effect from next open()  shared fds stay shared until released */
+        __atomic_store_n(&loopbackfs_cfg.fd_share, *val == '1', __ATOMIC_RELAXED);
+    } else if (!strcmp(line, "log-level")) {
+        for (i = 0; i < sizeof(log_levels) / sizeof(*log_levels); i++) {
+            if (!strcmp(val, log_levels[i].name)) break;
+        }
+        if (i == sizeof(log_levels) / sizeof(*log_levels)) return -EINVAL;
+        log_level = log_levels[i].level;
+        (void) setlogmask(LOG_UPTO(log_level));
+    } else {
+        return -EINVAL;
+    }
+
+    SYSLOG("config  %s=%s", line, val);
+    return 0;
+}
 
 /**
  * Get file attributes.
@@ -62,26 +3643,43 @@ static struct loopbackfs_config loopbackfs_cfg; /* Zeroed out */
  */
 static int lb_getattr(const char *path, struct stat *stbuf)
 {
+    struct cache_ticket t;
+    struct cache_ticket nt;
+    enum ctl_node n;
     int e;
 
     assert_nonnull(path);
     assert_nonnull(stbuf);
 
+    n = ctl_node(path);
+    if (n != CTL_NONE) return ctl_getattr(n, stbuf);
+
+    if (cache_lookup(&attr_cache, path, stbuf, &t)) return 0;
+    if (cache_lookup(&neg_cache, path, NULL, &nt)) return -ENOENT;
+
     e = lstat(path, stbuf);
-    if (e == 0) {
+    if (e != 0) {
+        e = -errno;
+        if (e == -ENOENT) cache_put(&neg_cache, path, NULL, &nt);
+        return e;
+    }
+
+    /* Size and times must include buffered writes */
+    if (wb_sync_stat(stbuf)) RET_IF_ERROR(lstat(path, stbuf));
+
 #if FUSE_VERSION >= 29
-        /*
-         * [sic]
-         * The optimal I/O size can be set on a per-file basis.
-         * Setting st_blksize to zero will cause the kernel extension to
-         *  fall back on the global I/O size
-         *  which can be specified at mount-time (option iosize).
-         */
-        stbuf->st_blksize = 0;
+    /*
+     * [sic]
+     * The optimal I/O size can be set on a per-file basis.
+     * Setting st_blksize to zero will cause the kernel extension to
+     *  fall back on the global I/O size
+     *  which can be specified at mount-time (option iosize).
+     */
+    stbuf->st_blksize = 0;
 #endif
-    }
 
-    return RET_TO_ERRNO(e);
+    cache_put(&attr_cache, path, stbuf, &t);
+    return 0;
 }
 
 /**
@@ -120,12 +3718,14 @@ static int lb_mknod(const char *path, mode_t mode, dev_t dev)
     int e;
 
     assert_nonnull(path);
+    CTL_DENY(path);
 
     if (S_ISFIFO(mode)) {
         e = mkfifo(path, mode);
     } else {
         e = mknod(path, mode, dev);
     }
+    if (e == 0) entry_changed(path);
 
     return RET_TO_ERRNO(e);
 }
@@ -140,12 +3740,15 @@ static int lb_mknod(const char *path, mode_t mode, dev_t dev)
 static int lb_mkdir(const char *path, mode_t mode)
 {
     assert_nonnull(path);
+    CTL_DENY(path);
 
     if (!(mode | S_IFDIR)) {
         SYSLOG_WARN("mkdir()  mode %#x without type spec.", mode);
     }
 
-    return RET_TO_ERRNO(mkdir(path, mode | S_IFDIR));
+    RET_IF_ERROR(mkdir(path, mode | S_IFDIR));
+    entry_changed(path);
+    return 0;
 }
 
 /**
@@ -154,14 +3757,20 @@ static int lb_mkdir(const char *path, mode_t mode)
 static int lb_unlink(const char *path)
 {
     assert_nonnull(path);
-    return RET_TO_ERRNO(unlink(path));
+    CTL_DENY(path);
+    RET_IF_ERROR(unlink(path));
+    entry_changed(path);
+    return 0;
 }
 
 /** Remove a directory */
 static int lb_rmdir(const char *path)
 {
     assert_nonnull(path);
-    return RET_TO_ERRNO(rmdir(path));
+    CTL_DENY(path);
+    RET_IF_ERROR(rmdir(path));
+    entry_changed(path);
+    return 0;
 }
 
 /**
@@ -171,7 +3780,12 @@ static int lb_symlink(const char *dst, const char *lnk)
 {
     assert_nonnull(dst);
     assert_nonnull(lnk);
-    return RET_TO_ERRNO(symlink(dst, lnk));
+    CTL_DENY(lnk);
+    RET_IF_ERROR(symlink(dst, lnk));
+    entry_changed(lnk);
+    /* Paths through the new link may resolve now */
+    cache_flush(&neg_cache);
+    return 0;
 }
 
 /**
@@ -179,9 +3793,31 @@ static int lb_symlink(const char *dst, const char *lnk)
  */
 static int lb_rename(const char *old, const char *new)
 {
+    struct stat st;
+
     assert_nonnull(old);
     assert_nonnull(new);
-    return RET_TO_ERRNO(rename(old, new));
+    CTL_DENY(old);
+    CTL_DENY(new);
+
+    RET_IF_ERROR(rename(old, new));
+
+    if (cache_enabled(&attr_cache) || cache_enabled(&neg_cache) || xattr_cache_enabled()) {
+        if (lstat(new, &st) != 0 || S_ISDIR(st.st_mode) || S_ISLNK(st.st_mode)) {
+            /*
+             * Every cached path below the old directory is stale now
+             *  and missing paths below the new one may exist now
+             */
+            cache_flush(&attr_cache);
+            cache_flush(&neg_cache);
+            xattr_cache_flush();
+        } else {
+            entry_changed(old);
+            entry_changed(new);
+        }
+    }
+
+    return 0;
 }
 
 /**
@@ -191,7 +3827,13 @@ static int lb_link(const char *dst, const char *lnk)
 {
     assert_nonnull(dst);
     assert_nonnull(lnk);
-    return RET_TO_ERRNO(link(dst, lnk));
+    CTL_DENY(dst);
+    CTL_DENY(lnk);
+    RET_IF_ERROR(link(dst, lnk));
+    /* st_nlink changed for every name of this file */
+    cache_flush(&attr_cache);
+    cache_invalidate(&neg_cache, lnk);
+    return 0;
 }
 
 /**
@@ -200,7 +3842,10 @@ static int lb_link(const char *dst, const char *lnk)
 static int lb_chmod(const char *path, mode_t mode)
 {
     assert_nonnull(path);
-    return chmod(path, mode);
+    CTL_DENY(path);
+    RET_IF_ERROR(chmod(path, mode));
+    attr_changed(path);
+    return 0;
 }
 
 /**
@@ -209,7 +3854,10 @@ static int lb_chmod(const char *path, mode_t mode)
 static int lb_chown(const char *path, uid_t owner, gid_t group)
 {
     assert_nonnull(path);
-    return RET_TO_ERRNO(chown(path, owner, group));
+    CTL_DENY(path);
+    RET_IF_ERROR(chown(path, owner, group));
+    attr_changed(path);
+    return 0;
 }
 
 /**
@@ -217,9 +3865,21 @@ static int lb_chown(const char *path, uid_t owner, gid_t group)
  */
 static int lb_truncate(const char *path, off_t len)
 {
+    enum ctl_node n;
+
     assert_nonnull(path);
+
+    n = ctl_node(path);
+    if (n != CTL_NONE) return ctl_settable(n);
+
+    /* Buffered writes come first  or they'd extend the file back */
+    wb_sync_path(path);
+
     /* Don't assert(len >= 0)  truncate(2) will return EINVAL if it's negative */
-    return RET_TO_ERRNO(truncate(path, len));
+    RET_IF_ERROR(truncate(path, len));
+    attr_changed(path);
+    data_changed(path);
+    return 0;
 }
 
 /**
@@ -242,15 +3902,28 @@ static int lb_truncate(const char *path, off_t len)
  */
 static int lb_open(const char *path, struct fuse_file_info *fi)
 {
+    struct lb_backing *bk;
+    enum ctl_node n;
     int fd;
 
     assert_nonnull(path);
     assert_nonnull(fi);
 
-    fd = open(path, fi->flags);
-    if (fd >= 0) fi->fh = fd;
+    n = ctl_node(path);
+    if (n != CTL_NONE) return ctl_open(n, fi);
+
+    /* see: lb_truncate() */
+    if (fi->flags & O_TRUNC) wb_sync_path(path);
 
-    return RET_TO_ERRNO(fd);
+    fd = fd_open(path, fi->flags, 0, &bk);
+    if (fd < 0) return fd;
+
+    if (fi->flags & O_TRUNC) {
+        attr_changed(path);
+        data_changed(path);
+    }
+
+    return lb_file_new(fi, fd, bk);
 }
 
 /**
@@ -272,6 +3945,7 @@ static int lb_read(
         off_t off,
         struct fuse_file_info *fi)
 {
+    const char *data;
     ssize_t n;
 
     assert_nonnull(path);
@@ -279,8 +3953,14 @@ static int lb_read(
     /* Don't assert(off >= 0)  pread(2) will return EINVAL if it's negative */
     assert_nonnull(fi);
 
-    n = pread((int) fi->fh, buf, sz, off);
-    RET_IF_ERROR(n);
+    if (ctl_node(path) != CTL_NONE) {
+        data = ctl_data(fi, &sz, off);
+        (void) memcpy(buf, data, sz);
+        return (int) sz;
+    }
+
+    n = lb_file_read(get_file(fi), buf, sz, off);
+    if (n < 0) return (int) n;
     assert((n & ~0x7fffffffULL) == 0);
     return (int) n;
 }
@@ -301,17 +3981,159 @@ static int lb_write(
         off_t off,
         struct fuse_file_info *fi)
 {
+    enum ctl_node node;
     ssize_t n;
 
     assert_nonnull(path);
     assert(!!buf | !sz);    /* Fail if buf is NULL yet sz not zero */
     assert_nonnull(fi);
 
-    n = pwrite((int) fi->fh, buf, sz, off);
-    RET_IF_ERROR(n);
+    node = ctl_node(path);
+    if (node != CTL_NONE) return ctl_write(node, buf, sz);
+
+    n = lb_file_write(get_file(fi), buf, sz, off);
+    if (n < 0) return (int) n;
+    attr_changed(path);
+    data_changed_file(get_file(fi));
+    assert((n & ~0x7fffffffULL) == 0);
+    return (int) n;
+}
+
+#if FUSE_VERSION >= 29
+/**
+ * Read data from an open file without copying it through user space
+ *
+ * Instead of filling a memory buffer  we hand libfuse a fd-backed buffer
+ *  fuse_buf_copy() will later move data straight from the backing fd
+ *  into the reply(splice(2) where libfuse supports it  a single read otherwise)
+ *
+ * *bufp is allocated here and freed by libfuse after reply.
+ */
+static int lb_read_buf(
+        const char *path,
+        struct fuse_bufvec **bufp,
+        size_t sz,
+        off_t off,
+        struct fuse_file_info *fi)
+{
+    struct fuse_bufvec *src;
+    const char *data;
+    struct lb_file *f;
+    ssize_t n;
+
+    assert_nonnull(path);
+    assert_nonnull(bufp);
+    assert_nonnull(fi);
+
+    if (ctl_node(path) != CTL_NONE) {
+        /*
+         * Content lives in the handle's sbuf till release
+         *  hand libfuse a copy it can free
+         */
+        data = ctl_data(fi, &sz, off);
+        src = malloc(sizeof(*src));
+        if (src == NULL) return -ENOMEM;
+        *src = FUSE_BUFVEC_INIT(sz);
+        src->buf[0].mem = malloc(sz ? sz : 1);
+        if (src->buf[0].mem == NULL) {
+            free(src);
+            return -ENOMEM;
+        }
+        (void) memcpy(src->buf[0].mem, data, sz);
+        *bufp = src;
+        return 0;
+    } else if ((f = get_file(fi))->ra != NULL || io_async()) {
+        /*
+         * Read-ahead and async backends hand out a memory buffer
+         *  libfuse frees buf[0].mem and the bufvec separately after reply
+         *  see: fuse_free_buf()
+         */
+        src = malloc(sizeof(*src));
+        if (src == NULL) return -ENOMEM;
+        *src = FUSE_BUFVEC_INIT(sz);
+        src->buf[0].mem = malloc(sz ? sz : 1);
+        if (src->buf[0].mem == NULL) {
+            free(src);
+            return -ENOMEM;
+        }
+        n = lb_file_read(f, src->buf[0].mem, sz, off);
+        if (n < 0) {
+            free(src->buf[0].mem);
+            free(src);
+            return (int) n;
+        }
+        src->buf[0].size = (size_t) n;
+        *bufp = src;
+        return 0;
+    }
+
+    src = malloc(sizeof(*src));
+    if (src == NULL) return -ENOMEM;
+
+    *src = FUSE_BUFVEC_INIT(sz);
+    /* Read-after-write  see: wb_sync() */
+    (void) wb_sync(f->dev, f->ino, NULL, off);
+
+    src->buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+    src->buf[0].fd = f->fd;
+    src->buf[0].pos = off;
+
+    *bufp = src;
+    return 0;
+}
+
+/**
+ * Write data to an open file without an intermediate user space copy
+ * see: lb_read_buf()
+ */
+static int lb_write_buf(
+        const char *path,
+        struct fuse_bufvec *buf,
+        off_t off,
+        struct fuse_file_info *fi)
+{
+    struct fuse_bufvec dst = FUSE_BUFVEC_INIT(fuse_buf_size(buf));
+    enum ctl_node node;
+    struct lb_file *f;
+    ssize_t n;
+
+    assert_nonnull(path);
+    assert_nonnull(buf);
+    assert_nonnull(fi);
+
+    node = ctl_node(path);
+    if (node != CTL_NONE) {
+        /* Gather into memory  control writes are tiny */
+        dst.buf[0].mem = malloc(dst.buf[0].size);
+        if (dst.buf[0].mem == NULL) return -ENOMEM;
+        n = fuse_buf_copy(&dst, buf, 0);
+        if (n >= 0) n = ctl_write(node, dst.buf[0].mem, (size_t) n);
+        free(dst.buf[0].mem);
+        return (int) n;
+    }
+
+    f = get_file(fi);
+    if ((f->wb != NULL || io_async()) &&
+            buf->count == 1 && !(buf->buf[0].flags & FUSE_BUF_IS_FD)) {
+        /* Already in memory  go through write buffer or backend as lb_write() does */
+        n = lb_file_write(f, buf->buf[0].mem, buf->buf[0].size, off);
+    } else {
+        /* Piped data goes straight to fd  older buffered data first */
+        if (f->wb != NULL && (n = wb_sync_file(f)) != 0) return (int) n;
+
+        dst.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+        dst.buf[0].fd = f->fd;
+        dst.buf[0].pos = off;
+
+        n = fuse_buf_copy(&dst, buf, FUSE_BUF_SPLICE_NONBLOCK);
+    }
+    if (n < 0) return (int) n;  /* -errno */
+    attr_changed(path);
+    data_changed_file(f);
     assert((n & ~0x7fffffffULL) == 0);
     return (int) n;
 }
+#endif
 
 /**
  * Get file system statistics
@@ -326,6 +4148,9 @@ static int lb_statfs(const char *path, struct statvfs *st)
     assert_nonnull(path);
     assert_nonnull(st);
 
+    /* Control directory lives on the mount root volume */
+    if (ctl_node(path) != CTL_NONE) path = "/";
+
     return RET_TO_ERRNO(statvfs(path, st));
 }
 
@@ -336,13 +4161,20 @@ static int lb_statfs(const char *path, struct statvfs *st)
 static int lb_flush(const char *path, struct fuse_file_info *fi)
 {
     int fd;
+    int e;
 
     assert_nonnull(path);
     assert_nonnull(fi);
 
-    fd = dup((int) fi->fh);
-    if (fd < 0) return RET_TO_ERRNO(fd);
-    return RET_TO_ERRNO(close(fd));
+    if (ctl_node(path) != CTL_NONE) return 0;
+
+    /* close(2) is where write errors get reported */
+    e = wb_sync_file(get_file(fi));
+
+    fd = dup(lb_fd(fi));
+    if (fd < 0) return e != 0 ? e : RET_TO_ERRNO(fd);
+    if (close(fd) != 0 && e == 0) e = -errno;
+    return e;
 }
 
 /**
@@ -354,7 +4186,12 @@ static int lb_release(const char *path, struct fuse_file_info *fi)
     assert_nonnull(path);
     assert_nonnull(fi);
 
-    return RET_TO_ERRNO(close((int) fi->fh));
+    if (ctl_node(path) != CTL_NONE) {
+        ctl_release(fi);
+        return 0;
+    }
+
+    return lb_file_free(get_file(fi));
 }
 
 /**
@@ -372,13 +4209,15 @@ static int lb_fsync(
         int datasync,
         struct fuse_file_info *fi)
 {
+    int e, e2;
+
     assert_nonnull(path);
     assert_nonnull(fi);
-#if USE_FULL_FSYNC
-    return RET_TO_ERRNO(fcntl((int) fi->fh, F_FULLFSYNC));
-#else
-    return RET_TO_ERRNO(fsync((int) fi->fh));
-#endif
+    if (ctl_node(path) != CTL_NONE) return 0;
+
+    e = wb_sync_file(get_file(fi));
+    e2 = lb_sync_fd(lb_fd(fi), datasync);
+    return e != 0 ? e : e2;
 }
 
 #define XATTR_APPLE_PREFIX          "com.apple."
@@ -394,6 +4233,9 @@ static const char *map_xattr_name(const char *name)
     return strcmp(name, A_KAUTH_FILESEC_XATTR) ? name : P_KAUTH_FILESEC_XATTR;
 }
 
+/* Bumped by setxattr()  removexattr()  see: lb_listxattr() */
+static uint32_t xattr_gen;
+
 /**
  * Set extended attributes
  */
@@ -410,6 +4252,7 @@ static int lb_setxattr(
     assert_nonnull(path);
     assert_nonnull(name);
     assert(!!value || !size);
+    CTL_DENY(path);
 
     if (!strncmp(name, XATTR_APPLE_PREFIX, STRLEN(XATTR_APPLE_PREFIX))) {
         /*
@@ -424,6 +4267,11 @@ static int lb_setxattr(
     }
 
     e = setxattr(path, map_xattr_name(name), value, size, position, options);
+    if (e == 0) {
+        attr_changed(path);
+        xattr_changed(path);
+        (void) __atomic_add_fetch(&xattr_gen, 1, __ATOMIC_RELEASE);
+    }
     return RET_TO_ERRNO(e);
 }
 
@@ -441,18 +4289,185 @@ static int lb_getxattr(
         uint32_t position)
 {
     static int options = XATTR_NOFOLLOW;
+    struct cache_ticket t;
+    char buf[XATTR_VALUE_MAX];
     ssize_t sz;
+    int e;
 
     assert_nonnull(path);
     assert_nonnull(name);
 
+    if (ctl_node(path) != CTL_NONE) return -ENOATTR;
+
+    if (xattr_cache_enabled()) {
+        /*
+         * Resource fork reads are served piecewise and never fail with ERANGE
+         *  a short buffer would cache a truncated fork
+         * The empty name is where the name list lives(see: lb_listxattr())
+         */
+        if (position != 0 || *name == '\0' || !strcmp(name, XATTR_RESOURCEFORK_NAME)) {
+            STAT_INC(xattr_cache.bypassed);
+            goto out_direct;
+        }
+
+        if (xattr_cache_lookup(path, name, value, size, &t, &e)) return e;
+
+        sz = getxattr(path, map_xattr_name(name), buf, sizeof(buf), 0, options);
+        if (sz < 0) {
+            e = -errno;
+            if (e == -ENOATTR) xattr_cache_put(path, name, NULL, 0, e, &t);
+            if (e != -ERANGE) return e;
+            /* Too large to cache */
+            STAT_INC(xattr_cache.bypassed);
+            goto out_direct;
+        }
+
+        xattr_cache_put(path, name, buf, (size_t) sz, 0, &t);
+        if (size == 0) return (int) sz;
+        if (size < (size_t) sz) return -ERANGE;
+        (void) memcpy(value, buf, (size_t) sz);
+        return (int) sz;
+    }
+
+out_direct:
     sz = getxattr(path, map_xattr_name(name), value, size, position, options);
     RET_IF_ERROR(sz);
     assert((sz & ~0x7fffffffULL) == 0);
     return (int) sz;
 }
 
-#define USE_STRICT_LISTXATTR_SIZE       1
+/*
+ * listxattr() scratch  one per thread
+ *
+ * The kernel asks for the size of the name list(namebuf NULL) and then
+ *  for the names  we fetch the list once on the size probe  hide
+ *  P_KAUTH_FILESEC_XATTR in one pass  and serve the names call from it
+ *  if it comes next on the same thread for the same path  soon enough
+ *  and no xattr changed through this fs in between(see: xattr_gen)
+ * Otherwise it's a plain refetch  e.g. the two calls landed on different workers
+ */
+
+#define XATTR_SCRATCH_MIN       1024
+#define XATTR_PROBE_TTL_NS      (100 * 1000000ULL)
+
+struct xattr_scratch {
+    char *buf;
+    size_t cap;
+    size_t len;             /* Filtered name list in buf */
+    char path[PATH_MAX];    /* Probed path  empty if nothing to serve */
+    uint32_t gen;
+    uint64_t at;
+};
+
+static pthread_key_t xattr_key;
+static pthread_once_t xattr_once = PTHREAD_ONCE_INIT;
+static int xattr_key_ok;
+
+static struct {
+    uint64_t fetches;       /* listxattr(2) calls */
+    uint64_t served;        /* Names calls answered from the size probe */
+} xattr_stats;
+
+static void xattr_scratch_free(void *arg)
+{
+    struct xattr_scratch *x = (struct xattr_scratch *) arg;
+    free(x->buf);
+    free(x);
+}
+
+static void xattr_key_init(void)
+{
+    xattr_key_ok = pthread_key_create(&xattr_key, xattr_scratch_free) == 0;
+}
+
+static struct xattr_scratch *xattr_self(void)
+{
+    struct xattr_scratch *x;
+
+    (void) pthread_once(&xattr_once, xattr_key_init);
+    if (!xattr_key_ok) return NULL;
+
+    x = (struct xattr_scratch *) pthread_getspecific(xattr_key);
+    if (x != NULL) return x;
+
+    x = calloc(1, sizeof(*x));
+    if (x == NULL) return NULL;
+    x->buf = malloc(XATTR_SCRATCH_MIN);
+    if (x->buf == NULL || pthread_setspecific(xattr_key, x) != 0) {
+        free(x->buf);
+        free(x);
+        return NULL;
+    }
+    x->cap = XATTR_SCRATCH_MIN;
+    return x;
+}
+
+/**
+ * Drop names user space shouldn't see  compacting in place
+ * @return      new length of `buf'
+ */
+static size_t xattr_filter(char *buf, size_t len)
+{
+    size_t i = 0, out = 0;
+    size_t n;
+
+    while (i < len) {
+        n = strnlen(buf + i, len - i) + 1;
+        if (n > len - i) n = len - i;
+
+        /* Don't expose fake A_KAUTH_FILESEC_XATTR to user space */
+        if (strcmp(buf + i, P_KAUTH_FILESEC_XATTR)) {
+            if (out != i) (void) memmove(buf + out, buf + i, n);
+            out += n;
+        }
+        i += n;
+    }
+
+    return out;
+}
+
+/**
+ * Filtered listxattr(2) of `path' into scratch
+ * @return      0 if success  -errno otherwise
+ */
+static int xattr_fetch(struct xattr_scratch *x, const char *path, int options)
+{
+    ssize_t rd;
+    size_t cap;
+    char *p;
+
+    for (;;) {
+        STAT_INC(xattr_stats.fetches);
+        rd = listxattr(path, x->buf, x->cap, options);
+        if (rd >= 0) break;
+        if (errno != ERANGE) return -errno;
+
+        /* Outgrew scratch  it only grows */
+        STAT_INC(xattr_stats.fetches);
+        rd = listxattr(path, NULL, 0, options);
+        if (rd < 0) return -errno;
+        cap = MAX((size_t) rd, x->cap * 2);
+        p = realloc(x->buf, cap);
+        if (p == NULL) return -ENOMEM;
+        x->buf = p;
+        x->cap = cap;
+    }
+
+    x->len = xattr_filter(x->buf, (size_t) rd);
+    return 0;
+}
+
+static void xattr_render_stats(struct sbuf *b)
+{
+    uint64_t fetches = STAT_GET(xattr_stats.fetches);
+    uint64_t served = STAT_GET(xattr_stats.served);
+
+    if (fetches + served == 0) return;
+
+    /* Every served call is a listxattr(2) saved */
+    sbuf_printf(b, "listxattr  fetches(listxattr): %llu served from probe: %llu\n",
+            (unsigned long long) fetches, (unsigned long long) served);
+}
 
 /**
  * List extended attributes
@@ -463,50 +4478,53 @@ static int lb_getxattr(
 static int lb_listxattr(const char *path, char *namebuf, size_t size)
 {
     static int options = XATTR_NOFOLLOW;
-    ssize_t rd;
+    struct xattr_scratch *x;
+    struct cache_ticket t;
+    uint32_t gen;
+    size_t len;
+    int e;
 
     assert_nonnull(path);
 
-    rd = listxattr(path, namebuf, size, options);
-    if (rd > 0) {
-        if (namebuf != NULL) {
-            size_t len = 0;
-            char *curr = namebuf;
-            size_t currlen;
+    if (ctl_node(path) != CTL_NONE) return 0;
 
-            do {
-                currlen = strlen(curr) + 1;
+    /* Name list cached under the empty name */
+    if (xattr_cache_lookup(path, "", namebuf, size, &t, &e)) return e;
 
-                /* Don't expose fake A_KAUTH_FILESEC_XATTR to user space */
-                if (!strcmp(curr, P_KAUTH_FILESEC_XATTR)) {
-                    (void) memmove(curr, curr + currlen, rd - len - currlen);
-                    rd -= currlen;
-                    break;
-                }
+    x = xattr_self();
+    if (x == NULL) return -ENOMEM;
+
+    gen = __atomic_load_n(&xattr_gen, __ATOMIC_ACQUIRE);
+    if (namebuf != NULL && x->path[0] != '\0' && x->gen == gen &&
+            now_ns() - x->at < XATTR_PROBE_TTL_NS && !strcmp(x->path, path)) {
+        STAT_INC(xattr_stats.served);
+    } else {
+        e = xattr_fetch(x, path, options);
+        if (e != 0) {
+            x->path[0] = '\0';
+            return e;
+        }
+        if (x->len <= XATTR_VALUE_MAX) xattr_cache_put(path, "", x->buf, x->len, 0, &t);
+    }
 
-                curr += currlen;
-                len += currlen;
-            } while (len < rd);
+    if (namebuf == NULL) {
+        /* Size is exact  names call expected next */
+        len = strlen(path);
+        if (len < sizeof(x->path)) {
+            (void) memcpy(x->path, path, len + 1);
+            x->gen = gen;
+            x->at = now_ns();
         } else {
-#if USE_STRICT_LISTXATTR_SIZE
-            /*
-             * listxattr(2) don't have to return strict name buffer size
-             *  since it's only a snapshot
-             * if we don't check P_KAUTH_FILESEC_XATTR
-             *  which we may overcommit return name buffer size(if it present)
-             *  it's fine and we reduced a syscall call(getxattr)
-             */
-            ssize_t rd2 = getxattr(path, P_KAUTH_FILESEC_XATTR, NULL, 0, 0, options);
-            if (rd2 >= 0) rd -= STRLEN(P_KAUTH_FILESEC_XATTR) + 1;
-            /* FIXME: potential TOCTOU bug */
-            assert(rd >= 0);
-#endif
+            x->path[0] = '\0';
         }
+    } else {
+        x->path[0] = '\0';
+        if (size < x->len) return -ERANGE;
+        (void) memcpy(namebuf, x->buf, x->len);
     }
 
-    RET_IF_ERROR(rd);
-    assert((rd & ~0x7fffffffULL) == 0);
-    return (int) rd;
+    assert((x->len & ~0x7fffffffULL) == 0);
+    return (int) x->len;
 }
 
 /**
@@ -522,17 +4540,273 @@ static int lb_removexattr(const char *path, const char *name)
 
     assert_nonnull(path);
     assert_nonnull(name);
+    CTL_DENY(path);
 
     e = removexattr(path, map_xattr_name(name), options);
+    if (e == 0) {
+        attr_changed(path);
+        xattr_changed(path);
+        (void) __atomic_add_fetch(&xattr_gen, 1, __ATOMIC_RELEASE);
+    }
     return RET_TO_ERRNO(e);
 }
 
+struct dirp_entry {
+    ino_t ino;
+    uint32_t name;      /* Offset into loopback_dirp.names */
+    uint8_t type;       /* d_type */
+};
+
+/*
+ * Directory handle
+ *
+ * Entries are read in batches of `readdir-batch' into a snapshot window
+ *  offsets handed to the filler are stable stream indexes(cookies)
+ *  so a resumed readdir() positions itself in O(1) within the window
+ * telldir(3) of window starts is remembered  thusly seeking back to an
+ *  old cookie reloads a single window instead of re-scanning from start
+ * At most DIRP_MARKS_MAX marks are kept  past that every other one is
+ *  dropped and a window between two marks is reached by skipping entries
+ */
+
+#define DIRP_MARKS_MAX      256
+
 struct loopback_dirp {
     DIR *dp;
-    struct dirent *entry;
-    off_t offset;
+
+    struct dirp_entry *ents;    /* readdir_batch slots */
+    size_t base;                /* Stream index of ents[0] */
+    size_t count;               /* Valid entries in window */
+    int eof;                    /* Window reaches end of directory */
+
+    char *names;                /* Name arena of current window */
+    size_t names_len;
+    size_t names_cap;
+
+    long *marks;                /* telldir() at start of window j * stride */
+    size_t nmarks;
+    size_t marks_cap;
+    size_t stride;              /* Windows per mark  a power of two */
+    size_t known;               /* Windows whose start has been reached */
+    size_t stream_window;       /* Window DIR stream positioned at  SIZE_MAX if unknown */
+
+    /* Child path buffer for `readdir-plus'  NULL if disabled */
+    char *path;
+    size_t pathlen;     /* Directory prefix length including trailing '/' */
 };
 
+static int dirp_add_mark(struct loopback_dirp *d, long pos)
+{
+    long *p;
+    size_t j;
+
+    if (d->nmarks == DIRP_MARKS_MAX) {
+        /* Keep marks of even index  i.e. every other window start */
+        for (j = 0; j * 2 < d->nmarks; j++) d->marks[j] = d->marks[j * 2];
+        d->nmarks = j;
+        d->stride *= 2;
+    }
+
+    if (d->nmarks == d->marks_cap) {
+        p = realloc(d->marks, (d->marks_cap ? d->marks_cap * 2 : 16) * sizeof(*p));
+        if (p == NULL) return -ENOMEM;
+        d->marks = p;
+        d->marks_cap = d->marks_cap ? d->marks_cap * 2 : 16;
+    }
+
+    d->marks[d->nmarks++] = pos;
+    return 0;
+}
+
+static int dirp_add_name(struct loopback_dirp *d, const char *name, uint32_t *off)
+{
+    size_t len = strlen(name) + 1;
+    size_t cap;
+    char *p;
+
+    if (d->names_len + len > d->names_cap) {
+        cap = d->names_cap ? d->names_cap : 4096;
+        while (d->names_len + len > cap) cap *= 2;
+        p = realloc(d->names, cap);
+        if (p == NULL) return -ENOMEM;
+        d->names = p;
+        d->names_cap = cap;
+    }
+
+    *off = (uint32_t) d->names_len;
+    (void) memcpy(d->names + d->names_len, name, len);
+    d->names_len += len;
+    return 0;
+}
+
+/**
+ * Start over from the beginning of directory
+ * Entries created since opendir() become visible  like rewinddir(3)
+ */
+static int dirp_rewind(struct loopback_dirp *d)
+{
+    rewinddir(d->dp);
+    d->nmarks = 0;
+    d->stride = 1;
+    d->known = 1;
+    d->count = 0;
+    d->eof = 0;
+    d->stream_window = 0;
+    return dirp_add_mark(d, telldir(d->dp));
+}
+
+/**
+ * Load window k  whose start position must already be known
+ * @return      0 on success  -errno otherwise
+ */
+static int dirp_fill(struct loopback_dirp *d, size_t k)
+{
+    size_t batch = loopbackfs_cfg.readdir_batch;
+    struct dirent *de;
+    struct dirp_entry *ent;
+    size_t skip = 0;
+    int e;
+
+    assert(k < d->known);
+
+    if (d->stream_window != k) {
+        seekdir(d->dp, d->marks[k / d->stride]);
+        skip = k % d->stride * batch;
+    }
+    d->stream_window = SIZE_MAX;
+
+    d->base = k * batch;
+    d->count = 0;
+    d->names_len = 0;
+    d->eof = 0;
+
+    /* Nearest mark is behind  entries deleted since may shorten the walk */
+    for (; skip != 0; skip--) {
+        errno = 0;
+        if (readdir(d->dp) == NULL) {
+            if (errno != 0) return -errno;
+            d->eof = 1;
+            return 0;
+        }
+    }
+
+    while (d->count < batch) {
+        errno = 0;
+        if ((de = readdir(d->dp)) == NULL) {
+            if (errno != 0) return -errno;
+            d->eof = 1;
+            return 0;
+        }
+
+        ent = &d->ents[d->count];
+        e = dirp_add_name(d, de->d_name, &ent->name);
+        if (e != 0) return e;
+        ent->ino = de->d_ino;
+        ent->type = de->d_type;
+        d->count++;
+    }
+
+    /* Window full  remember where the next one starts */
+    if (k + 1 == d->known) {
+        d->known++;
+        if ((k + 1) % d->stride == 0) {
+            e = dirp_add_mark(d, telldir(d->dp));
+            if (e != 0) return e;
+        }
+    }
+    d->stream_window = k + 1;
+    return 0;
+}
+
+/**
+ * Make the window containing stream index `idx' current
+ */
+static int dirp_seek(struct loopback_dirp *d, size_t idx)
+{
+    size_t batch = loopbackfs_cfg.readdir_batch;
+    size_t k = idx / batch;
+    int e;
+
+    if (d->count != 0 && d->base == k * batch) return 0;
+
+    /* Never handed out cookie of this window yet  walk forward to it */
+    while (k >= d->known) {
+        e = dirp_fill(d, d->known - 1);
+        if (e != 0) return e;
+        if (d->eof) return 0;
+    }
+
+    return dirp_fill(d, k);
+}
+
+/**
+ * Set up child path buffer "<dir>/" for readdir_stat()
+ */
+static int dirp_init_path(struct loopback_dirp *d, const char *path)
+{
+    size_t len;
+
+    assert_nonnull(d);
+    assert_nonnull(path);
+
+    len = strlen(path);
+    d->path = malloc(PATH_MAX);
+    if (d->path == NULL) return -ENOMEM;
+    if (len + 1 >= PATH_MAX) {
+        free(d->path);
+        d->path = NULL;
+        return -ENAMETOOLONG;
+    }
+
+    (void) memcpy(d->path, path, len);
+    if (len == 0 || path[len-1] != '/') d->path[len++] = '/';
+    d->pathlen = len;
+    return 0;
+}
+
+/**
+ * Fetch full attributes of a directory entry in one pass with the listing
+ *
+ * Served from attribute cache if possible  otherwise fstatat(2) relative to
+ *  the open directory(no full path walk)  and the result primes attribute
+ *  cache so the getattr() kernel issues right after(e.g. `ls -l')
+ *  costs no syscall
+ *
+ * @return      0 if st filled  -1 otherwise(caller falls back to d_type)
+ */
+static int readdir_stat(struct loopback_dirp *d, const char *name, struct stat *st)
+{
+    struct cache_ticket t;
+    size_t len;
+
+    assert_nonnull(d);
+    assert_nonnull(d->path);
+    assert_nonnull(name);
+    assert_nonnull(st);
+
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        return -1;
+    }
+
+    len = strlen(name);
+    if (d->pathlen + len >= PATH_MAX) return -1;
+    (void) memcpy(d->path + d->pathlen, name, len + 1);
+
+    if (cache_lookup(&attr_cache, d->path, st, &t)) return 0;
+
+    if (fstatat(dirfd(d->dp), name, st, AT_SYMLINK_NOFOLLOW) != 0) return -1;
+    /* see: lb_getattr() */
+    if (wb_sync_stat(st) && fstatat(dirfd(d->dp), name, st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return -1;
+    }
+#if FUSE_VERSION >= 29
+    st->st_blksize = 0;     /* see: lb_getattr() */
+#endif
+
+    cache_put(&attr_cache, d->path, st, &t);
+    return 0;
+}
+
 /**
  * Open directory
  * File handle will be passed to readdir, closedir and fsyncdir
@@ -540,21 +4814,39 @@ struct loopback_dirp {
 static int lb_opendir(const char *path, struct fuse_file_info *fi)
 {
     struct loopback_dirp *d;
+    enum ctl_node n;
 
     assert_nonnull(path);
     assert_nonnull(fi);
 
+    n = ctl_node(path);
+    if (n != CTL_NONE) {
+        fi->fh = 0;     /* Listing is static  see: lb_readdir() */
+        return n == CTL_ROOT ? 0 : (n == CTL_BAD ? -ENOENT : -ENOTDIR);
+    }
+
     d = malloc(sizeof(*d));
     if (d == NULL) return -ENOMEM;
 
+    (void) memset(d, 0, sizeof(*d));
+
+    d->ents = malloc(loopbackfs_cfg.readdir_batch * sizeof(*d->ents));
+    if (d->ents == NULL) {
+        free(d);
+        return -ENOMEM;
+    }
+
     d->dp = opendir(path);
     if (d->dp == NULL) {
+        free(d->ents);
         free(d);
         return -errno;
     }
 
-    d->entry = NULL;
-    d->offset = 0;
+    if (loopbackfs_cfg.readdir_plus && dirp_init_path(d, path) != 0) {
+        /* Not fatal  plain listing still works */
+        SYSLOG_WARN("opendir()  readdir-plus disabled for %s", path);
+    }
 
     fi->fh = (uint64_t) d;
     return 0;
@@ -574,8 +4866,11 @@ static int lb_readdir(
         struct fuse_file_info *fi)
 {
     struct loopback_dirp *d;
+    struct dirp_entry *ent;
+    const char *name;
     struct stat st;
-    off_t nextoff;
+    size_t idx;
+    int e;
 
     assert_nonnull(path);
     assert_nonnull(buf);
@@ -583,30 +4878,46 @@ static int lb_readdir(
     assert(off >= 0);
     assert_nonnull(fi);
 
+    if (ctl_node(path) != CTL_NONE) {
+        ctl_readdir(buf, filler);
+        return 0;
+    }
+
     d = get_dirp(fi);
     assert_nonnull(d);
 
-    if (off != d->offset) {
-        seekdir(d->dp, (long) off);
-        d->entry = NULL;
-        d->offset = off;
-    }
+    /*
+     * Offset is the stream index of the first entry to return
+     *  i.e. cookie we handed out along with the previous entry
+     */
+    idx = (size_t) off;
+
+    e = (idx == 0 || d->known == 0) ? dirp_rewind(d) : 0;
+    if (e == 0) e = dirp_seek(d, idx);
+    if (e != 0) return e;
 
     while (1) {
-        if (d->entry == NULL) {
+        /* A reloaded window may have lost entries  past its end too */
+        if (idx >= d->base + d->count) {
             /* No more directory entry */
-            if ((d->entry = readdir(d->dp)) == NULL) break;
+            if (d->eof) break;
+            e = dirp_fill(d, idx / loopbackfs_cfg.readdir_batch);
+            if (e != 0) return e;
+            if (d->count == 0) break;
         }
 
-        (void) memset(&st, 0, sizeof(st));
-        st.st_ino = d->entry->d_ino;
-        st.st_mode = DTTOIF(d->entry->d_type);
-        nextoff = telldir(d->dp);
-        /* break if dir buffer is full */
-        if (filler(buf, d->entry->d_name, &st, nextoff)) break;
+        ent = &d->ents[idx - d->base];
+        name = d->names + ent->name;
 
-        d->entry = NULL;
-        d->offset = nextoff;
+        if (d->path == NULL || readdir_stat(d, name, &st) != 0) {
+            (void) memset(&st, 0, sizeof(st));
+            st.st_ino = ent->ino;
+            st.st_mode = DTTOIF(ent->type);
+        }
+
+        /* break if dir buffer is full */
+        if (filler(buf, name, &st, (off_t) (idx + 1))) break;
+        idx++;
     }
 
     return 0;
@@ -625,11 +4936,17 @@ static int lb_releasedir(const char *path, struct fuse_file_info *fi)
     assert_nonnull(path);
     assert_nonnull(fi);
 
+    if (ctl_node(path) != CTL_NONE) return 0;
+
     d = get_dirp(fi);
     assert_nonnull(d);
 
     assert_nonnull(d->dp);
     e = closedir(d->dp);
+    free(d->ents);
+    free(d->names);
+    free(d->marks);
+    free(d->path);
     free(d);
 
     return RET_TO_ERRNO(e);
@@ -646,7 +4963,13 @@ static int lb_fsyncdir(
         int datasync,
         struct fuse_file_info *fi)
 {
-    return lb_fsync(path, datasync, fi);
+    assert_nonnull(path);
+    assert_nonnull(fi);
+
+    if (ctl_node(path) != CTL_NONE) return 0;
+
+    /* fi->fh is a struct loopback_dirp  not a struct lb_file */
+    return lb_sync_fd(dirfd(get_dirp(fi)->dp), datasync);
 }
 
 /**
@@ -654,6 +4977,8 @@ static int lb_fsyncdir(
  */
 static void *lb_init(struct fuse_conn_info *conn)
 {
+    pthread_t tid;
+
     assert_nonnull(conn);
 
     FUSE_ENABLE_SETVOLNAME(conn);
@@ -663,6 +4988,13 @@ static void *lb_init(struct fuse_conn_info *conn)
         FUSE_ENABLE_CASE_INSENSITIVE(conn);
     }
 
+    /* Started here rather than main()  fuse_main() may daemonize via fork(2) */
+    if (pthread_create(&tid, NULL, &stats_signal_thread, NULL) == 0) {
+        (void) pthread_detach(tid);
+    } else {
+        SYSLOG_WARN("pthread_create(3) fail  stats dump on SIGUSR1 unavailable");
+    }
+
     return NULL;
 }
 
@@ -673,6 +5005,8 @@ static void *lb_init(struct fuse_conn_info *conn)
 static void lb_destroy(void *userdata)
 {
     UNUSED(userdata);
+    trace_flush();
+    lb_dump_stats();
 }
 
 /**
@@ -680,7 +5014,16 @@ static void lb_destroy(void *userdata)
  */
 static int lb_access(const char *path, int mode)
 {
+    enum ctl_node n;
+
     assert_nonnull(path);
+
+    n = ctl_node(path);
+    if (n != CTL_NONE) {
+        if (n == CTL_BAD) return -ENOENT;
+        return (mode & W_OK) && !ctl_writable(n) ? -EACCES : 0;
+    }
+
     return RET_TO_ERRNO(access(path, mode));
 }
 
@@ -692,16 +5035,23 @@ static int lb_create(
         mode_t mode,
         struct fuse_file_info *fi)
 {
+    struct lb_backing *bk;
     int fd;
 
     assert_nonnull(path);
     assert_nonnull(fi);
+    CTL_DENY(path);
 
-    fd = open(path, fi->flags, mode);
-    if (fd < 0) return -errno;
+    /* see: lb_truncate() */
+    if (fi->flags & O_TRUNC) wb_sync_path(path);
 
-    fi->fh = fd;
-    return 0;
+    fd = fd_open(path, fi->flags, mode, &bk);
+    if (fd < 0) return fd;
+
+    entry_changed(path);
+    /* O_TRUNC of an existing file */
+    data_changed(path);
+    return lb_file_new(fi, fd, bk);
 }
 
 /**
@@ -712,10 +5062,21 @@ static int lb_ftruncate(
         off_t off,
         struct fuse_file_info *fi)
 {
+    enum ctl_node n;
+
     assert_nonnull(path);
     assert_nonnull(fi);
 
-    return RET_TO_ERRNO(ftruncate((int) fi->fh, off));
+    n = ctl_node(path);
+    if (n != CTL_NONE) return ctl_settable(n);
+
+    /* see: lb_truncate() */
+    wb_sync_inode(get_file(fi));
+
+    RET_IF_ERROR(ftruncate(lb_fd(fi), off));
+    attr_changed(path);
+    data_changed_file(get_file(fi));
+    return 0;
 }
 
 /**
@@ -726,13 +5087,20 @@ static int lb_fgetattr(
         struct stat *st,
         struct fuse_file_info *fi)
 {
+    enum ctl_node n;
     int e;
 
     assert_nonnull(path);
     assert_nonnull(st);
     assert_nonnull(fi);
 
-    e = fstat((int) fi->fh, st);
+    n = ctl_node(path);
+    if (n != CTL_NONE) return ctl_getattr(n, st);
+
+    /* see: lb_getattr() */
+    wb_sync_inode(get_file(fi));
+
+    e = fstat(lb_fd(fi), st);
 #if FUSE_VERSION >= 29
     if (e == 0) {
         /* Fall back to global IO size  see: lb_getattr() */
@@ -759,7 +5127,9 @@ static int lb_lock(
     assert_nonnull(fi);
     assert_nonnull(lck);
 
-    e = fcntl((int) fi->fh, cmd, lck);
+    if (ctl_node(path) != CTL_NONE) return -ENOTSUP;
+
+    e = fcntl(lb_fd(fi), cmd, lck);
     return RET_TO_ERRNO(e);
 }
 
@@ -770,16 +5140,52 @@ static int lb_lock(
 static int lb_utimens(const char *path, const struct timespec tv[2])
 {
     static int flag = AT_SYMLINK_NOFOLLOW;
+    enum ctl_node n;
     assert_nonnull(path);
     assert_nonnull(tv);
-    return RET_TO_ERRNO(utimensat(AT_FDCWD, path, tv, flag));
+    n = ctl_node(path);
+    if (n != CTL_NONE) return ctl_settable(n);
+    RET_IF_ERROR(utimensat(AT_FDCWD, path, tv, flag));
+    attr_changed(path);
+    return 0;
 }
 
 static int lb_flock(const char *path, struct fuse_file_info *fi, int op)
 {
+    struct lb_file *f;
+    int expected = -1;
+    int fd;
+
     assert_nonnull(path);
     assert_nonnull(fi);
-    return RET_TO_ERRNO(flock((int) fi->fh, op));
+    if (ctl_node(path) != CTL_NONE) return -ENOTSUP;
+
+    f = get_file(fi);
+    if (f->bk == NULL) return RET_TO_ERRNO(flock(f->fd, op));
+
+    /*
+     * Locking the shared fd would lock on behalf of every handle sharing it
+     * Decided once per handle  so all its locks go through one description
+     */
+    fd = __atomic_load_n(&f->lock_fd, __ATOMIC_ACQUIRE);
+    if (fd == -1) {
+        if (fd_claim(f->bk)) {
+            fd = LOCK_FD_BACKING;
+        } else {
+            fd = fd_reopen(f->bk);
+            if (fd < 0) return fd;
+        }
+        if (__atomic_compare_exchange_n(&f->lock_fd, &expected, fd, 0,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            if (fd >= 0) fd_gauge_inc(&fd_stats.fds, &fd_stats.fds_max);
+        } else {
+            /* Concurrent flock() of the same handle decided first */
+            if (fd >= 0) (void) close(fd);
+            fd = expected;
+        }
+    }
+
+    return RET_TO_ERRNO(flock(fd == LOCK_FD_BACKING ? f->fd : fd, op));
 }
 
 /**
@@ -793,6 +5199,7 @@ static int lb_fallocate(
         struct fuse_file_info *fi)
 {
     fstore_t fst;
+    int e;
 
     assert_nonnull(path);
     assert(off >= 0);
@@ -818,62 +5225,97 @@ static int lb_fallocate(
     fst.fst_offset = off;
     fst.fst_length = len;
 
-    return RET_TO_ERRNO(fcntl((int) fi->fh, F_PREALLOCATE, &fst));
+    /* F_PEOFPOSMODE is relative to current end of file */
+    wb_sync_inode(get_file(fi));
+
+    e = io_prealloc(lb_fd(fi), &fst);
+    if (e != 0) return e;
+    attr_changed(path);
+    data_changed_file(get_file(fi));
+    return 0;
 }
 
 static int lb_statfs_x(const char *path, struct statfs *st)
 {
     assert_nonnull(path);
     assert_nonnull(st);
+    if (ctl_node(path) != CTL_NONE) path = "/";
     return RET_TO_ERRNO(statfs(path, st));
 }
 
 static int lb_setvolname(const char *volname)
 {
     assert_nonnull(volname);
+    UNUSED(volname);
     return 0;
 }
 
+static struct {
+    uint64_t calls;
+    uint64_t hits;          /* Served from attr cache */
+} xtimes_stats;
+
+static void xtimes_render_stats(struct sbuf *b)
+{
+    uint64_t calls = STAT_GET(xtimes_stats.calls);
+
+    if (calls == 0) return;
+
+    /* Every hit is a getattrlist(2) saved */
+    sbuf_printf(b, "getxtimes  calls: %llu served from attr cache: %llu\n",
+            (unsigned long long) calls, (unsigned long long) STAT_GET(xtimes_stats.hits));
+}
+
+/**
+ * Backup and creation times in one getattrlist(2)
+ * A following getxtimes() of the same file is served from attr cache
+ *  as long as the entry getattr() left there lives
+ */
 static int lb_getxtimes(
         const char *path,
         struct timespec *bkuptime,
         struct timespec *crtime)
 {
     /*
+     * Attributes come in order of their bits  CRTIME before BKUPTIME
+     *
      * see:
      *  getattrlist(2) ATTRIBUTE BUFFER section
      *  setattrlist(2)
      */
     struct xtimeattrbuf {
         uint32_t size;
-        struct timespec xtime;
-    } __attribute__ ((packed));
+        struct timespec crtime;
+        struct timespec bkuptime;
+    } __attribute__ ((aligned(4), packed));
 
     int e;
     struct attrlist attrs;
     struct xtimeattrbuf buf;
+    struct cache_ticket t;
 
     assert_nonnull(path);
     assert_nonnull(bkuptime);
     assert_nonnull(crtime);
 
+    STAT_INC(xtimes_stats.calls);
+    if (cache_get_xtimes(&attr_cache, path, bkuptime, crtime, &t)) {
+        STAT_INC(xtimes_stats.hits);
+        return 0;
+    }
+
     (void) memset(&attrs, 0, sizeof(attrs));
     attrs.bitmapcount = ATTR_BIT_MAP_COUNT;
+    attrs.commonattr = ATTR_CMN_CRTIME | ATTR_CMN_BKUPTIME;
 
-    attrs.commonattr = ATTR_CMN_BKUPTIME;
-    e = getattrlist(path, &attrs, &buf, sizeof(buf), FSOPT_NOFOLLOW);
-    if (e == 0) {
-        (void) memcpy(bkuptime, &buf.xtime, sizeof(*bkuptime));
-    } else {
-        (void) memset(bkuptime, 0, sizeof(*bkuptime));
-    }
-
-    attrs.commonattr = ATTR_CMN_CRTIME;
     e = getattrlist(path, &attrs, &buf, sizeof(buf), FSOPT_NOFOLLOW);
-    if (e == 0) {
-        (void) memcpy(crtime, &buf.xtime, sizeof(*crtime));
+    if (e == 0 && buf.size >= sizeof(buf)) {
+        (void) memcpy(crtime, &buf.crtime, sizeof(*crtime));
+        (void) memcpy(bkuptime, &buf.bkuptime, sizeof(*bkuptime));
+        cache_put_xtimes(&attr_cache, path, bkuptime, crtime, &t);
     } else {
         (void) memset(crtime, 0, sizeof(*crtime));
+        (void) memset(bkuptime, 0, sizeof(*bkuptime));
     }
 
     return 0;
@@ -886,10 +5328,22 @@ static int lb_exchange(
 {
     assert_nonnull(path1);
     assert_nonnull(path2);
+    CTL_DENY(path1);
+    CTL_DENY(path2);
     if (options & ~0xffffffffUL) {
         SYSLOG_WARN("exchangedata()  bad options: %#lx", options);
     }
-    return RET_TO_ERRNO(exchangedata(path1, path2, (unsigned int) options));
+    wb_sync_path(path1);
+    wb_sync_path(path2);
+    RET_IF_ERROR(exchangedata(path1, path2, (unsigned int) options));
+    attr_changed(path1);
+    attr_changed(path2);
+    /* Resource forks are exchanged along with data */
+    xattr_changed(path1);
+    xattr_changed(path2);
+    data_changed(path1);
+    data_changed(path2);
+    return 0;
 }
 
 static int _lb_setxtime(
@@ -902,12 +5356,14 @@ static int _lb_setxtime(
 
     assert_nonnull(path);
     assert_nonnull(tv);
+    CTL_DENY(path);
 
     (void) memset(&attrl, 0, sizeof(attrl));
     attrl.bitmapcount = ATTR_BIT_MAP_COUNT;
     attrl.commonattr = commonattr;
 
     e = setattrlist(path, &attrl, (void *) tv, sizeof(*tv), FSOPT_NOFOLLOW);
+    if (e == 0) attr_changed(path);
     return RET_TO_ERRNO(e);
 }
 
@@ -929,163 +5385,496 @@ static inline int lb_setcrtime(const char *path, const struct timespec *tv)
 static int lb_chflags(const char *path, uint32_t flags)
 {
     assert_nonnull(path);
-    return RET_TO_ERRNO(chflags(path, flags));
+    CTL_DENY(path);
+    RET_IF_ERROR(chflags(path, flags));
+    attr_changed(path);
+    return 0;
 }
 
-static int lb_setattr_x(const char *path, struct setattr_x *attr)
+/*
+ * setattr_x() batching
+ *
+ * All wanted times go in one setattrlist(2)
+ * Mode and owner are always applied  attr cache is path keyed and may be
+ *  stale(hard links  outside changes)  fine for a read  not to drop a write
+ * With three or more calls the path is resolved once by opening it
+ *  and f*() variants used  only for regular files and directories known
+ *  from attr cache  opening anything else may have side effects
+ */
+
+#define SA_MODE         0x01
+#define SA_OWNER        0x02
+#define SA_SIZE         0x04
+#define SA_TIMES        0x08
+#define SA_FLAGS        0x10
+
+#define SA_FD_MIN       3       /* Calls left worth an open(2) and close(2) */
+
+static struct {
+    uint64_t calls;
+    uint64_t syscalls;      /* Incl. open(2)/close(2) of the fd path */
+    uint64_t by_fd;
+} sa_stats;
+
+static void sa_render_stats(struct sbuf *b)
 {
-    int e;
-    uid_t uid = -1;
-    gid_t gid = -1;
-    struct timeval tv[2];
-    struct attrlist attrl;
+    uint64_t calls = STAT_GET(sa_stats.calls);
+
+    if (calls == 0) return;
+
+    sbuf_printf(b, "setattr_x  calls: %llu syscalls: %llu through fd: %llu\n",
+            (unsigned long long) calls,
+            (unsigned long long) STAT_GET(sa_stats.syscalls),
+            (unsigned long long) STAT_GET(sa_stats.by_fd));
+}
+
+/**
+ * Work out calls needed for `attr'
+ * @openable    set if `path' is known safe to open(2)  NULL if not interested
+ * @return      SA_* mask
+ */
+static unsigned sa_plan(const char *path, const struct setattr_x *attr, int *openable)
+{
+    struct cache_ticket t;
+    struct stat st;
+    unsigned ops = 0;
 
     assert_nonnull(path);
     assert_nonnull(attr);
 
-    if (SETATTR_WANTS_MODE(attr)) {
-        RET_IF_ERROR(lchmod(path, attr->mode));
+    if (SETATTR_WANTS_MODE(attr)) ops |= SA_MODE;
+    if (SETATTR_WANTS_UID(attr) || SETATTR_WANTS_GID(attr)) ops |= SA_OWNER;
+    if (SETATTR_WANTS_SIZE(attr)) ops |= SA_SIZE;
+    if (SETATTR_WANTS_ACCTIME(attr) || SETATTR_WANTS_MODTIME(attr) ||
+            SETATTR_WANTS_CRTIME(attr) || SETATTR_WANTS_CHGTIME(attr) ||
+            SETATTR_WANTS_BKUPTIME(attr)) {
+        ops |= SA_TIMES;
     }
+    if (SETATTR_WANTS_FLAGS(attr)) ops |= SA_FLAGS;
 
-    if (SETATTR_WANTS_UID(attr)) uid = attr->uid;
-    if (SETATTR_WANTS_GID(attr)) gid = attr->gid;
+    if (openable == NULL) return ops;
 
-    if (uid != -1 || gid != -1) {
-        RET_IF_ERROR(lchown(path, uid, gid));
+    *openable = 0;
+    if (__builtin_popcount(ops) >= SA_FD_MIN && cache_lookup(&attr_cache, path, &st, &t)) {
+        *openable = S_ISREG(st.st_mode) || S_ISDIR(st.st_mode);
     }
 
-    if (SETATTR_WANTS_SIZE(attr)) {
-        RET_IF_ERROR(truncate(path, attr->size));
-    }
+    return ops;
+}
 
-    /*
-     * We don't support modify acctime directly
-     *  instead we modify it with companion of modtime
-     */
-    if (SETATTR_WANTS_MODTIME(attr)) {
-        if (!SETATTR_WANTS_ACCTIME(attr)) {
-            e = gettimeofday(&tv[0], NULL);
-            assert(e == 0);
-        } else {
-            tv[0].tv_sec = attr->acctime.tv_sec;
-            tv[0].tv_usec = (typeof(tv[0].tv_usec)) (attr->acctime.tv_nsec / 1000);
-        }
-        tv[1].tv_sec = attr->modtime.tv_sec;
-        tv[1].tv_usec = (typeof(tv[1].tv_usec)) (attr->modtime.tv_nsec / 1000);
+/**
+ * Pack wanted times in attribute bit order  as setattrlist(2) expects
+ * @return      buffer size
+ */
+static size_t sa_times(const struct setattr_x *attr, struct attrlist *al, struct timespec *ts)
+{
+    size_t n = 0;
 
-        RET_IF_ERROR(lutimes(path, tv));
-    }
+    (void) memset(al, 0, sizeof(*al));
+    al->bitmapcount = ATTR_BIT_MAP_COUNT;
 
     if (SETATTR_WANTS_CRTIME(attr)) {
-        (void) memset(&attrl, 0, sizeof(attrl));
-        attrl.bitmapcount = ATTR_BIT_MAP_COUNT;
-        attrl.commonattr = ATTR_CMN_CRTIME;
-        RET_IF_ERROR(setattrlist(path, &attrl, &attr->crtime,
-                        sizeof(attr->crtime), FSOPT_NOFOLLOW));
+        al->commonattr |= ATTR_CMN_CRTIME;
+        ts[n++] = attr->crtime;
+    }
+    if (SETATTR_WANTS_MODTIME(attr)) {
+        al->commonattr |= ATTR_CMN_MODTIME;
+        ts[n++] = attr->modtime;
     }
-
     if (SETATTR_WANTS_CHGTIME(attr)) {
-        (void) memset(&attrl, 0, sizeof(attrl));
-        attrl.bitmapcount = ATTR_BIT_MAP_COUNT;
-        attrl.commonattr = ATTR_CMN_CHGTIME;
-        RET_IF_ERROR(setattrlist(path, &attrl, &attr->chgtime,
-                        sizeof(attr->chgtime), FSOPT_NOFOLLOW));
+        al->commonattr |= ATTR_CMN_CHGTIME;
+        ts[n++] = attr->chgtime;
+    }
+    if (SETATTR_WANTS_ACCTIME(attr)) {
+        al->commonattr |= ATTR_CMN_ACCTIME;
+        ts[n++] = attr->acctime;
     }
-
     if (SETATTR_WANTS_BKUPTIME(attr)) {
-        (void) memset(&attrl, 0, sizeof(attrl));
-        attrl.bitmapcount = ATTR_BIT_MAP_COUNT;
-        attrl.commonattr = ATTR_CMN_BKUPTIME;
-        RET_IF_ERROR(setattrlist(path, &attrl, &attr->bkuptime,
-                        sizeof(attr->bkuptime), FSOPT_NOFOLLOW));
+        al->commonattr |= ATTR_CMN_BKUPTIME;
+        ts[n++] = attr->bkuptime;
+    }
+
+    return n * sizeof(*ts);
+}
+
+static inline uid_t sa_uid(const struct setattr_x *attr)
+{
+    return SETATTR_WANTS_UID(attr) ? attr->uid : (uid_t) -1;
+}
+
+static inline gid_t sa_gid(const struct setattr_x *attr)
+{
+    return SETATTR_WANTS_GID(attr) ? attr->gid : (gid_t) -1;
+}
+
+/*
+ * Both apply `ops' of `attr' in the same order
+ *  times after size(truncate(2) touches them)  flags last(may be immutable)
+ */
+
+static int sa_apply_fd(int fd, const struct setattr_x *attr, unsigned ops)
+{
+    struct timespec ts[5];
+    struct attrlist al;
+    size_t n;
+
+    assert_nonnull(attr);
+
+    if (ops & SA_MODE) RET_IF_ERROR(fchmod(fd, attr->mode));
+    if (ops & SA_OWNER) RET_IF_ERROR(fchown(fd, sa_uid(attr), sa_gid(attr)));
+    if (ops & SA_SIZE) RET_IF_ERROR(ftruncate(fd, attr->size));
+    if (ops & SA_TIMES) {
+        n = sa_times(attr, &al, ts);
+        RET_IF_ERROR(fsetattrlist(fd, &al, ts, n, FSOPT_NOFOLLOW));
     }
+    if (ops & SA_FLAGS) RET_IF_ERROR(fchflags(fd, attr->flags));
+
+    return 0;
+}
+
+static int sa_apply_path(const char *path, const struct setattr_x *attr, unsigned ops)
+{
+    struct timespec ts[5];
+    struct attrlist al;
+    size_t n;
+
+    assert_nonnull(path);
+    assert_nonnull(attr);
 
-    if (SETATTR_WANTS_FLAGS(attr)) {
-        RET_IF_ERROR(lchflags(path, attr->flags));
+    if (ops & SA_MODE) RET_IF_ERROR(lchmod(path, attr->mode));
+    if (ops & SA_OWNER) RET_IF_ERROR(lchown(path, sa_uid(attr), sa_gid(attr)));
+    if (ops & SA_SIZE) RET_IF_ERROR(truncate(path, attr->size));
+    if (ops & SA_TIMES) {
+        n = sa_times(attr, &al, ts);
+        RET_IF_ERROR(setattrlist(path, &al, ts, n, FSOPT_NOFOLLOW));
     }
+    if (ops & SA_FLAGS) RET_IF_ERROR(lchflags(path, attr->flags));
 
     return 0;
 }
 
+static int _lb_setattr_x(const char *path, struct setattr_x *attr)
+{
+    unsigned ops;
+    int openable;
+    int calls;
+    int fd;
+    int e;
+
+    assert_nonnull(path);
+    assert_nonnull(attr);
+
+    STAT_INC(sa_stats.calls);
+    ops = sa_plan(path, attr, &openable);
+    calls = __builtin_popcount(ops);
+
+    if (openable && calls >= SA_FD_MIN) {
+        /* Same access truncate(2) needs  O_NOFOLLOW keeps lchmod(2) semantics */
+        fd = open(path, ((ops & SA_SIZE) ? O_WRONLY : O_RDONLY) | O_NOFOLLOW | O_NONBLOCK);
+        if (fd >= 0) {
+            e = sa_apply_fd(fd, attr, ops);
+            (void) close(fd);
+            STAT_INC(sa_stats.by_fd);
+            (void) __atomic_add_fetch(&sa_stats.syscalls, calls + 2, __ATOMIC_RELAXED);
+            return e;
+        }
+        /* e.g. no read permission  which path based calls don't need */
+        STAT_INC(sa_stats.syscalls);
+    }
+
+    (void) __atomic_add_fetch(&sa_stats.syscalls, calls, __ATOMIC_RELAXED);
+    return sa_apply_path(path, attr, ops);
+}
+
+/**
+ * Only size and access/modification times of writable control files
+ *  can be "changed"  see: ctl_settable()
+ */
+static int ctl_setattr_x(enum ctl_node n, const struct setattr_x *attr)
+{
+    assert_nonnull(attr);
+
+    if (SETATTR_WANTS_MODE(attr) || SETATTR_WANTS_UID(attr) ||
+            SETATTR_WANTS_GID(attr) || SETATTR_WANTS_CRTIME(attr) ||
+            SETATTR_WANTS_CHGTIME(attr) || SETATTR_WANTS_BKUPTIME(attr) ||
+            SETATTR_WANTS_FLAGS(attr)) {
+        return -EPERM;
+    }
+
+    return ctl_settable(n);
+}
+
+static int lb_setattr_x(const char *path, struct setattr_x *attr)
+{
+    enum ctl_node n = ctl_node(path);
+    int e;
+
+    if (n != CTL_NONE) return ctl_setattr_x(n, attr);
+
+    /* see: lb_truncate() */
+    if (SETATTR_WANTS_SIZE(attr)) wb_sync_path(path);
+
+    e = _lb_setattr_x(path, attr);
+    /* Even if failed  some attributes may already changed */
+    attr_changed(path);
+    if (SETATTR_WANTS_SIZE(attr)) data_changed(path);
+    return e;
+}
+
 /**
  * see: lb_setattr_x()
  */
-static int lb_fsetattr_x(
+static int _lb_fsetattr_x(
         const char *path,
         struct setattr_x *attr,
         struct fuse_file_info *fi)
 {
-    int e;
-    int fd;
-    uid_t uid = -1;
-    gid_t gid = -1;
-    struct timeval tv[2];
-    struct attrlist attrl;
+    unsigned ops;
 
     assert_nonnull(path);
     assert_nonnull(attr);
     assert_nonnull(fi);
 
-    fd = (int) fi->fh;
+    STAT_INC(sa_stats.calls);
+    ops = sa_plan(path, attr, NULL);
+    (void) __atomic_add_fetch(&sa_stats.syscalls, __builtin_popcount(ops), __ATOMIC_RELAXED);
+    return sa_apply_fd(lb_fd(fi), attr, ops);
+}
 
-    if (SETATTR_WANTS_MODE(attr)) {
-        RET_IF_ERROR(fchmod(fd, attr->mode));
-    }
+static int lb_fsetattr_x(
+        const char *path,
+        struct setattr_x *attr,
+        struct fuse_file_info *fi)
+{
+    enum ctl_node n = ctl_node(path);
+    int e;
 
-    if (SETATTR_WANTS_UID(attr)) uid = attr->uid;
-    if (SETATTR_WANTS_GID(attr)) gid = attr->gid;
+    /* Control files have no backing fd */
+    if (n != CTL_NONE) return ctl_setattr_x(n, attr);
 
-    if (uid != -1 || gid != -1) {
-        RET_IF_ERROR(fchown(fd, uid, gid));
-    }
+    /* see: lb_truncate() */
+    if (SETATTR_WANTS_SIZE(attr)) wb_sync_inode(get_file(fi));
 
-    if (SETATTR_WANTS_SIZE(attr)) {
-        RET_IF_ERROR(ftruncate(fd, attr->size));
-    }
+    e = _lb_fsetattr_x(path, attr, fi);
+    attr_changed(path);
+    if (SETATTR_WANTS_SIZE(attr)) data_changed_file(get_file(fi));
+    return e;
+}
 
-    if (SETATTR_WANTS_MODTIME(attr)) {
-        if (!SETATTR_WANTS_ACCTIME(attr)) {
-            e = gettimeofday(&tv[0], NULL);
-            assert(e == 0);
-        } else {
-            tv[0].tv_sec = attr->acctime.tv_sec;
-            tv[0].tv_usec = (typeof(tv[0].tv_usec)) (attr->acctime.tv_nsec / 1000);
-        }
-        tv[1].tv_sec = attr->modtime.tv_sec;
-        tv[1].tv_usec = (typeof(tv[1].tv_usec)) (attr->modtime.tv_nsec / 1000);
+/*
+ * Instrumented callbacks  swapped into loopback_op by opstat_install()
+ *  if op stats or tracing enabled
+ *
+ * `targs' is a TA() argument list  what each field means per op
+ *  is defined here and decoded by bench/lbreplay.c
+ */
 
-        RET_IF_ERROR(futimes(fd, tv));
+/* path  path2  off  size  flags  mode  fh */
+#define TA(p, p2, o, sz, fl, md, fh)                    \
+    {(p), (p2), (uint64_t) (o), (uint64_t) (sz),        \
+     (uint32_t) (fl), (uint32_t) (md), (uint64_t) (fh)}
+
+#define TRACE_OP(op, e, t0, targs)                      \
+    if (trace_fd >= 0) {                                \
+        const struct trace_args ta = TA targs;          \
+        trace_op(op, e, t0, &ta);                       \
     }
 
-    if (SETATTR_WANTS_CRTIME(attr)) {
-        (void) memset(&attrl, 0, sizeof(attrl));
-        attrl.bitmapcount = ATTR_BIT_MAP_COUNT;
-        attrl.commonattr = ATTR_CMN_CRTIME;
-        RET_IF_ERROR(fsetattrlist(fd, &attrl, &attr->crtime,
-                        sizeof(attr->crtime), FSOPT_NOFOLLOW));
+#define OPSTAT_WRAP(op, proto, args, targs)             \
+    static int stat_##op proto                          \
+    {                                                   \
+        uint64_t t0 = now_ns();                         \
+        int e = lb_##op args;                           \
+        opstat_record(OP_##op, e, 0, t0);               \
+        TRACE_OP(OP_##op, e, t0, targs)                 \
+        return e;                                       \
     }
 
-    if (SETATTR_WANTS_CHGTIME(attr)) {
-        (void) memset(&attrl, 0, sizeof(attrl));
-        attrl.bitmapcount = ATTR_BIT_MAP_COUNT;
-        attrl.commonattr = ATTR_CMN_CHGTIME;
-        RET_IF_ERROR(fsetattrlist(fd, &attrl, &attr->chgtime,
-                        sizeof(attr->chgtime), FSOPT_NOFOLLOW));
+/* Callbacks whose positive return value is bytes transferred */
+#define OPSTAT_WRAP_IO(op, proto, args, targs)          \
+    static int stat_##op proto                          \
+    {                                                   \
+        uint64_t t0 = now_ns();                         \
+        int e = lb_##op args;                           \
+        opstat_record(OP_##op, e, e > 0 ? e : 0, t0);   \
+        TRACE_OP(OP_##op, e, t0, targs)                 \
+        return e;                                       \
     }
 
-    if (SETATTR_WANTS_BKUPTIME(attr)) {
-        (void) memset(&attrl, 0, sizeof(attrl));
-        attrl.bitmapcount = ATTR_BIT_MAP_COUNT;
-        attrl.commonattr = ATTR_CMN_BKUPTIME;
-        RET_IF_ERROR(fsetattrlist(fd, &attrl, &attr->bkuptime,
-                        sizeof(attr->bkuptime), FSOPT_NOFOLLOW));
+/* Control directory traffic isn't workload */
+static inline void trace_op(enum lb_op op, int e, uint64_t t0, const struct trace_args *a)
+{
+    if (a->path[0] == '/' && ctl_node(a->path) != CTL_NONE) return;
+    trace_record(op, e, t0, a);
+}
+
+typedef struct fuse_file_info fi_t;
+
+OPSTAT_WRAP(getattr, (const char *p, struct stat *st), (p, st),
+        (p, NULL, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(readlink, (const char *p, char *b, size_t n), (p, b, n),
+        (p, NULL, 0, n, 0, 0, 0))
+OPSTAT_WRAP(mknod, (const char *p, mode_t m, dev_t d), (p, m, d),
+        (p, NULL, d, 0, 0, m, 0))
+OPSTAT_WRAP(mkdir, (const char *p, mode_t m), (p, m),
+        (p, NULL, 0, 0, 0, m, 0))
+OPSTAT_WRAP(unlink, (const char *p), (p),
+        (p, NULL, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(rmdir, (const char *p), (p),
+        (p, NULL, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(symlink, (const char *d, const char *l), (d, l),
+        (l, d, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(rename, (const char *o, const char *n), (o, n),
+        (o, n, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(link, (const char *d, const char *l), (d, l),
+        (d, l, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(chmod, (const char *p, mode_t m), (p, m),
+        (p, NULL, 0, 0, 0, m, 0))
+OPSTAT_WRAP(chown, (const char *p, uid_t u, gid_t g), (p, u, g),
+        (p, NULL, u, g, 0, 0, 0))
+OPSTAT_WRAP(truncate, (const char *p, off_t l), (p, l),
+        (p, NULL, l, 0, 0, 0, 0))
+OPSTAT_WRAP(open, (const char *p, fi_t *fi), (p, fi),
+        (p, NULL, 0, 0, fi->flags, 0, fi->fh))
+OPSTAT_WRAP_IO(read, (const char *p, char *b, size_t n, off_t o, fi_t *fi), (p, b, n, o, fi),
+        (p, NULL, o, n, 0, 0, fi->fh))
+OPSTAT_WRAP_IO(write, (const char *p, const char *b, size_t n, off_t o, fi_t *fi), (p, b, n, o, fi),
+        (p, NULL, o, n, 0, 0, fi->fh))
+OPSTAT_WRAP(statfs, (const char *p, struct statvfs *st), (p, st),
+        (p, NULL, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(flush, (const char *p, fi_t *fi), (p, fi),
+        (p, NULL, 0, 0, 0, 0, fi->fh))
+OPSTAT_WRAP(release, (const char *p, fi_t *fi), (p, fi),
+        (p, NULL, 0, 0, fi->flags, 0, fi->fh))
+OPSTAT_WRAP(fsync, (const char *p, int d, fi_t *fi), (p, d, fi),
+        (p, NULL, 0, 0, d, 0, fi->fh))
+OPSTAT_WRAP(setxattr, (const char *p, const char *k, const char *v, size_t n, int f, uint32_t o), (p, k, v, n, f, o),
+        (p, k, o, n, f, 0, 0))
+OPSTAT_WRAP(getxattr, (const char *p, const char *k, char *v, size_t n, uint32_t o), (p, k, v, n, o),
+        (p, k, o, n, 0, 0, 0))
+OPSTAT_WRAP(listxattr, (const char *p, char *b, size_t n), (p, b, n),
+        (p, NULL, 0, n, 0, 0, 0))
+OPSTAT_WRAP(removexattr, (const char *p, const char *k), (p, k),
+        (p, k, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(opendir, (const char *p, fi_t *fi), (p, fi),
+        (p, NULL, 0, 0, fi->flags, 0, fi->fh))
+OPSTAT_WRAP(readdir, (const char *p, void *b, fuse_fill_dir_t f, off_t o, fi_t *fi), (p, b, f, o, fi),
+        (p, NULL, o, 0, 0, 0, fi->fh))
+OPSTAT_WRAP(releasedir, (const char *p, fi_t *fi), (p, fi),
+        (p, NULL, 0, 0, 0, 0, fi->fh))
+OPSTAT_WRAP(fsyncdir, (const char *p, int d, fi_t *fi), (p, d, fi),
+        (p, NULL, 0, 0, d, 0, fi->fh))
+OPSTAT_WRAP(access, (const char *p, int m), (p, m),
+        (p, NULL, 0, 0, m, 0, 0))
+OPSTAT_WRAP(create, (const char *p, mode_t m, fi_t *fi), (p, m, fi),
+        (p, NULL, 0, 0, fi->flags, m, fi->fh))
+OPSTAT_WRAP(ftruncate, (const char *p, off_t l, fi_t *fi), (p, l, fi),
+        (p, NULL, l, 0, 0, 0, fi->fh))
+OPSTAT_WRAP(fgetattr, (const char *p, struct stat *st, fi_t *fi), (p, st, fi),
+        (p, NULL, 0, 0, 0, 0, fi->fh))
+OPSTAT_WRAP(lock, (const char *p, fi_t *fi, int c, struct flock *l), (p, fi, c, l),
+        (p, NULL, l->l_start, l->l_len, c, l->l_type, fi->fh))
+OPSTAT_WRAP(utimens, (const char *p, const struct timespec tv[2]), (p, tv),
+        (p, NULL, tv[0].tv_sec, tv[1].tv_sec, 0, 0, 0))
+OPSTAT_WRAP(flock, (const char *p, fi_t *fi, int op), (p, fi, op),
+        (p, NULL, 0, 0, op, 0, fi->fh))
+OPSTAT_WRAP(fallocate, (const char *p, int m, off_t o, off_t l, fi_t *fi), (p, m, o, l, fi),
+        (p, NULL, o, l, m, 0, fi->fh))
+OPSTAT_WRAP(statfs_x, (const char *p, struct statfs *st), (p, st),
+        (p, NULL, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(setvolname, (const char *v), (v),
+        (v, NULL, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(exchange, (const char *a, const char *b, unsigned long o), (a, b, o),
+        (a, b, 0, 0, o, 0, 0))
+OPSTAT_WRAP(setbkuptime, (const char *p, const struct timespec *tv), (p, tv),
+        (p, NULL, tv->tv_sec, tv->tv_nsec, 0, 0, 0))
+OPSTAT_WRAP(setchgtime, (const char *p, const struct timespec *tv), (p, tv),
+        (p, NULL, tv->tv_sec, tv->tv_nsec, 0, 0, 0))
+OPSTAT_WRAP(setcrtime, (const char *p, const struct timespec *tv), (p, tv),
+        (p, NULL, tv->tv_sec, tv->tv_nsec, 0, 0, 0))
+OPSTAT_WRAP(getxtimes, (const char *p, struct timespec *b, struct timespec *c), (p, b, c),
+        (p, NULL, 0, 0, 0, 0, 0))
+OPSTAT_WRAP(chflags, (const char *p, uint32_t f), (p, f),
+        (p, NULL, 0, 0, f, 0, 0))
+/* Times aren't recorded  size  (uid << 32 | gid)  valid bits  mode */
+OPSTAT_WRAP(setattr_x, (const char *p, struct setattr_x *a), (p, a),
+        (p, NULL, a->size, (uint64_t) a->uid << 32 | a->gid, a->valid, a->mode, 0))
+OPSTAT_WRAP(fsetattr_x, (const char *p, struct setattr_x *a, fi_t *fi), (p, a, fi),
+        (p, NULL, a->size, (uint64_t) a->uid << 32 | a->gid, a->valid, a->mode, fi->fh))
+#if FUSE_VERSION >= 29
+OPSTAT_WRAP_IO(write_buf, (const char *p, struct fuse_bufvec *b, off_t o, fi_t *fi), (p, b, o, fi),
+        (p, NULL, o, fuse_buf_size(b), 0, 0, fi->fh))
+
+/**
+ * Bytes a read_buf() reply will move
+ * fd segments carry the requested size  clamp them to the backing file
+ *  else short reads at EOF count in full
+ */
+static uint64_t read_buf_bytes(const struct fuse_bufvec *b)
+{
+    const struct fuse_buf *s;
+    struct stat st;
+    uint64_t n = 0;
+    size_t i;
+
+    for (i = 0; i < b->count; i++) {
+        s = &b->buf[i];
+        if (!(s->flags & FUSE_BUF_IS_FD)) {
+            n += s->size;
+        } else if (fstat(s->fd, &st) == 0 && st.st_size > s->pos) {
+            n += MIN(s->size, (uint64_t) (st.st_size - s->pos));
+        }
     }
 
-    if (SETATTR_WANTS_FLAGS(attr)) {
-        RET_IF_ERROR(fchflags(fd, attr->flags));
+    return n;
+}
+
+/* Bytes are only known through the returned buffer */
+static int stat_read_buf(
+        const char *path,
+        struct fuse_bufvec **bufp,
+        size_t sz,
+        off_t off,
+        struct fuse_file_info *fi)
+{
+    uint64_t t0 = now_ns();
+    int e = lb_read_buf(path, bufp, sz, off, fi);
+    uint64_t bytes = 0, skew = 0, t1;
+
+    if (e == 0 && opstat_enabled) {
+        /* fstat() isn't part of the op  keep it out of the latency */
+        t1 = now_ns();
+        bytes = read_buf_bytes(*bufp);
+        skew = now_ns() - t1;
     }
+    opstat_record(OP_read_buf, e, bytes, t0 + skew);
+    TRACE_OP(OP_read_buf, e, t0, (path, NULL, off, sz, 0, 0, fi->fh))
+    return e;
+}
+#endif
 
-    return 0;
+/**
+ * Replace every non-NULL callback with its instrumented counterpart
+ */
+static void opstat_install(struct fuse_operations *ops)
+{
+    assert_nonnull(ops);
+
+#define X(op)   if (ops->op != NULL) ops->op = stat_##op;
+    X(getattr) X(readlink) X(mknod) X(mkdir) X(unlink)
+    X(rmdir) X(symlink) X(rename) X(link) X(chmod)
+    X(chown) X(truncate) X(open) X(read) X(write)
+    X(statfs) X(flush) X(release) X(fsync)
+    X(setxattr) X(getxattr) X(listxattr) X(removexattr)
+    X(opendir) X(readdir) X(releasedir) X(fsyncdir)
+    X(access) X(create) X(ftruncate) X(fgetattr) X(lock)
+    X(utimens) X(flock) X(fallocate) X(statfs_x)
+    X(setvolname) X(exchange) X(setbkuptime) X(setchgtime)
+    X(setcrtime) X(getxtimes) X(chflags) X(setattr_x) X(fsetattr_x)
+#if FUSE_VERSION >= 29
+    X(read_buf) X(write_buf)
+#endif
+#undef X
 }
 
 static struct fuse_operations loopback_op = {
@@ -1151,8 +5940,14 @@ static struct fuse_operations loopback_op = {
     .bmap = NULL,
     .ioctl = NULL,
     .poll = NULL,
+#if FUSE_VERSION >= 29
+    /* Zero-copy data path  see: `io=copy' option */
+    .write_buf = lb_write_buf,
+    .read_buf = lb_read_buf,
+#else
     .write_buf = NULL,
     .read_buf = NULL,
+#endif
     .flock = lb_flock,
 
     .fallocate = lb_fallocate,
@@ -1174,16 +5969,126 @@ static struct fuse_operations loopback_op = {
 
 static struct fuse_opt loopback_opts[] = {
     {"case-insensitive", offsetof(struct loopbackfs_config, ci), 1},
+    /*
+     * Toggle between copy(read/write) and zero-copy(read_buf/write_buf) path
+     *  so both can be compared for throughput on the same mount setup
+     */
+    {"io=copy", offsetof(struct loopbackfs_config, copy_io), 1},
+    {"io=zero-copy", offsetof(struct loopbackfs_config, copy_io), 0},
+    {"attr-cache-ttl=%lf", offsetof(struct loopbackfs_config, attr_ttl), 0},
+    {"attr-cache-size=%u", offsetof(struct loopbackfs_config, attr_size), 0},
+    {"neg-cache-ttl=%lf", offsetof(struct loopbackfs_config, neg_ttl), 0},
+    {"neg-cache-size=%u", offsetof(struct loopbackfs_config, neg_size), 0},
+    {"xattr-cache-ttl=%lf", offsetof(struct loopbackfs_config, xattr_ttl), 0},
+    {"xattr-cache-size=%u", offsetof(struct loopbackfs_config, xattr_size), 0},
+    {"readdir-plus", offsetof(struct loopbackfs_config, readdir_plus), 1},
+    {"readdir-batch=%u", offsetof(struct loopbackfs_config, readdir_batch), 0},
+    {"op-stats", offsetof(struct loopbackfs_config, op_stats), 1},
+    {"ctl-dir=%s", offsetof(struct loopbackfs_config, ctl_dir), 0},
+    {"trace=%s", offsetof(struct loopbackfs_config, trace), 0},
+    {"readahead=%u", offsetof(struct loopbackfs_config, readahead), 0},
+    {"write-coalesce=%u", offsetof(struct loopbackfs_config, write_coalesce), 0},
+    {"io-backend=%s", offsetof(struct loopbackfs_config, io_backend), 0},
+    {"io-depth=%u", offsetof(struct loopbackfs_config, io_depth), 0},
+    {"fsync-group=%u", offsetof(struct loopbackfs_config, fsync_group), 0},
+    {"full-fsync", offsetof(struct loopbackfs_config, full_fsync), 1},
+    {"fd-share", offsetof(struct loopbackfs_config, fd_share), 1},
     FUSE_OPT_END,
 };
 
+/**
+ * Parse our own options out of `args' and set up caches and loopback_op
+ * Shared with the in-process bench(see: bench/lbbench.c)  which never mounts
+ * @return      0 if success  -1 otherwise
+ */
+static int lb_setup(struct fuse_args *args)
+{
+    const char *why;
+    int e;
+
+    assert_nonnull(args);
+
+    if (fuse_opt_parse(args, &loopbackfs_cfg, loopback_opts, NULL) < 0) {
+        return -1;
+    }
+
+    if (loopbackfs_cfg.copy_io) {
+        /* libfuse falls back to read()/write() if *_buf() absent */
+        loopback_op.read_buf = NULL;
+        loopback_op.write_buf = NULL;
+    }
+
+    if (cache_init(&attr_cache, loopbackfs_cfg.attr_ttl, loopbackfs_cfg.attr_size) != 0 ||
+            cache_init(&neg_cache, loopbackfs_cfg.neg_ttl, loopbackfs_cfg.neg_size) != 0 ||
+            xattr_cache_init(loopbackfs_cfg.xattr_ttl, loopbackfs_cfg.xattr_size) != 0) {
+        LOG_ERROR("cache init fail");
+        return -1;
+    }
+    /* Names differing in case may reach one file  see: cache_hash() */
+    attr_cache.fold = loopbackfs_cfg.ci || backing_ci();
+    neg_cache.fold = attr_cache.fold;
+    xattr_cache.fold = attr_cache.fold;
+
+    if (loopbackfs_cfg.readdir_batch == 0) loopbackfs_cfg.readdir_batch = 1;
+
+    /* Not settable at runtime  handles opened before would lack inode identity */
+    if (loopbackfs_cfg.write_coalesce != 0) wb_init();
+
+    /* Settable at runtime  so always ready */
+    fd_init();
+
+    if (loopbackfs_cfg.io_backend != NULL && io_select(loopbackfs_cfg.io_backend) != 0) {
+        LOG_ERROR("unknown io-backend on this platform: %s", loopbackfs_cfg.io_backend);
+        return -1;
+    }
+    if (loopbackfs_cfg.io_depth == 0) loopbackfs_cfg.io_depth = 1;
+
+    if (loopbackfs_cfg.fsync_group != 0 && (why = fsg_unsupported()) != NULL) {
+        LOG_ERROR("fsync-group refused  %s", why);
+        return -1;
+    }
+
+    if (ctl_init(loopbackfs_cfg.ctl_dir ? loopbackfs_cfg.ctl_dir : CTL_DIR_DEFAULT) != 0) {
+        LOG_ERROR("bad ctl-dir name: %s", loopbackfs_cfg.ctl_dir);
+        return -1;
+    }
+
+    /* Attributes fetched would be thrown away  pure overhead */
+    if (loopbackfs_cfg.readdir_plus && !cache_enabled(&attr_cache)) {
+        LOG_ERROR("readdir-plus refused  needs attr-cache-ttl");
+        return -1;
+    }
+
+    if (loopbackfs_cfg.op_stats && opstat_init() != 0) {
+        LOG_ERROR("pthread_key_create(3) fail  op stats disabled");
+    }
+
+    /* Opened before fuse_main() chdir(2)s away  relative paths work */
+    if (loopbackfs_cfg.trace != NULL && (e = trace_open(loopbackfs_cfg.trace)) != 0) {
+        LOG_ERROR("cannot open trace file %s  errno: %d", loopbackfs_cfg.trace, -e);
+        return -1;
+    }
+
+    if (opstat_enabled || trace_fd >= 0) {
+        /* Must come after any other tweak to loopback_op */
+        opstat_install(&loopback_op);
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     int e;
+    sigset_t set;
     struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
-    if (fuse_opt_parse(&args, &loopbackfs_cfg, loopback_opts, NULL) < 0) {
-        exit(1);
-    }
+
+    if (lb_setup(&args) != 0) exit(1);
+
+    /* Inherited by all fuse threads  see: stats_signal_thread() */
+    (void) sigemptyset(&set);
+    (void) sigaddset(&set, SIGUSR1);
+    (void) pthread_sigmask(SIG_BLOCK, &set, NULL);
 
     /*
      * [sic]
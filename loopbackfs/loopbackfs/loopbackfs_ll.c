@@ -0,0 +1,1473 @@
+/*
+ * Created 190612 lynnl
+ *
+ * Loopback FUSE filesystem implementation using low-level FUSE API
+ *
+ * Unlike loopbackfs.c  which receives a full path for every operation
+ *  and make kernel re-walk it each time
+ *  this implementation keeps an inode table of opened backing fds
+ *  and resolves children relative to their parent fd via *at() syscalls
+ *  thusly a lookup costs one path component instead of N.
+ *
+ * Xcode settings:
+ *  1) Other Linker Flags:      -losxfuse
+ *  2) Header Search Paths:     /usr/local/include/osxfuse/fuse
+ *  3) Library Search Paths:    /usr/local/lib
+ *
+ * see:
+ *  libfuse/example/passthrough_ll.c
+ *  loopbackfs.c
+ */
+
+#define FUSE_USE_VERSION            26
+#define _FILE_OFFSET_BITS           64
+
+#ifndef _DARWIN_USE_64_BIT_INODE
+#define _DARWIN_USE_64_BIT_INODE    1
+#endif
+
+#include <stdio.h>
+#include <stddef.h>     /* offsetof() */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>      /* openat(2) */
+#include <dirent.h>     /* fdopendir(3) */
+#include <errno.h>
+#include <limits.h>     /* PATH_MAX */
+#include <pthread.h>
+
+#include <sys/stat.h>
+#include <sys/resource.h>   /* setrlimit(2) */
+#include <sys/file.h>   /* flock(2) */
+#include <sys/xattr.h>
+#include <sys/vnode.h>  /* PREALLOCATE */
+#include <sys/statvfs.h>
+
+#include <fuse_lowlevel.h>
+
+#include "utils.h"
+
+struct loopbackfs_ll_config {
+    int ci;     /* Case insensitive? */
+};
+
+static struct loopbackfs_ll_config loopbackfs_ll_cfg; /* Zeroed out */
+
+/* Attribute and entry timeouts replied to kernel(in seconds) */
+#define LB_LL_TIMEOUT       1.0
+
+/*
+ * An inode we handed out to kernel
+ *
+ * For regular files, directories, symlinks and fifos  we keep an fd
+ *  opened with O_EVTONLY | O_SYMLINK  which is the closest macOS has
+ *  to Linux's O_PATH: needs no read permission and won't follow symlinks
+ * Device nodes and sockets can't(or shouldn't) be opened
+ *  for them we remember the path they were looked up as
+ * Kernel may hold lookups of a whole `find' worth of files  past fd budget
+ *  non-directories are remembered by path too  directories always keep an fd
+ *  as their children are resolved relative to it
+ */
+struct lb_inode {
+    struct lb_inode *next;      /* Hash chain */
+    int fd;                     /* -1 if inode not backed by an fd */
+    char *path;                 /* Only valid if fd is -1 */
+    dev_t dev;
+    ino_t ino;
+    uint64_t nlookup;           /* Protected by inode table lock */
+};
+
+#define INODE_TABLE_SIZE    4096    /* Must be power of 2 */
+
+static struct {
+    pthread_mutex_t lock;
+    struct lb_inode *buckets[INODE_TABLE_SIZE];
+    struct lb_inode root;       /* Never freed */
+    unsigned nfds;              /* Inode fds opened  root excluded */
+    unsigned fd_budget;         /* Zero if unlimited  see: lb_ll_setup() */
+} itab = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static inline struct lb_inode *get_inode(fuse_ino_t ino)
+{
+    if (ino == FUSE_ROOT_ID) return &itab.root;
+    return (struct lb_inode *) (uintptr_t) ino;
+}
+
+static inline fuse_ino_t inode_id(struct lb_inode *i)
+{
+    if (i == &itab.root) return FUSE_ROOT_ID;
+    return (fuse_ino_t) (uintptr_t) i;
+}
+
+static inline size_t inode_hash(dev_t dev, ino_t ino)
+{
+    uint64_t h = (uint64_t) ino * 0x9e3779b97f4a7c15ULL ^ (uint64_t) dev;
+    return (size_t) (h >> 20) & (INODE_TABLE_SIZE - 1);
+}
+
+/* Should be called with inode table lock held */
+static inline int fd_budget_full(void)
+{
+    return itab.fd_budget != 0 && itab.nfds >= itab.fd_budget;
+}
+
+/**
+ * Resolve backing path of an inode
+ * Only used by operations which have no *at() or f*() counterpart on macOS
+ * @return      0 on success  -errno otherwise
+ */
+static int inode_path(struct lb_inode *i, char buf[PATH_MAX])
+{
+    assert_nonnull(i);
+    assert_nonnull(buf);
+
+    if (i->fd < 0) {
+        assert_nonnull(i->path);
+        if (strlen(i->path) >= PATH_MAX) return -ENAMETOOLONG;
+        (void) strcpy(buf, i->path);
+        return 0;
+    }
+
+    return fcntl(i->fd, F_GETPATH, buf) < 0 ? -errno : 0;
+}
+
+/**
+ * Resolve backing path of an entry in directory `dir'
+ */
+static int child_path(struct lb_inode *dir, const char *name, char buf[PATH_MAX])
+{
+    int e;
+    size_t len;
+
+    e = inode_path(dir, buf);
+    if (e != 0) return e;
+
+    len = strlen(buf);
+    if (len + 1 + strlen(name) >= PATH_MAX) return -ENAMETOOLONG;
+    if (len == 0 || buf[len-1] != '/') buf[len++] = '/';
+    (void) strcpy(buf + len, name);
+    return 0;
+}
+
+static int inode_stat(struct lb_inode *i, struct stat *st)
+{
+    assert_nonnull(i);
+    assert_nonnull(st);
+    return i->fd >= 0 ? fstat(i->fd, st) : lstat(i->path, st);
+}
+
+/**
+ * Open a backing handle of an entry which we know its type
+ * @return      fd  or -1 if this type of file won't be opened
+ */
+static int open_child(int dirfd, const char *name, mode_t mode)
+{
+    int fd;
+
+    if (S_ISDIR(mode)) {
+        /* Try a readable fd first  it can also serve fdopendir(3) */
+        fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        if (fd >= 0) return fd;
+    } else if (!S_ISREG(mode) && !S_ISLNK(mode) && !S_ISFIFO(mode)) {
+        return -1;
+    }
+
+    return openat(dirfd, name, O_EVTONLY | O_SYMLINK | O_NONBLOCK);
+}
+
+/**
+ * Look up an entry and take a lookup reference on its inode
+ * @return      0 on success  -errno otherwise
+ */
+static int do_lookup(fuse_ino_t parent, const char *name, struct fuse_entry_param *ep)
+{
+    struct lb_inode *dir;
+    struct lb_inode *i;
+    struct lb_inode *n;
+    char path[PATH_MAX];
+    size_t h;
+    int full;
+    int fd;
+    int e;
+
+    assert_nonnull(name);
+    assert_nonnull(ep);
+
+    dir = get_inode(parent);
+    assert(dir->fd >= 0);
+
+    (void) memset(ep, 0, sizeof(*ep));
+    ep->attr_timeout = LB_LL_TIMEOUT;
+    ep->entry_timeout = LB_LL_TIMEOUT;
+
+    if (fstatat(dir->fd, name, &ep->attr, AT_SYMLINK_NOFOLLOW) < 0) return -errno;
+
+    h = inode_hash(ep->attr.st_dev, ep->attr.st_ino);
+
+    /* Fast path: inode already known  no need to open anything */
+    (void) pthread_mutex_lock(&itab.lock);
+    for (i = itab.buckets[h]; i != NULL; i = i->next) {
+        if (i->ino == ep->attr.st_ino && i->dev == ep->attr.st_dev) {
+            i->nlookup++;
+            (void) pthread_mutex_unlock(&itab.lock);
+            ep->ino = inode_id(i);
+            return 0;
+        }
+    }
+    full = fd_budget_full();
+    (void) pthread_mutex_unlock(&itab.lock);
+
+    n = calloc(1, sizeof(*n));
+    if (n == NULL) return -ENOMEM;
+
+    if (S_ISDIR(ep->attr.st_mode)) {
+        fd = open_child(dir->fd, name, ep->attr.st_mode);
+        if (fd < 0) {
+            e = -errno;
+            free(n);
+            return e;
+        }
+    } else {
+        /* Out of fds is no error  fall back to path as if budget ran out */
+        fd = full ? -1 : open_child(dir->fd, name, ep->attr.st_mode);
+    }
+
+    if (fd < 0) {
+        e = child_path(dir, name, path);
+        if (e == 0 && (n->path = strdup(path)) == NULL) e = -ENOMEM;
+        if (e != 0) {
+            free(n);
+            return e;
+        }
+    }
+
+    n->fd = fd;
+    n->dev = ep->attr.st_dev;
+    n->ino = ep->attr.st_ino;
+    n->nlookup = 1;
+
+    (void) pthread_mutex_lock(&itab.lock);
+    /* Someone may inserted the same inode while we opening it */
+    for (i = itab.buckets[h]; i != NULL; i = i->next) {
+        if (i->ino == n->ino && i->dev == n->dev) break;
+    }
+    if (i != NULL) {
+        i->nlookup++;
+    } else {
+        n->next = itab.buckets[h];
+        itab.buckets[h] = n;
+        if (n->fd >= 0) itab.nfds++;
+        i = n;
+        n = NULL;
+    }
+    (void) pthread_mutex_unlock(&itab.lock);
+
+    if (n != NULL) {
+        if (n->fd >= 0) (void) close(n->fd);
+        free(n->path);
+        free(n);
+    }
+
+    ep->ino = inode_id(i);
+    return 0;
+}
+
+static void unref_inode(struct lb_inode *i, uint64_t n)
+{
+    struct lb_inode **pp;
+
+    assert_nonnull(i);
+    if (i == &itab.root) return;
+
+    (void) pthread_mutex_lock(&itab.lock);
+    assert(i->nlookup >= n);
+    i->nlookup -= n;
+    if (i->nlookup != 0) {
+        (void) pthread_mutex_unlock(&itab.lock);
+        return;
+    }
+
+    pp = &itab.buckets[inode_hash(i->dev, i->ino)];
+    while (*pp != i) {
+        assert_nonnull(*pp);
+        pp = &(*pp)->next;
+    }
+    *pp = i->next;
+    if (i->fd >= 0) itab.nfds--;
+    (void) pthread_mutex_unlock(&itab.lock);
+
+    if (i->fd >= 0) (void) close(i->fd);
+    free(i->path);
+    free(i);
+}
+
+/**
+ * Reply an error(or success if err is zero) to kernel
+ * Reply may fail if the request was interrupted  nothing we can do about it
+ */
+static void reply_err(fuse_req_t req, int err)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert(err >= 0);
+
+    e = fuse_reply_err(req, err);
+    if (e != 0) SYSLOG_WARN("fuse_reply_err() fail  errno: %d", -e);
+}
+
+static void reply_entry(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    struct fuse_entry_param ep;
+    int e;
+
+    e = do_lookup(parent, name, &ep);
+    if (e != 0) {
+        reply_err(req, -e);
+    } else if (fuse_reply_entry(req, &ep) != 0) {
+        /* Kernel won't know about this lookup  drop our reference */
+        unref_inode(get_inode(ep.ino), 1);
+    }
+}
+
+static void lb_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    assert_nonnull(req);
+    assert_nonnull(name);
+    reply_entry(req, parent, name);
+}
+
+static void lb_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup)
+{
+    assert_nonnull(req);
+    unref_inode(get_inode(ino), nlookup);
+    fuse_reply_none(req);
+}
+
+static void lb_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    struct stat st;
+    int e;
+
+    assert_nonnull(req);
+
+    e = fi != NULL ? fstat((int) fi->fh, &st) : inode_stat(get_inode(ino), &st);
+    if (e < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    e = fuse_reply_attr(req, &st, LB_LL_TIMEOUT);
+    if (e != 0) SYSLOG_WARN("fuse_reply_attr() fail  errno: %d", -e);
+}
+
+static void lb_ll_setattr(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        struct stat *attr,
+        int to_set,
+        struct fuse_file_info *fi)
+{
+    struct lb_inode *i;
+    char path[PATH_MAX];
+    struct timespec tv[2];
+    uid_t uid;
+    gid_t gid;
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(attr);
+
+    i = get_inode(ino);
+
+    if (to_set & FUSE_SET_ATTR_MODE) {
+        e = i->fd >= 0 ? fchmod(i->fd, attr->st_mode) : lchmod(i->path, attr->st_mode);
+        if (e < 0) goto out_errno;
+    }
+
+    if (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID)) {
+        uid = (to_set & FUSE_SET_ATTR_UID) ? attr->st_uid : (uid_t) -1;
+        gid = (to_set & FUSE_SET_ATTR_GID) ? attr->st_gid : (gid_t) -1;
+        e = i->fd >= 0 ? fchown(i->fd, uid, gid) : lchown(i->path, uid, gid);
+        if (e < 0) goto out_errno;
+    }
+
+    if (to_set & FUSE_SET_ATTR_SIZE) {
+        if (fi != NULL) {
+            e = ftruncate((int) fi->fh, attr->st_size);
+        } else {
+            /* Our inode fd isn't writable  fall back to path */
+            e = inode_path(i, path);
+            if (e != 0) goto out_err;
+            e = truncate(path, attr->st_size);
+        }
+        if (e < 0) goto out_errno;
+    }
+
+    if (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME)) {
+        tv[0].tv_sec = 0;
+        tv[0].tv_nsec = UTIME_OMIT;
+        tv[1].tv_sec = 0;
+        tv[1].tv_nsec = UTIME_OMIT;
+
+        if (to_set & FUSE_SET_ATTR_ATIME) tv[0] = attr->st_atimespec;
+        if (to_set & FUSE_SET_ATTR_MTIME) tv[1] = attr->st_mtimespec;
+#ifdef FUSE_SET_ATTR_ATIME_NOW
+        if (to_set & FUSE_SET_ATTR_ATIME_NOW) tv[0].tv_nsec = UTIME_NOW;
+        if (to_set & FUSE_SET_ATTR_MTIME_NOW) tv[1].tv_nsec = UTIME_NOW;
+#endif
+
+        if (fi != NULL) {
+            e = futimens((int) fi->fh, tv);
+        } else if (i->fd >= 0) {
+            e = futimens(i->fd, tv);
+        } else {
+            e = utimensat(AT_FDCWD, i->path, tv, AT_SYMLINK_NOFOLLOW);
+        }
+        if (e < 0) goto out_errno;
+    }
+
+#if defined(__APPLE__) && defined(FUSE_SET_ATTR_FLAGS)
+    if (to_set & FUSE_SET_ATTR_FLAGS) {
+        e = i->fd >= 0 ? fchflags(i->fd, attr->st_flags) : lchflags(i->path, attr->st_flags);
+        if (e < 0) goto out_errno;
+    }
+#endif
+
+    lb_ll_getattr(req, ino, fi);
+    return;
+
+out_errno:
+    e = -errno;
+out_err:
+    reply_err(req, -e);
+}
+
+static void lb_ll_readlink(fuse_req_t req, fuse_ino_t ino)
+{
+    char path[PATH_MAX];
+    char buf[PATH_MAX];
+    ssize_t n;
+    int e;
+
+    assert_nonnull(req);
+
+    /* macOS got no freadlink(2) */
+    e = inode_path(get_inode(ino), path);
+    if (e != 0) {
+        reply_err(req, -e);
+        return;
+    }
+
+    n = readlink(path, buf, sizeof(buf) - 1);
+    if (n < 0) {
+        reply_err(req, errno);
+        return;
+    }
+    buf[n] = '\0';
+
+    e = fuse_reply_readlink(req, buf);
+    if (e != 0) SYSLOG_WARN("fuse_reply_readlink() fail  errno: %d", -e);
+}
+
+static void lb_ll_mknod(
+        fuse_req_t req,
+        fuse_ino_t parent,
+        const char *name,
+        mode_t mode,
+        dev_t rdev)
+{
+    char path[PATH_MAX];
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(name);
+
+    /* mknodat(2) not available on older macOS  resolve parent once */
+    e = child_path(get_inode(parent), name, path);
+    if (e != 0) {
+        reply_err(req, -e);
+        return;
+    }
+
+    e = S_ISFIFO(mode) ? mkfifo(path, mode) : mknod(path, mode, rdev);
+    if (e < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    reply_entry(req, parent, name);
+}
+
+static void lb_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode)
+{
+    assert_nonnull(req);
+    assert_nonnull(name);
+
+    if (mkdirat(get_inode(parent)->fd, name, mode) < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    reply_entry(req, parent, name);
+}
+
+static void lb_ll_symlink(
+        fuse_req_t req,
+        const char *link,
+        fuse_ino_t parent,
+        const char *name)
+{
+    assert_nonnull(req);
+    assert_nonnull(link);
+    assert_nonnull(name);
+
+    if (symlinkat(link, get_inode(parent)->fd, name) < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    reply_entry(req, parent, name);
+}
+
+static void lb_ll_link(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        fuse_ino_t newparent,
+        const char *newname)
+{
+    char path[PATH_MAX];
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(newname);
+
+    /* No AT_EMPTY_PATH on macOS  source must be named by path */
+    e = inode_path(get_inode(ino), path);
+    if (e != 0) {
+        reply_err(req, -e);
+        return;
+    }
+
+    if (linkat(AT_FDCWD, path, get_inode(newparent)->fd, newname, 0) < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    reply_entry(req, newparent, newname);
+}
+
+static void lb_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(name);
+
+    e = unlinkat(get_inode(parent)->fd, name, 0);
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+static void lb_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(name);
+
+    e = unlinkat(get_inode(parent)->fd, name, AT_REMOVEDIR);
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+static void lb_ll_rename(
+        fuse_req_t req,
+        fuse_ino_t parent,
+        const char *name,
+        fuse_ino_t newparent,
+        const char *newname)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(name);
+    assert_nonnull(newname);
+
+    e = renameat(get_inode(parent)->fd, name, get_inode(newparent)->fd, newname);
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+static void lb_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    char path[PATH_MAX];
+    int fd;
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+
+    /*
+     * Inode fd was opened O_EVTONLY  it can't be reopened with other flags
+     *  thusly this is the only place(besides few rare ops) we walk a path
+     */
+    e = inode_path(get_inode(ino), path);
+    if (e != 0) {
+        reply_err(req, -e);
+        return;
+    }
+
+    fd = open(path, fi->flags & ~O_CREAT);
+    if (fd < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    fi->fh = fd;
+    if (fuse_reply_open(req, fi) != 0) (void) close(fd);
+}
+
+static void lb_ll_create(
+        fuse_req_t req,
+        fuse_ino_t parent,
+        const char *name,
+        mode_t mode,
+        struct fuse_file_info *fi)
+{
+    struct fuse_entry_param ep;
+    int fd;
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(name);
+    assert_nonnull(fi);
+
+    fd = openat(get_inode(parent)->fd, name, fi->flags | O_CREAT, mode);
+    if (fd < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    e = do_lookup(parent, name, &ep);
+    if (e != 0) {
+        (void) close(fd);
+        reply_err(req, -e);
+        return;
+    }
+
+    fi->fh = fd;
+    if (fuse_reply_create(req, &ep, fi) != 0) {
+        (void) close(fd);
+        unref_inode(get_inode(ep.ino), 1);
+    }
+}
+
+static void lb_ll_read(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        size_t size,
+        off_t off,
+        struct fuse_file_info *fi)
+{
+    int e;
+#if FUSE_VERSION >= 29
+    /* Let libfuse move data from backing fd directly  see: lb_read_buf() */
+    struct fuse_bufvec buf = FUSE_BUFVEC_INIT(size);
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    UNUSED(ino);
+
+    buf.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+    buf.buf[0].fd = (int) fi->fh;
+    buf.buf[0].pos = off;
+
+    e = fuse_reply_data(req, &buf, FUSE_BUF_SPLICE_MOVE);
+    if (e != 0) SYSLOG_WARN("fuse_reply_data() fail  errno: %d", -e);
+#else
+    char *buf;
+    ssize_t n;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+
+    buf = malloc(size);
+    if (buf == NULL) {
+        reply_err(req, ENOMEM);
+        return;
+    }
+
+    n = pread((int) fi->fh, buf, size, off);
+    if (n < 0) {
+        reply_err(req, errno);
+    } else {
+        e = fuse_reply_buf(req, buf, (size_t) n);
+        if (e != 0) SYSLOG_WARN("fuse_reply_buf() fail  errno: %d", -e);
+    }
+
+    free(buf);
+#endif
+}
+
+static void lb_ll_write(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        const char *buf,
+        size_t size,
+        off_t off,
+        struct fuse_file_info *fi)
+{
+    ssize_t n;
+    int e;
+
+    assert_nonnull(req);
+    assert(!!buf | !size);
+    assert_nonnull(fi);
+    UNUSED(ino);
+
+    n = pwrite((int) fi->fh, buf, size, off);
+    if (n < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    e = fuse_reply_write(req, (size_t) n);
+    if (e != 0) SYSLOG_WARN("fuse_reply_write() fail  errno: %d", -e);
+}
+
+static void lb_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    int fd;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    UNUSED(ino);
+
+    /* see: loopbackfs.c#lb_flush() */
+    fd = dup((int) fi->fh);
+    if (fd < 0 || close(fd) < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    reply_err(req, 0);
+}
+
+static void lb_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    UNUSED(ino);
+
+    (void) close((int) fi->fh);
+    reply_err(req, 0);
+}
+
+static int sync_fd(int fd)
+{
+#if USE_FULL_FSYNC
+    return fcntl(fd, F_FULLFSYNC);
+#else
+    return fsync(fd);
+#endif
+}
+
+static void lb_ll_fsync(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        int datasync,
+        struct fuse_file_info *fi)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    UNUSED(ino);
+    UNUSED(datasync);
+
+    e = sync_fd((int) fi->fh);
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+struct lb_ll_dirp {
+    DIR *dp;
+    struct dirent *entry;
+    off_t offset;
+};
+
+static inline struct lb_ll_dirp *get_dirp(struct fuse_file_info *fi)
+{
+    assert_nonnull(fi);
+    return (struct lb_ll_dirp *) (uintptr_t) fi->fh;
+}
+
+static void lb_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    struct lb_ll_dirp *d;
+    int fd;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+
+    d = malloc(sizeof(*d));
+    if (d == NULL) {
+        reply_err(req, ENOMEM);
+        return;
+    }
+
+    /* A fresh fd so that each opendir() have its own directory offset */
+    fd = openat(get_inode(ino)->fd, ".", O_RDONLY | O_DIRECTORY);
+    if (fd < 0) goto out_errno;
+
+    d->dp = fdopendir(fd);
+    if (d->dp == NULL) {
+        (void) close(fd);
+        goto out_errno;
+    }
+
+    d->entry = NULL;
+    d->offset = 0;
+
+    fi->fh = (uint64_t) (uintptr_t) d;
+    if (fuse_reply_open(req, fi) != 0) {
+        (void) closedir(d->dp);
+        free(d);
+    }
+    return;
+
+out_errno:
+    reply_err(req, errno);
+    free(d);
+}
+
+static void lb_ll_readdir(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        size_t size,
+        off_t off,
+        struct fuse_file_info *fi)
+{
+    struct lb_ll_dirp *d;
+    struct stat st;
+    char *buf;
+    char *p;
+    size_t rem;
+    size_t entsz;
+    off_t nextoff;
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    assert(off >= 0);
+    UNUSED(ino);
+
+    d = get_dirp(fi);
+    assert_nonnull(d);
+
+    buf = malloc(size);
+    if (buf == NULL) {
+        reply_err(req, ENOMEM);
+        return;
+    }
+
+    if (off != d->offset) {
+        seekdir(d->dp, (long) off);
+        d->entry = NULL;
+        d->offset = off;
+    }
+
+    p = buf;
+    rem = size;
+    while (1) {
+        if (d->entry == NULL) {
+            errno = 0;
+            if ((d->entry = readdir(d->dp)) == NULL) {
+                /* Report error only if nothing filled yet */
+                if (errno != 0 && rem == size) {
+                    reply_err(req, errno);
+                    free(buf);
+                    return;
+                }
+                break;
+            }
+        }
+
+        /* Kernel only use st_ino and file type bits of st_mode */
+        (void) memset(&st, 0, sizeof(st));
+        st.st_ino = d->entry->d_ino;
+        st.st_mode = DTTOIF(d->entry->d_type);
+        nextoff = telldir(d->dp);
+
+        entsz = fuse_add_direntry(req, p, rem, d->entry->d_name, &st, nextoff);
+        /* break if dir buffer is full */
+        if (entsz > rem) break;
+
+        p += entsz;
+        rem -= entsz;
+        d->entry = NULL;
+        d->offset = nextoff;
+    }
+
+    e = fuse_reply_buf(req, buf, size - rem);
+    if (e != 0) SYSLOG_WARN("fuse_reply_buf() fail  errno: %d", -e);
+    free(buf);
+}
+
+static void lb_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi)
+{
+    struct lb_ll_dirp *d;
+
+    assert_nonnull(req);
+    UNUSED(ino);
+
+    d = get_dirp(fi);
+    assert_nonnull(d);
+    assert_nonnull(d->dp);
+
+    (void) closedir(d->dp);
+    free(d);
+    reply_err(req, 0);
+}
+
+static void lb_ll_fsyncdir(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        int datasync,
+        struct fuse_file_info *fi)
+{
+    struct lb_ll_dirp *d;
+    int e;
+
+    assert_nonnull(req);
+    UNUSED(ino);
+    UNUSED(datasync);
+
+    d = get_dirp(fi);
+    assert_nonnull(d);
+
+    e = sync_fd(dirfd(d->dp));
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+static void lb_ll_statfs(fuse_req_t req, fuse_ino_t ino)
+{
+    struct lb_inode *i;
+    struct statvfs st;
+    int e;
+
+    assert_nonnull(req);
+
+    i = get_inode(ino);
+    e = i->fd >= 0 ? fstatvfs(i->fd, &st) : statvfs(i->path, &st);
+    if (e < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    e = fuse_reply_statfs(req, &st);
+    if (e != 0) SYSLOG_WARN("fuse_reply_statfs() fail  errno: %d", -e);
+}
+
+static void lb_ll_access(fuse_req_t req, fuse_ino_t ino, int mask)
+{
+    char path[PATH_MAX];
+    int e;
+
+    assert_nonnull(req);
+
+    /* No faccessat(2) relative to the file itself */
+    e = inode_path(get_inode(ino), path);
+    if (e != 0) {
+        reply_err(req, -e);
+        return;
+    }
+
+    e = faccessat(AT_FDCWD, path, mask, AT_SYMLINK_NOFOLLOW);
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+/*
+ * Extended attributes
+ *
+ * Operate on the inode fd  which was opened with O_SYMLINK
+ *  hence it behaves as XATTR_NOFOLLOW  see: loopbackfs.c
+ */
+
+#define XATTR_APPLE_PREFIX          "com.apple."
+#define A_KAUTH_FILESEC_XATTR       "com.apple.system.Security"
+#define P_KAUTH_FILESEC_XATTR       "pseudo." A_KAUTH_FILESEC_XATTR
+
+static const char *map_xattr_name(const char *name)
+{
+    assert_nonnull(name);
+    return strcmp(name, A_KAUTH_FILESEC_XATTR) ? name : P_KAUTH_FILESEC_XATTR;
+}
+
+static void lb_ll_setxattr(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        const char *name,
+        const char *value,
+        size_t size,
+        int flags,
+        uint32_t position)
+{
+    struct lb_inode *i;
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(name);
+    assert(!!value || !size);
+
+    if (!strncmp(name, XATTR_APPLE_PREFIX, STRLEN(XATTR_APPLE_PREFIX))) {
+        /* Kernel-only flags  see: loopbackfs.c#lb_setxattr() */
+        flags &= ~(XATTR_NOSECURITY | XATTR_NODEFAULT);
+    }
+
+    i = get_inode(ino);
+    if (i->fd >= 0) {
+        e = fsetxattr(i->fd, map_xattr_name(name), value, size, position, flags);
+    } else {
+        e = setxattr(i->path, map_xattr_name(name), value, size, position, flags | XATTR_NOFOLLOW);
+    }
+
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+static void lb_ll_getxattr(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        const char *name,
+        size_t size,
+        uint32_t position)
+{
+    struct lb_inode *i;
+    char *buf = NULL;
+    ssize_t n;
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(name);
+
+    if (size != 0 && (buf = malloc(size)) == NULL) {
+        reply_err(req, ENOMEM);
+        return;
+    }
+
+    i = get_inode(ino);
+    if (i->fd >= 0) {
+        n = fgetxattr(i->fd, map_xattr_name(name), buf, size, position, 0);
+    } else {
+        n = getxattr(i->path, map_xattr_name(name), buf, size, position, XATTR_NOFOLLOW);
+    }
+
+    if (n < 0) {
+        reply_err(req, errno);
+    } else {
+        e = size == 0 ? fuse_reply_xattr(req, (size_t) n) : fuse_reply_buf(req, buf, (size_t) n);
+        if (e != 0) SYSLOG_WARN("getxattr() reply fail  errno: %d", -e);
+    }
+
+    free(buf);
+}
+
+/**
+ * Strip P_KAUTH_FILESEC_XATTR out of a listxattr(2) name buffer
+ * @return      new length of the name buffer
+ */
+static size_t filter_xattr_names(char *namebuf, size_t len)
+{
+    char *curr = namebuf;
+    size_t currlen;
+
+    while (curr < namebuf + len) {
+        currlen = strlen(curr) + 1;
+        /* Don't expose fake A_KAUTH_FILESEC_XATTR to user space */
+        if (!strcmp(curr, P_KAUTH_FILESEC_XATTR)) {
+            (void) memmove(curr, curr + currlen, namebuf + len - curr - currlen);
+            return len - currlen;
+        }
+        curr += currlen;
+    }
+
+    return len;
+}
+
+static void lb_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
+{
+    struct lb_inode *i;
+    char *buf;
+    ssize_t n;
+    size_t len;
+    int e;
+
+    assert_nonnull(req);
+
+    i = get_inode(ino);
+
+    /*
+     * Always fetch the names  even for a size probe
+     *  since the pseudo attribute must be subtracted from the size
+     */
+    if (i->fd >= 0) {
+        n = flistxattr(i->fd, NULL, 0, 0);
+    } else {
+        n = listxattr(i->path, NULL, 0, XATTR_NOFOLLOW);
+    }
+    if (n <= 0) {
+        if (n < 0) {
+            reply_err(req, errno);
+        } else {
+            e = size == 0 ? fuse_reply_xattr(req, 0) : fuse_reply_buf(req, NULL, 0);
+            if (e != 0) SYSLOG_WARN("listxattr() reply fail  errno: %d", -e);
+        }
+        return;
+    }
+
+    buf = malloc((size_t) n);
+    if (buf == NULL) {
+        reply_err(req, ENOMEM);
+        return;
+    }
+
+    if (i->fd >= 0) {
+        n = flistxattr(i->fd, buf, (size_t) n, 0);
+    } else {
+        n = listxattr(i->path, buf, (size_t) n, XATTR_NOFOLLOW);
+    }
+    if (n < 0) {
+        reply_err(req, errno);
+        free(buf);
+        return;
+    }
+
+    len = filter_xattr_names(buf, (size_t) n);
+    if (size == 0) {
+        e = fuse_reply_xattr(req, len);
+    } else if (size < len) {
+        e = fuse_reply_err(req, ERANGE);
+    } else {
+        e = fuse_reply_buf(req, buf, len);
+    }
+    if (e != 0) SYSLOG_WARN("listxattr() reply fail  errno: %d", -e);
+
+    free(buf);
+}
+
+static void lb_ll_removexattr(fuse_req_t req, fuse_ino_t ino, const char *name)
+{
+    struct lb_inode *i;
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(name);
+
+    i = get_inode(ino);
+    if (i->fd >= 0) {
+        e = fremovexattr(i->fd, map_xattr_name(name), 0);
+    } else {
+        e = removexattr(i->path, map_xattr_name(name), XATTR_NOFOLLOW);
+    }
+
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+static void lb_ll_getlk(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        struct fuse_file_info *fi,
+        struct flock *lock)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    assert_nonnull(lock);
+    UNUSED(ino);
+
+    if (fcntl((int) fi->fh, F_GETLK, lock) < 0) {
+        reply_err(req, errno);
+        return;
+    }
+
+    e = fuse_reply_lock(req, lock);
+    if (e != 0) SYSLOG_WARN("fuse_reply_lock() fail  errno: %d", -e);
+}
+
+static void lb_ll_setlk(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        struct fuse_file_info *fi,
+        struct flock *lock,
+        int sleep)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    assert_nonnull(lock);
+    UNUSED(ino);
+
+    e = fcntl((int) fi->fh, sleep ? F_SETLKW : F_SETLK, lock);
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+static void lb_ll_flock(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        struct fuse_file_info *fi,
+        int op)
+{
+    int e;
+
+    assert_nonnull(req);
+    assert_nonnull(fi);
+    UNUSED(ino);
+
+    e = flock((int) fi->fh, op);
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+/**
+ * see: loopbackfs.c#lb_fallocate()
+ */
+static void lb_ll_fallocate(
+        fuse_req_t req,
+        fuse_ino_t ino,
+        int mode,
+        off_t off,
+        off_t len,
+        struct fuse_file_info *fi)
+{
+    fstore_t fst;
+    int e;
+
+    assert_nonnull(req);
+    assert(off >= 0);
+    assert(len >= 0);
+    assert_nonnull(fi);
+    UNUSED(ino);
+
+    if ((mode & PREALLOCATE) == 0) {
+        reply_err(req, ENOTSUP);
+        return;
+    }
+
+    fst.fst_flags = 0;
+    if (mode & ALLOCATECONTIG) {
+        fst.fst_flags |= F_ALLOCATECONTIG;
+    }
+    if (mode & ALLOCATEALL) {
+        fst.fst_flags |= F_ALLOCATEALL;
+    }
+
+    if (mode & ALLOCATEFROMPEOF) {
+        fst.fst_posmode = F_PEOFPOSMODE;
+    } else if (mode & ALLOCATEFROMVOL) {
+        fst.fst_posmode = F_VOLPOSMODE;
+    }
+
+    fst.fst_offset = off;
+    fst.fst_length = len;
+
+    e = fcntl((int) fi->fh, F_PREALLOCATE, &fst);
+    reply_err(req, e < 0 ? errno : 0);
+}
+
+static void lb_ll_init(void *userdata, struct fuse_conn_info *conn)
+{
+    UNUSED(userdata);
+    assert_nonnull(conn);
+
+    if (loopbackfs_ll_cfg.ci) {
+        FUSE_ENABLE_CASE_INSENSITIVE(conn);
+    }
+}
+
+static const struct fuse_lowlevel_ops lb_ll_ops = {
+    .init = lb_ll_init,
+    .lookup = lb_ll_lookup,
+    .forget = lb_ll_forget,
+    .getattr = lb_ll_getattr,
+    .setattr = lb_ll_setattr,
+    .readlink = lb_ll_readlink,
+    .mknod = lb_ll_mknod,
+    .mkdir = lb_ll_mkdir,
+    .unlink = lb_ll_unlink,
+    .rmdir = lb_ll_rmdir,
+    .symlink = lb_ll_symlink,
+    .rename = lb_ll_rename,
+    .link = lb_ll_link,
+    .open = lb_ll_open,
+    .read = lb_ll_read,
+    .write = lb_ll_write,
+    .flush = lb_ll_flush,
+    .release = lb_ll_release,
+    .fsync = lb_ll_fsync,
+    .opendir = lb_ll_opendir,
+    .readdir = lb_ll_readdir,
+    .releasedir = lb_ll_releasedir,
+    .fsyncdir = lb_ll_fsyncdir,
+    .statfs = lb_ll_statfs,
+    .setxattr = lb_ll_setxattr,
+    .getxattr = lb_ll_getxattr,
+    .listxattr = lb_ll_listxattr,
+    .removexattr = lb_ll_removexattr,
+    .access = lb_ll_access,
+    .create = lb_ll_create,
+    .getlk = lb_ll_getlk,
+    .setlk = lb_ll_setlk,
+    .flock = lb_ll_flock,
+    .fallocate = lb_ll_fallocate,
+};
+
+static struct fuse_opt loopback_ll_opts[] = {
+    {"case-insensitive", offsetof(struct loopbackfs_ll_config, ci), 1},
+    FUSE_OPT_END,
+};
+
+/*
+ * Each looked up inode keeps an fd  macOS's default soft limit(256)
+ *  won't survive a `find' over the mount
+ * Raise it to the hard limit  and leave a quarter of it to file handles
+ */
+static void raise_nofile(void)
+{
+    struct rlimit rl;
+    rlim_t n;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        LOG_WARN("getrlimit(2) fail  errno: %d", errno);
+        return;
+    }
+
+    n = rl.rlim_max;
+#ifdef OPEN_MAX
+    /* Darwin rejects RLIM_INFINITY or anything past OPEN_MAX */
+    if (n > OPEN_MAX) n = OPEN_MAX;
+#endif
+    if (n > rl.rlim_cur) {
+        rl.rlim_cur = n;
+        if (setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+            LOG_WARN("setrlimit(2) fail  errno: %d", errno);
+            if (getrlimit(RLIMIT_NOFILE, &rl) < 0) return;
+        }
+    }
+
+    n = rl.rlim_cur - rl.rlim_cur / 4;
+    itab.fd_budget = n < UINT_MAX ? (unsigned) n : UINT_MAX;
+}
+
+/**
+ * Open the root inode and size the fd budget
+ * @return      0 on success  -errno otherwise
+ */
+static int lb_ll_setup(void)
+{
+    struct stat st;
+    int e;
+
+    raise_nofile();
+
+    /* Same as loopbackfs.c  we mirror the whole file system */
+    itab.root.fd = open("/", O_RDONLY | O_DIRECTORY);
+    if (itab.root.fd < 0) {
+        e = -errno;
+        LOG_ERROR("open(2) root fail  errno: %d", -e);
+        return e;
+    }
+    if (fstat(itab.root.fd, &st) < 0) {
+        e = -errno;
+        LOG_ERROR("fstat(2) root fail  errno: %d", -e);
+        (void) close(itab.root.fd);
+        return e;
+    }
+    itab.root.dev = st.st_dev;
+    itab.root.ino = st.st_ino;
+    itab.root.nlookup = 2;
+    /* So that lookup("..") of a top level directory yields the root */
+    itab.buckets[inode_hash(st.st_dev, st.st_ino)] = &itab.root;
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_chan *ch;
+    struct fuse_session *se;
+    char *mountpoint = NULL;
+    int multithreaded;
+    int foreground;
+    int e;
+
+    if (fuse_opt_parse(&args, &loopbackfs_ll_cfg, loopback_ll_opts, NULL) < 0) {
+        LOG_ERROR("fuse_opt_parse() fail");
+        e = 1;
+        goto out_fail;
+    }
+
+    e = fuse_parse_cmdline(&args, &mountpoint, &multithreaded, &foreground);
+    if (e == -1) {
+        LOG_ERROR("fuse_parse_cmdline() fail");
+        e = 1;
+        goto out_args;
+    } else if (mountpoint == NULL) {
+        if (argc == 1) LOG_ERROR("no mountpoint  -h for help");
+        e = 2;
+        goto out_args;
+    }
+
+    if (lb_ll_setup() != 0) {
+        e = 3;
+        goto out_chan;
+    }
+
+    /* see: loopbackfs.c#main() */
+    (void) umask(0);
+
+    ch = fuse_mount(mountpoint, &args);
+    if (ch == NULL) {
+        LOG_ERROR("fuse_mount() fail");
+        e = 4;
+        goto out_root;
+    }
+
+    se = fuse_lowlevel_new(&args, &lb_ll_ops, sizeof(lb_ll_ops), NULL);
+    if (se == NULL) {
+        LOG_ERROR("fuse_lowlevel_new() fail");
+        e = 5;
+        goto out_se;
+    }
+
+    if (fuse_set_signal_handlers(se) != -1) {
+        fuse_session_add_chan(se, ch);
+
+        (void) fuse_daemonize(foreground);
+
+        e = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+        if (e == -1) {
+            e = 6;
+            LOG_ERROR("fuse_session_loop() fail");
+        }
+
+        fuse_remove_signal_handlers(se);
+        fuse_session_remove_chan(ch);
+    } else {
+        e = 7;
+        LOG_ERROR("fuse_set_signal_handlers() fail");
+    }
+
+    fuse_session_destroy(se);
+out_se:
+    fuse_unmount(mountpoint, ch);
+out_root:
+    (void) close(itab.root.fd);
+out_chan:
+    free(mountpoint);
+out_args:
+    fuse_opt_free_args(&args);
+out_fail:
+    return e;
+}